@@ -3,9 +3,15 @@
 Envelope Function - envelope should always be constant duration?
 Parameter has a logarithmic effect (McAdams 1995)
 */
+#include <cmath>
 #include "adsr.h"
 
 #define DEBOUNCE_MS 20
+// shortest run worth rendering without the state machine
+#define ADSR_MIN_RUN 4
+// runs stop at this fraction of the estimated distance to a level threshold,
+// leaving a wide margin for rounding in the accumulated level
+#define ADSR_RUN_MARGIN 0.5f
 
 // Constructor
 Adsr::Adsr() : Adsr(44100.0) {}
@@ -21,9 +27,16 @@ Adsr::Adsr(float sampleRate)
 	decayTime_ = 0.01;
 	sustainlvl_ = 0.5;
 	releaseTime_ = 0.01;
+	attackCurve_ = kADSRCurveLinear;
+	decayCurve_ = kADSRCurveLinear;
+	releaseCurve_ = kADSRCurveLinear;
+	rampLength_ = 0;
+	sustainRamp_ = 0;
 	
 	// ADSR is in off state to begin with
 	adsrLevel_ = 0.0;
+	adsrMultiplier_ = 1.0;
+	adsrIncrement_ = 0.0;
 	currentState_ = kADSRStateOff;
 	
 	// Initialize Debounce counter and conditions
@@ -52,9 +65,24 @@ void Adsr::setDecay(float decayTime)
 }
 
 // Set Sustain
+// a held note moves to the new level, gliding over the ramp length
 void Adsr::setSustain(float sustainlvl)
 {
+	if (sustainlvl == sustainlvl_)
+		return;
 	sustainlvl_ = sustainlvl;
+	if (currentState_ != kADSRStateSustain)
+		return;
+	if (rampLength_ > 1)
+	{
+		startSegment(sustainlvl_, rampLength_, kADSRCurveLinear, 0);
+		sustainRamp_ = rampLength_;
+	}
+	else
+	{
+		adsrLevel_ = sustainlvl_;
+		sustainRamp_ = 0;
+	}
 }
 
 // Set Release
@@ -64,12 +92,45 @@ void Adsr::setRelease(float releaseTime)
 	invReleaseSamples_ = 1 / (releaseTime_ * sampleRate_);
 }
 
+// Set the number of samples a change of sustain level glides over
+void Adsr::setRampLength(int samples)
+{
+	rampLength_ = samples;
+}
+
+// Return whether the envelope is waiting for a note on
+bool Adsr::isIdle()
+{
+	return currentState_ == kADSRStateOff;
+}
+
+// Set segment curves
+void Adsr::setAttackCurve(int curve)
+{
+	attackCurve_ = curve;
+}
+void Adsr::setDecayCurve(int curve)
+{
+	decayCurve_ = curve;
+}
+void Adsr::setReleaseCurve(int curve)
+{
+	releaseCurve_ = curve;
+}
+
 // Return current state
 int Adsr::getState()
 {
 	return currentState_;
 }
 
+// Return whether the envelope is sounding
+bool Adsr::isActive()
+{
+	return (currentState_ != kADSRStateOff && currentState_ != kADSRStateOffDebounce
+		&& currentState_ != kADSRStateButtonHeldOff);
+}
+
 //set fixed duration (if 0, duration is not fixed)
 //fixed duration sounds have no sustain
 void Adsr::setDuration(float duration)
@@ -100,6 +161,47 @@ float Adsr::getRelease()
 	return releaseTime_;
 }
 
+// calculate the recurrence for a new segment
+void Adsr::startSegment(float target, float samples, int curve, float overshoot)
+{
+	if (curve == kADSRCurveExponential)
+	{
+		// aim past the target: level = aim + (level0 - aim) * multiplier^n
+		// multiplier chosen so the level crosses the target after the given samples
+		float aim = target > adsrLevel_ ? target + overshoot : target - overshoot;
+		float ratio = (target - aim) / (adsrLevel_ - aim);
+		if (ratio > 0 && ratio < 1)
+		{
+			adsrMultiplier_ = expf(logf(ratio) / samples);
+			adsrIncrement_ = aim * (1 - adsrMultiplier_);
+			return;
+		}
+	}
+	// linear (or already at the target)
+	// difference taken in double to match the original increment calculation exactly
+	adsrMultiplier_ = 1.0;
+	adsrIncrement_ = (double(target) - adsrLevel_) / samples;
+}
+
+// level a fraction of the way through a segment, as the recurrence renders it
+float Adsr::curveLevel(float start, float target, float position, int curve, float overshoot)
+{
+	if (curve == kADSRCurveExponential)
+	{
+		float aim = target > start ? target + overshoot : target - overshoot;
+		float ratio = (target - aim) / (start - aim);
+		if (ratio > 0 && ratio < 1)
+			return aim + (start - aim) * powf(ratio, position);
+	}
+	return start + (target - start) * position;
+}
+
+// level change at the next sample, for linear segments this is exactly the increment
+float Adsr::nextStep()
+{
+	return adsrLevel_ * (adsrMultiplier_ - 1) + adsrIncrement_;
+}
+
 // update and return ADSR level. Manage state as necessary
 // input: whether input trigger (ex. button, midi key) is currently pressed
 float Adsr::process(bool noteOn)
@@ -111,7 +213,7 @@ float Adsr::process(bool noteOn)
 			// Transition: look for note on to go to attack state
 			if (noteOn) {
 				currentState_ = kADSRStateAttack;
-				adsrIncrement_ = (1.0 - adsrLevel_) / (attackTime_ * sampleRate_);
+				startSegment(1.0, attackTime_ * sampleRate_, attackCurve_, ADSR_ATTACK_OVERSHOOT);
 				// rt_printf("adsr state change, newState: %d || level: %f || incr: %f\n", currentState_, adsrLevel_, adsrIncrement_);
 			}
 			break;
@@ -122,10 +224,10 @@ float Adsr::process(bool noteOn)
 			if (adsrLevel_ >= 1.0) {
 				adsrLevel_ = 1.0;
 				currentState_ = kADSRStateDecay;
-				adsrIncrement_ = (sustainlvl_ - 1.0) / (decayTime_ * sampleRate_);
+				startSegment(sustainlvl_, decayTime_ * sampleRate_, decayCurve_, ADSR_DECAY_OVERSHOOT);
 				// rt_printf("adsr state change, newState: %d || level: %f || incr: %f\n", currentState_, adsrLevel_, adsrIncrement_);
 			}
-			adsrLevel_ += adsrIncrement_;
+			adsrLevel_ = adsrLevel_ * adsrMultiplier_ + adsrIncrement_;
 			break;
 		}
 		case(kADSRStateDecay): {
@@ -143,18 +245,26 @@ float Adsr::process(bool noteOn)
 					currentState_ = kADSRStateSustain;
 				// rt_printf("adsr state change, newState: %d || level: %f || incr: %f\n", currentState_, adsrLevel_, adsrIncrement_);
 			}
-			adsrLevel_ += adsrIncrement_;
+			adsrLevel_ = adsrLevel_ * adsrMultiplier_ + adsrIncrement_;
 			break;
 		}
 		case(kADSRStateSustain): {
-			// Action: hold a constant level (don't change envelope value)
+			// Action: hold a constant level (don't change envelope value),
+			// or glide to a new sustain level, landing exactly on it
 			// Transition: look for note off and go to release state
 			if (!noteOn) {
 				currentState_ = kADSRStateReleaseDebounce;
 				debounceCounter_ = 0;
-				adsrIncrement_ = (0 - adsrLevel_) / (releaseTime_ * sampleRate_);
+				sustainRamp_ = 0;
+				startSegment(0, releaseTime_ * sampleRate_, releaseCurve_, ADSR_DECAY_OVERSHOOT);
 				// rt_printf("adsr state change, newState: %d || level: %f || incr: %f\n", currentState_, adsrLevel_, adsrIncrement_);
 			}
+			else if (sustainRamp_ > 0) {
+				if (--sustainRamp_ > 0)
+					adsrLevel_ = adsrLevel_ * adsrMultiplier_ + adsrIncrement_;
+				else
+					adsrLevel_ = sustainlvl_;
+			}
 			break;
 		}
 		case(kADSRStateReleaseDebounce): {
@@ -170,7 +280,7 @@ float Adsr::process(bool noteOn)
 				currentState_ = kADSRStateOff;
 				// rt_printf("adsr state change, newState: %d || level: %f || incr: %f\n", currentState_, adsrLevel_, adsrIncrement_);
 			}
-			adsrLevel_ += adsrIncrement_;
+			adsrLevel_ = adsrLevel_ * adsrMultiplier_ + adsrIncrement_;
 			debounceCounter_++;
 			break;
 		}
@@ -186,9 +296,9 @@ float Adsr::process(bool noteOn)
 			if (noteOn) {
 				currentState_ = kADSRStateAttack;
 				// rt_printf("adsr state change, newState: %d || level: %f || incr: %f\n", currentState_, adsrLevel_, adsrIncrement_);
-				adsrIncrement_ = (1.0 - adsrLevel_) / (attackTime_ * sampleRate_);
+				startSegment(1.0, attackTime_ * sampleRate_, attackCurve_, ADSR_ATTACK_OVERSHOOT);
 			}
-			adsrLevel_ += adsrIncrement_;
+			adsrLevel_ = adsrLevel_ * adsrMultiplier_ + adsrIncrement_;
 			break;
 		}
 		case(kADSRStateButtonHeldOff): {
@@ -211,4 +321,126 @@ float Adsr::process(bool noteOn)
 		}
 	}
 	return adsrLevel_;
-}
\ No newline at end of file
+}
+
+// safe number of steps before a level moving by step reaches a threshold
+// distance away (0 if moving away from it or already there). Steps only get
+// smaller along a segment (exponential segments slow down towards their
+// target) so the estimate from the current step is conservative
+static int levelRunLength(float distance, float increment)
+{
+	float steps = ADSR_RUN_MARGIN * distance / increment;
+	if (!(steps >= ADSR_MIN_RUN))
+		return 0;
+	if (steps > 1e9f)
+		return 1e9;
+	return int(steps);
+}
+
+// number of samples before the state machine could change state
+// mirrors the transition checks in process()
+int Adsr::runLength(bool noteOn)
+{
+	switch(currentState_)
+	{
+		case(kADSRStateOff):
+		case(kADSRStateSustain):
+		case(kADSRStateButtonHeldOff): {
+			// constant level, off waits for note on, the others for note off
+			if (noteOn == (currentState_ == kADSRStateOff))
+				return 0;
+			// a glide to a new sustain level lands on it in process()
+			if (currentState_ == kADSRStateSustain && sustainRamp_ > 0)
+				return sustainRamp_ - 1;
+			return 1e9;
+		}
+		case(kADSRStateAttack):
+			return levelRunLength(1.0 - adsrLevel_, nextStep());
+		case(kADSRStateDecay):
+			return levelRunLength(adsrLevel_ - sustainlvl_, -nextStep());
+		case(kADSRStateRelease): {
+			if (noteOn)
+				return 0;
+			return levelRunLength(adsrLevel_, -nextStep());
+		}
+		case(kADSRStateReleaseDebounce): {
+			// stop before the debounce interval ends as well
+			int run = levelRunLength(adsrLevel_, -nextStep());
+			int debounceRun = debounceInterval_ - debounceCounter_ + 1;
+			return run < debounceRun ? run : debounceRun;
+		}
+		case(kADSRStateOffDebounce): {
+			int debounceRun = debounceInterval_ - debounceCounter_ + 1;
+			return debounceRun > 0 ? debounceRun : 0;
+		}
+	}
+	return 0;
+}
+
+// render a block, skipping the state machine inside long runs of one segment
+// the level is accumulated sample by sample exactly as process() does, so
+// the output is bit-identical and transitions happen on the same samples
+void Adsr::processBlock(float* levels, bool* active, int numFrames, bool noteOn)
+{
+	int n = 0;
+	while (n < numFrames)
+	{
+		int run = runLength(noteOn);
+		if (run > numFrames - n)
+			run = numFrames - n;
+		
+		// near a segment boundary, step through the state machine
+		if (run < ADSR_MIN_RUN)
+		{
+			levels[n] = process(noteOn);
+			active[n] = isActive();
+			n++;
+			continue;
+		}
+		
+		// inside a segment: constant or linear ramp, no transitions
+		bool isOn = isActive();
+		float level = adsrLevel_;
+		bool sustainRamp = (currentState_ == kADSRStateSustain && sustainRamp_ > 0);
+		bool ramping = (currentState_ == kADSRStateAttack || currentState_ == kADSRStateDecay
+			|| currentState_ == kADSRStateRelease || currentState_ == kADSRStateReleaseDebounce
+			|| sustainRamp);
+		if (ramping)
+		{
+			// each level is built from the previous stored one, so the sum is
+			// never reassociated into start + i * increment (even with -ffast-math)
+			float multiplier = adsrMultiplier_;
+			float increment = adsrIncrement_;
+			float* ramp = levels + n;
+			// linear segment: one add per sample
+			if (multiplier == 1.0f)
+			{
+				ramp[0] = level + increment;
+				for (int i = 1; i < run; i++)
+					ramp[i] = ramp[i - 1] + increment;
+			}
+			// exponential segment: one multiply-add per sample
+			else
+			{
+				ramp[0] = level * multiplier + increment;
+				for (int i = 1; i < run; i++)
+					ramp[i] = ramp[i - 1] * multiplier + increment;
+			}
+			level = ramp[run - 1];
+		}
+		else
+		{
+			for (int i = 0; i < run; i++)
+				levels[n + i] = level;
+		}
+		for (int i = 0; i < run; i++)
+			active[n + i] = isOn;
+		
+		adsrLevel_ = level;
+		if (currentState_ == kADSRStateReleaseDebounce || currentState_ == kADSRStateOffDebounce)
+			debounceCounter_ += run;
+		if (sustainRamp)
+			sustainRamp_ -= run;
+		n += run;
+	}
+}
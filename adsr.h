@@ -16,6 +16,17 @@ enum {
 	kADSRStateOffDebounce,
 };
 
+// Enumerator for segment curves
+enum {
+	kADSRCurveLinear = 0,
+	kADSRCurveExponential,
+};
+
+// how far past its target an exponential segment aims, as a fraction of full
+// scale. Smaller is more curved, the segment still ends on its target on time
+#define ADSR_ATTACK_OVERSHOOT 0.3f
+#define ADSR_DECAY_OVERSHOOT 0.001f
+
 class Adsr
 {
 public:
@@ -41,6 +52,18 @@ public:
 	// Set Release
 	void setRelease(float releasems);
 	
+	// a held note glides to a new sustain level over this many samples (0 to jump)
+	void setRampLength(int samples);
+	
+	// Set curve of each segment (linear or exponential)
+	void setAttackCurve(int curve);
+	void setDecayCurve(int curve);
+	void setReleaseCurve(int curve);
+	
+	// level a fraction (0 to 1) of the way through a segment from start to
+	// target following a curve, as process() renders it (for drawing)
+	static float curveLevel(float start, float target, float position, int curve, float overshoot);
+	
 	//set fixed duration (if 0, duration is not fixed)
 	//fixed duration sounds have no sustain
 	void setDuration(float duration);
@@ -48,19 +71,46 @@ public:
 	//return the current state of the ADSR
 	int getState();
 	
+	// whether the envelope is sounding (not off, debouncing off or held off)
+	bool isActive();
+	
+	// whether the envelope is fully off (only a note on can change it)
+	bool isIdle();
+	
 	//getters
 	float getAttack();
 	float getDecay();
 	float getSustain();
 	float getRelease();
+	int getAttackCurve() { return attackCurve_; }
+	int getDecayCurve() { return decayCurve_; }
+	int getReleaseCurve() { return releaseCurve_; }
 	
 	// Get current Envelope Amplitude
 	float process(bool noteOn);
+	
+	// Fill a block with envelope amplitudes and active flags for a trigger that
+	// doesn't change during the block. Same output as calling process() per sample
+	void processBlock(float* levels, bool* active, int numFrames, bool noteOn);
 
 private:
+	// number of samples that can be rendered before any transition of the
+	// current state could fire, 0 if the next sample needs the state machine
+	int runLength(bool noteOn);
+	
+	// set multiplier and increment to go from the current level to target
+	// in a number of samples, following the given curve
+	void startSegment(float target, float samples, int curve, float overshoot);
+	
+	// change of level at the next sample
+	float nextStep();
+	
 	
 	int currentState_; // current enumerated ADSR state
 	float adsrLevel_; // current output level of ADSR
+	// every segment follows level = level * adsrMultiplier_ + adsrIncrement_
+	// (multiplier is 1 for linear segments)
+	float adsrMultiplier_; // Current amount to multiply level by
 	float adsrIncrement_; // Current amount to incremenet level by
 	int debounceCounter_; // frame counter for debounce timing
 	int debounceInterval_; // debounce interval in number of frames
@@ -68,9 +118,12 @@ private:
 	float sampleRate_;
 	// ADSR
 	float attackTime_, decayTime_, sustainlvl_, releaseTime_;
+	int attackCurve_, decayCurve_, releaseCurve_;
 	// inverse variables so we can use multiply instead of division (faster)
 	float invAttackSamples_, invDecaySamples_, invReleaseSamples_;
 	float duration_; // determines whether or not we have a fixed duration (0 sustain)
+	int rampLength_; // samples a change of sustain level glides over
+	int sustainRamp_; // samples left of a glide to the sustain level
 };
 
 #endif
\ No newline at end of file
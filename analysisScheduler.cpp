@@ -0,0 +1,69 @@
+/***** analysisScheduler.cpp *****/
+#include "analysisScheduler.h"
+
+// Constructor, task must be set with setup() before update() is called
+AnalysisScheduler::AnalysisScheduler()
+{
+	task_ = nullptr;
+	minPeriod_ = 0;
+	keepAlivePeriod_ = 0;
+	framesSinceWakeup_ = 0;
+	pending_ = false;
+	refresh_ = false;
+	wakeupCount_ = 0;
+	coalescedCount_ = 0;
+}
+
+// CALL IN SETUP
+void AnalysisScheduler::setup(AuxiliaryTask task, unsigned int minPeriod, unsigned int keepAlivePeriod)
+{
+	task_ = task;
+	minPeriod_ = minPeriod;
+	keepAlivePeriod_ = keepAlivePeriod;
+	// first update() with work ready wakes the task straight away
+	framesSinceWakeup_ = minPeriod_;
+}
+
+// decide whether to wake the task, call once per block
+void AnalysisScheduler::update(bool workReady, unsigned int frames)
+{
+	framesSinceWakeup_ += frames;
+	
+	bool keepAlive = keepAlivePeriod_ > 0 && framesSinceWakeup_ >= keepAlivePeriod_;
+	if (!workReady && !keepAlive)
+		return;
+	
+	// task hasn't started on the last wakeup yet, it will pick up this work too
+	if (pending_.load())
+	{
+		coalescedCount_++;
+		return;
+	}
+	// rate limit wakeups, work stays flagged until the next allowed one
+	if (framesSinceWakeup_ < minPeriod_)
+		return;
+	
+	refresh_ = !workReady;
+	pending_ = true;
+	framesSinceWakeup_ = 0;
+	wakeupCount_++;
+	Bela_scheduleAuxiliaryTask(task_);
+}
+
+// clear pending wakeup, new work reported from now on schedules a new one
+bool AnalysisScheduler::taskStarted()
+{
+	bool refresh = refresh_.load();
+	pending_ = false;
+	return refresh;
+}
+
+unsigned int AnalysisScheduler::getWakeupCount()
+{
+	return wakeupCount_;
+}
+
+unsigned int AnalysisScheduler::getCoalescedCount()
+{
+	return coalescedCount_;
+}
@@ -0,0 +1,48 @@
+/***** analysisScheduler.h *****/
+// Wakes an auxiliary analysis task only when it has work to do
+// render() reports once per block whether new work is ready (an FFT hop has
+// been filled, graph parameters changed). The task is scheduled at most once
+// per minimum period, and a wakeup that is still pending absorbs any further
+// requests. An optional keep-alive period wakes the task even without new
+// work so a GUI that (re)connects is refreshed.
+#ifndef ANALYSISSCHEDULER_H
+#define ANALYSISSCHEDULER_H
+
+#include <Bela.h>
+#include <atomic>
+
+class AnalysisScheduler
+{
+public:
+	AnalysisScheduler();
+	
+	// task to wake, minimum frames between wakeups and keep-alive period in
+	// frames (0 to disable). CALL IN SETUP
+	void setup(AuxiliaryTask task, unsigned int minPeriod, unsigned int keepAlivePeriod);
+	
+	// call once per block from render(), wakes the task if there is new work
+	// (or the keep-alive period has passed) and no wakeup is pending
+	void update(bool workReady, unsigned int frames);
+	
+	// call at the start of the task, returns true if this wakeup is only a
+	// keep-alive refresh (no new work was reported)
+	bool taskStarted();
+	
+	// number of wakeups scheduled and of requests absorbed by a pending wakeup
+	unsigned int getWakeupCount();
+	unsigned int getCoalescedCount();
+	
+private:
+	AuxiliaryTask task_;
+	unsigned int minPeriod_, keepAlivePeriod_;
+	unsigned int framesSinceWakeup_;
+	
+	// set by render() when the task is scheduled, cleared when the task starts
+	std::atomic<bool> pending_;
+	// whether the pending wakeup is a keep-alive refresh
+	std::atomic<bool> refresh_;
+	
+	unsigned int wakeupCount_, coalescedCount_;
+};
+
+#endif
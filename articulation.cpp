@@ -1,7 +1,60 @@
 /***** articulation.cpp *****/
 #include "articulation.h"
+#include "lookupTable.h"
+#include "denormals.h"
 #include <cmath>
 
+// size of all-pass dead zone
+// by default all-pass is middle 10% of articulation range
+static constexpr float kAllPassZone = 0.05;
+static constexpr int kArThresholdLP = int(MAX_ARTICULATION * (0.5 - kAllPassZone));
+static constexpr int kArThresholdHP = int(MAX_ARTICULATION * (0.5 + kAllPassZone));
+
+// min and max articulation time in milliseconds
+static constexpr float kMinArticTime = 5;
+static constexpr float kMaxArticTime = 600;
+
+// min and max Fc in Hz, based off of human hearing range.
+static constexpr float kMinFc = 50;
+static constexpr float kMaxFc = 20000;
+
+// Lookup table matching articulation to the rate (per second) of the exponential Fc sweep
+// baseFc = (maxFc - minFc)^(1 / (sampleRate * articTime)) = exp(rate / sampleRate)
+// so only the sample rate dependent exp is left for runtime, once per articulation change
+static constexpr LookupTable<MAX_ARTICULATION> makeArticToFcRateTable()
+{
+	LookupTable<MAX_ARTICULATION> table = {};
+	float logFcRange = ctmath::log(kMaxFc - kMinFc);
+	float articTime = 0;
+	for (int ar = 0; ar < MAX_ARTICULATION; ar++)
+	{
+		// if articulation is in low-pass zone (lower end of range)
+		if (ar <= kArThresholdLP)
+		{
+			// Articulation time is longer the farther it is from the middle of the range
+			articTime = (kMinArticTime + ((kMaxArticTime - kMinArticTime) * float(kArThresholdLP - ar)/float(kArThresholdLP))) * 0.001;
+			// for low-pass, rate calculated to get from minFc to maxFc
+			table.values[ar] = logFcRange / articTime;
+		}
+		// if articulation is in high-pass zone (higher end of range)
+		else if (ar >= kArThresholdHP)
+		{
+			// Articulation time is longer the farther it is from the middle of the range
+			articTime = (kMinArticTime + ((kMaxArticTime - kMinArticTime) * float(ar - kArThresholdHP)/float(MAX_ARTICULATION - kArThresholdHP))) * 0.001;
+			// for high-pass, rate calculated to get from maxFc to minFc (inverted)
+			table.values[ar] = -logFcRange / articTime;
+		}
+		// otherwise, we are in all-pass zone (middle of range). These values can be anything, won't be used.
+		else
+		{
+			table.values[ar] = 0;
+		}
+	}
+	return table;
+}
+// shared by all Articulation objects
+static constexpr LookupTable<MAX_ARTICULATION> kArticToFcRateTable = makeArticToFcRateTable();
+
 // Constructor
 Articulation::Articulation() : Articulation(44100.0) {}
 
@@ -16,21 +69,18 @@ Articulation::Articulation(float sampleRate)
 
 	// All pass setup
 	allPass_ = false;
-	// by default all-pass is middle 10% of articulation range
-	allPassZone_ = 0.05;
-	arThresholdLP_ = int(MAX_ARTICULATION * (0.5 - allPassZone_));
-	arThresholdHP_ = int(MAX_ARTICULATION * (0.5 + allPassZone_));
-	
-	// min and max articulation time in milliseconds
-	minArticTime_ = 5;
-	maxArticTime_ = 600;
+	graphChanged_ = true;
+	arThresholdLP_ = kArThresholdLP;
+	arThresholdHP_ = kArThresholdHP;
 
 	// Fc initialization
 	baseFc_ = 0;
 	deltaFc_ = 0;
-	// min and max Fc in Hz, based off of human hearing range.
-	minFc_ = 50;
-	maxFc_ = 20000;
+	controlPeriod_ = 1;
+	controlCount_ = 0;
+	controlBaseFc_ = 0;
+	minFc_ = kMinFc;
+	maxFc_ = kMaxFc;
 	
 	// Initialize filter parameters 
 	filterQ_ = 1.0; // Q-factor fixed at 1.0
@@ -40,41 +90,6 @@ Articulation::Articulation(float sampleRate)
 	
 	// Initialize Filter object
 	articuFilter_ = Filter(sampleRate_);
-	
-	initArticulationTable();
-}
-
-// Initialize lookup table matching articulation to baseFc
-void Articulation::initArticulationTable()
-{
-	float articTime = 0;
-	articToBaseFcTable_.reserve(MAX_ARTICULATION); // reserve size for vector
-	for (unsigned int ar = 0; ar < MAX_ARTICULATION; ar++)
-	{
-		// if articulation is in low-pass zone (lower end of range)
-		if (ar <= arThresholdLP_)
-		{
-			// Articulation time is longer the farther it is from the middle of the range, calculated on logarithmic scale
-			// articTime = (minArticTime_ + powf(maxArticTime_ - minArticTime_, float(arThresholdLP_ - ar)/float(arThresholdLP_))) * 0.001;
-			articTime = (minArticTime_ + ((maxArticTime_ - minArticTime_) * float(arThresholdLP_ - ar)/float(arThresholdLP_))) * 0.001;
-			// for low-pass, BaseFc calculated to get from minFc to maxFc
-			articToBaseFcTable_[ar] = powf((maxFc_ - minFc_), 1 / (sampleRate_ * articTime));
-		}
-		// if articulation is in high-pass zone (higher end of range)
-		else if (ar >= arThresholdHP_)
-		{
-			// Articulation time is longer the farther it is from the middle of the range, calculated on logarithmic scale
-			// articTime = (minArticTime_ + powf(maxArticTime_ - minArticTime_, float(ar - arThresholdHP_)/float(MAX_ARTICULATION - arThresholdHP_))) * 0.001;
-			articTime = (minArticTime_ + ((maxArticTime_ - minArticTime_) * float(ar - arThresholdHP_)/float(MAX_ARTICULATION - arThresholdHP_))) * 0.001;
-			// for low-pass, BaseFc calculated to get from maxFc to minFc (inverted)
-			articToBaseFcTable_[ar] = 1 / powf((maxFc_ - minFc_), 1 / (sampleRate_ * articTime));
-		}
-		// otherwise, we are in all-pass zone (middle of range). These values can be anything, won't be used.
-		else
-		{
-			articToBaseFcTable_[ar] = 0;
-		}
-	}
 }
 
 // Set sample rate, accordingly changes sampleRate of Filter object
@@ -82,6 +97,14 @@ void Articulation::setSampleRate(float frequency)
 {
 	sampleRate_ = frequency;
 	articuFilter_.setSampleRate(sampleRate_);
+	
+	// base of the Fc sweep depends on the sample rate
+	if (articulation_ <= arThresholdLP_ || articulation_ >= arThresholdHP_)
+	{
+		baseFc_ = expf(kArticToFcRateTable[articulation_] / sampleRate_);
+		controlBaseFc_ = powf(baseFc_, controlPeriod_);
+	}
+	graphChanged_ = true;
 }
 
 // Set frequency, used to set it to that of current note
@@ -94,6 +117,7 @@ void Articulation::setFrequency(float frequency)
 void Articulation::reset()
 {
 	articuFilter_.reset();
+	controlCount_ = 0;
 	if (filterType_ == kLowPass)
 	{
 		deltaFc_ = 1;
@@ -149,6 +173,18 @@ void Articulation::setAdvControls(float q)
 	}
 }
 
+// Update the filter every period samples, the sweep takes steps of period samples
+void Articulation::setControlPeriod(int period)
+{
+	if (period < 1)
+		period = 1;
+	controlPeriod_ = period;
+	controlBaseFc_ = powf(baseFc_, controlPeriod_);
+	articuFilter_.setRampLength(controlPeriod_);
+	if (controlCount_ > controlPeriod_)
+		controlCount_ = controlPeriod_;
+}
+
 // Change how the filter Fc changes according to new articulation
 void Articulation::updateArticulation(int articulation)
 {
@@ -160,7 +196,9 @@ void Articulation::updateArticulation(int articulation)
 	articulation_ = articulation;
 	
 	// Update slope
-	baseFc_ = articToBaseFcTable_[articulation_];
+	baseFc_ = expf(kArticToFcRateTable[articulation_] / sampleRate_);
+	controlBaseFc_ = powf(baseFc_, controlPeriod_);
+	graphChanged_ = true;
 	
 	//check articulation_ if low-pass
 	if (articulation_ <= arThresholdLP_)
@@ -188,16 +226,29 @@ float Articulation::process(float sampleIn)
 		return sampleIn;
 	
 	// Check if articulation has completed
-	if (filterType_ == kLowPass && filterFc_ >= maxFc_)
-		return sampleIn;
-	else if (filterType_ == kHighPass && filterFc_ <= minFc_+1)
-		return sampleIn;
+	// filterFc_ is where the filter is gliding to, it gets there at the next update
+	if (controlCount_ <= 1)
+	{
+		if (filterType_ == kLowPass && filterFc_ >= maxFc_)
+			return sampleIn;
+		else if (filterType_ == kHighPass && filterFc_ <= minFc_+1)
+			return sampleIn;
+	}
 	
 	// Otherwise, update and apply filter
-	// Update FilterFc
-	deltaFc_ *= baseFc_;
-	filterFc_ = frequency_ + minFc_ + deltaFc_;
-	articuFilter_.setFilterParams(filterFc_, filterQ_, filterType_);
+	// Update FilterFc, once every control period
+	// the coefficients glide to it over the period, except at the start of the
+	// sweep (the first update after a reset), which jumps
+	if (--controlCount_ <= 0)
+	{
+		bool start = (controlCount_ < 0);
+		controlCount_ = controlPeriod_;
+		deltaFc_ *= controlBaseFc_;
+		filterFc_ = frequency_ + minFc_ + deltaFc_;
+		articuFilter_.setFilterParams(filterFc_, filterQ_, filterType_);
+		if (start)
+			articuFilter_.finishRamp();
+	}
 	
 	// Apply filter
 	return articuFilter_.process(sampleIn);
@@ -218,7 +269,7 @@ void Articulation::updateFcGraph(Gui& gui, int bufferId)
 	{
 		// graph Fc change over the maximum artiulation time
 		// in order to work with the base factor, the time must be in units of audio frames
-		float tt = ((float(i) / ARTICULATION_GRAPH_N) * maxArticTime_ * 0.001) * sampleRate_;
+		float tt = ((float(i) / ARTICULATION_GRAPH_N) * kMaxArticTime * 0.001) * sampleRate_;
 		if (filterType_ == kLowPass)
 		{
 			float fc = pow(baseFc_, tt);
@@ -236,4 +287,20 @@ void Articulation::updateFcGraph(Gui& gui, int bufferId)
 
 	// send calculated graph buffer to the gui.
 	gui.sendBuffer(bufferId, fcGraph_, ARTICULATION_GRAPH_N);
-}
\ No newline at end of file
+}
+
+// Flush filter state and Fc sweep close to 0
+// a high-pass sweep keeps shrinking deltaFc_ for as long as the note is held
+void Articulation::flushDenormals()
+{
+	articuFilter_.flushDenormals();
+	flushDenormal(deltaFc_);
+}
+
+// check whether the Fc curve changed since the last call
+bool Articulation::checkGraphChanged()
+{
+	bool changed = graphChanged_;
+	graphChanged_ = false;
+	return changed;
+}
@@ -3,7 +3,6 @@
 #define ARTICULATION_H
 
 #include <libraries/Gui/Gui.h>
-#include <vector>
 #include "filter.h"
 
 #define MAX_ARTICULATION 256
@@ -24,9 +23,6 @@ public:
 	// Set frequency of note (Fc is relative to this frequency)
 	void setFrequency(float frequency);
 	
-	// Initialize lookup table matching articulation to baseFc
-	void initArticulationTable();
-	
 	// reset articulation to starting Fc
 	void reset();
 	
@@ -46,19 +42,27 @@ public:
 	// Change how the filter Fc changes
 	void updateArticulation(int articulation);
 	
+	// Update Fc every period samples (1 for every sample), designing the
+	// filter less often. The coefficients glide from one update to the next,
+	// so the sweep follows straight lines between the designed filters
+	void setControlPeriod(int period);
+	
 	// Update Fc and apply filter
 	float process(float sampleIn);
 	
+	// Flush filter state and Fc sweep close to 0 (call once per block)
+	void flushDenormals();
+	
 	// calculate graph
 	void updateFcGraph(Gui& gui, int bufferId);
 	
+	// whether the Fc curve changed since the last call (clears the flag)
+	bool checkGraphChanged();
+	
 private:
 
 	Filter articuFilter_; // Filter object
 	
-	// Lookup table to convert articulation to pre-calculated baseFc
-	std::vector<float> articToBaseFcTable_;
-	
 	// Current articulation value and thresholds for low pass and high pass behavior
 	int articulation_, arThresholdLP_, arThresholdHP_;
 	
@@ -70,15 +74,18 @@ private:
 	
 	float frequency_; // frequency of current note
 	
-	// all-pass variables
-	bool allPass_; // whether or not articulation is in all-pass zone
-	float allPassZone_; // size of all-pass dead zone
+	// whether or not articulation is in all-pass zone
+	bool allPass_;
+	// whether the Fc graph needs recalculating
+	bool graphChanged_;
 	
 	// parameters for how Fc changes
-	float minArticTime_, maxArticTime_; // min and max times for articulation to end
 	float baseFc_; // exponential base to multiply deltaFc by each frame
 	float deltaFc_; // exponentially accumulated value added to min or max Fc and note frequency
 	float minFc_, maxFc_; // minimum and maximum cut off frequency
+	int controlPeriod_; // samples between Fc updates
+	int controlCount_; // samples until the next Fc update
+	float controlBaseFc_; // baseFc_ to the power of controlPeriod_
 	
 	// Filter parameters
 	int filterType_; // type of filter, low-pass or high-pass
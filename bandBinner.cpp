@@ -0,0 +1,126 @@
+/***** bandBinner.cpp *****/
+#include <cmath>
+#include "bandBinner.h"
+
+// Constructor, empty until setup() is called
+BandBinner::BandBinner()
+{
+	numBands_ = 0;
+	pooling_ = kBandPoolMax;
+}
+
+// frequency (Hz) to position on the band scale
+float BandBinner::toScale(float frequency, int scale)
+{
+	switch (scale)
+	{
+		case kBandScaleLog: return log2f(frequency);
+		// Glasberg & Moore ERB-rate
+		case kBandScaleErb: return 21.4f * log10f(1.0f + 0.00437f * frequency);
+		// O'Shaughnessy mel
+		case kBandScaleMel: return 2595.0f * log10f(1.0f + frequency / 700.0f);
+		default: return frequency;
+	}
+}
+
+// position on the band scale to frequency (Hz)
+float BandBinner::fromScale(float position, int scale)
+{
+	switch (scale)
+	{
+		case kBandScaleLog: return exp2f(position);
+		case kBandScaleErb: return (powf(10.0f, position / 21.4f) - 1.0f) / 0.00437f;
+		case kBandScaleMel: return 700.0f * (powf(10.0f, position / 2595.0f) - 1.0f);
+		default: return position;
+	}
+}
+
+// CALL IN SETUP
+void BandBinner::setup(int numBins, float sampleRate, int numBands, int scale, int pooling, float minFrequency)
+{
+	numBands_ = numBands;
+	pooling_ = pooling;
+	bandStart_.resize(numBands_);
+	bandCount_.resize(numBands_);
+	invBandCount_.resize(numBands_);
+	
+	float binWidth = 0.5f * sampleRate / numBins;
+	float nyquist = 0.5f * sampleRate;
+	// linear scale starts at 0 Hz, the others can't
+	if (scale == kBandScaleLinear)
+		minFrequency = 0;
+	float scaleMin = toScale(minFrequency, scale);
+	float scaleMax = toScale(nyquist, scale);
+	
+	for (int b = 0; b < numBands_; b++)
+	{
+		float lowFrequency = fromScale(scaleMin + (scaleMax - scaleMin) * b / numBands_, scale);
+		float highFrequency = fromScale(scaleMin + (scaleMax - scaleMin) * (b + 1) / numBands_, scale);
+		// bins whose centre frequency (bin * binWidth) lies in [low, high)
+		int start = int(ceilf(lowFrequency / binWidth));
+		int end = int(ceilf(highFrequency / binWidth));
+		if (end > numBins)
+			end = numBins;
+		// band narrower than a bin, use the bin nearest its centre
+		if (end <= start)
+		{
+			start = int(0.5f * (lowFrequency + highFrequency) / binWidth + 0.5f);
+			if (start > numBins - 1)
+				start = numBins - 1;
+			end = start + 1;
+		}
+		bandStart_[b] = start;
+		bandCount_[b] = end - start;
+		invBandCount_[b] = 1.0f / bandCount_[b];
+	}
+}
+
+int BandBinner::getNumBands()
+{
+	return numBands_;
+}
+
+// pool every band's bins, computing squared magnitudes on the way
+void BandBinner::processComplex(const float* bins, float* bandPower)
+{
+	for (int b = 0; b < numBands_; b++)
+	{
+		const float* bin = bins + 2 * bandStart_[b];
+		int count = bandCount_[b];
+		float pooled = 0;
+		if (pooling_ == kBandPoolMax)
+		{
+			for (int i = 0; i < count; i++)
+				pooled = fmaxf(pooled, bin[2*i] * bin[2*i] + bin[2*i+1] * bin[2*i+1]);
+		}
+		else
+		{
+			for (int i = 0; i < count; i++)
+				pooled += bin[2*i] * bin[2*i] + bin[2*i+1] * bin[2*i+1];
+			pooled *= invBandCount_[b];
+		}
+		bandPower[b] = pooled;
+	}
+}
+
+void BandBinner::processPower(const float* binPower, float* bandPower)
+{
+	for (int b = 0; b < numBands_; b++)
+	{
+		const float* bin = binPower + bandStart_[b];
+		int count = bandCount_[b];
+		float pooled = 0;
+		if (pooling_ == kBandPoolMax)
+		{
+			for (int i = 0; i < count; i++)
+				pooled = fmaxf(pooled, bin[i]);
+		}
+		else
+		{
+			for (int i = 0; i < count; i++)
+				pooled += bin[i];
+			pooled *= invBandCount_[b];
+		}
+		bandPower[b] = pooled;
+	}
+}
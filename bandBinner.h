@@ -0,0 +1,58 @@
+/***** bandBinner.h *****/
+// Reduces FFT bins to a smaller number of frequency bands for the GUI
+// Band edges are spaced evenly on a log, ERB-rate or mel frequency scale
+// (or linearly). Each band pools a contiguous range of bins, either by taking
+// the loudest bin or the mean power. Bands narrower than a bin (at the bottom
+// of the log scales) take the bin nearest their centre. The bin ranges are
+// worked out once in setup, so reducing a frame is one pass over the bins.
+#ifndef BANDBINNER_H
+#define BANDBINNER_H
+
+#include <vector>
+
+// enumerator for band spacing
+enum {
+	kBandScaleLinear = 0,
+	kBandScaleLog,
+	kBandScaleErb,
+	kBandScaleMel
+};
+
+// enumerator for pooling bins into a band
+enum {
+	kBandPoolMax = 0, // loudest bin, keeps narrow peaks visible
+	kBandPoolPowerMean // mean power, keeps total energy
+};
+
+class BandBinner
+{
+public:
+	BandBinner();
+	
+	// calculate the bin range of every band. numBins bins cover 0 to
+	// sampleRate / 2, bands cover minFrequency to sampleRate / 2
+	// CALL IN SETUP (allocates)
+	void setup(int numBins, float sampleRate, int numBands, int scale, int pooling, float minFrequency);
+	
+	int getNumBands();
+	
+	// pool complex FFT bins (interleaved real and imaginary parts) into
+	// band powers (squared magnitudes)
+	void processComplex(const float* bins, float* bandPower);
+	// pool bin powers (squared magnitudes) into band powers
+	void processPower(const float* binPower, float* bandPower);
+	
+private:
+	// frequency to and from the position on the band scale
+	static float toScale(float frequency, int scale);
+	static float fromScale(float position, int scale);
+	
+	int numBands_;
+	int pooling_;
+	// first bin and number of bins of each band
+	std::vector<int> bandStart_, bandCount_;
+	// 1 / number of bins, for the power mean
+	std::vector<float> invBandCount_;
+};
+
+#endif
@@ -0,0 +1,223 @@
+/***** biquadCascade.h *****/
+// Cascade of biquad sections in transposed direct form II
+// Coefficients and state are stored as structure-of-arrays: [section][lane].
+// Each lane is an independent signal (e.g. one voice) with its own
+// coefficients, so processing one section for every lane is a plain loop over
+// contiguous floats that the compiler turns into NEON/SSE instructions.
+// With one lane this is simply a mono cascade, as in Brightness: each voice
+// filters its own signal, since the voices are rendered independently (on
+// several cores with VoiceRenderer) rather than in step through shared stages.
+// New coefficients can glide in: set the targets of any sections, then start
+// one ramp that moves every section towards its target in straight lines.
+#ifndef BIQUADCASCADE_H
+#define BIQUADCASCADE_H
+
+#include "filter.h"
+#include "denormals.h"
+
+// maximum number of second-order sections (16th order)
+#define BIQUAD_MAX_SECTIONS 8
+
+template <int Lanes>
+class BiquadCascade
+{
+public:
+	// Constructor, one pass-through section
+	BiquadCascade()
+	{
+		numSections_ = 1;
+		rampRemaining_ = 0;
+		BiquadCoefficients passThrough = {1, 0, 0, 0, 0};
+		for (int s = 0; s < BIQUAD_MAX_SECTIONS; s++)
+			setCoefficients(s, passThrough);
+		reset();
+	}
+	
+	// Set number of sections in use (1 to BIQUAD_MAX_SECTIONS)
+	void setNumSections(int numSections)
+	{
+		if (numSections < 1)
+			numSections = 1;
+		if (numSections > BIQUAD_MAX_SECTIONS)
+			numSections = BIQUAD_MAX_SECTIONS;
+		numSections_ = numSections;
+	}
+	int getNumSections() { return numSections_; }
+	
+	// Set coefficients of one section for one lane, at once
+	void setCoefficients(int section, int lane, const BiquadCoefficients& coeffs)
+	{
+		setTargetCoefficients(section, lane, coeffs);
+		a0_[section][lane] = coeffs.a0;
+		a1_[section][lane] = coeffs.a1;
+		a2_[section][lane] = coeffs.a2;
+		b1_[section][lane] = coeffs.b1;
+		b2_[section][lane] = coeffs.b2;
+		// keep it still if the other sections are gliding
+		da0_[section][lane] = da1_[section][lane] = da2_[section][lane] = 0;
+		db1_[section][lane] = db2_[section][lane] = 0;
+	}
+	
+	// Set coefficients of one section for every lane, at once
+	void setCoefficients(int section, const BiquadCoefficients& coeffs)
+	{
+		for (int l = 0; l < Lanes; l++)
+			setCoefficients(section, l, coeffs);
+	}
+	
+	// Set coefficients one section of one lane glides to with the next startRamp
+	void setTargetCoefficients(int section, int lane, const BiquadCoefficients& coeffs)
+	{
+		ta0_[section][lane] = coeffs.a0;
+		ta1_[section][lane] = coeffs.a1;
+		ta2_[section][lane] = coeffs.a2;
+		tb1_[section][lane] = coeffs.b1;
+		tb2_[section][lane] = coeffs.b2;
+	}
+	
+	// Set coefficients one section of every lane glides to with the next startRamp
+	void setTargetCoefficients(int section, const BiquadCoefficients& coeffs)
+	{
+		for (int l = 0; l < Lanes; l++)
+			setTargetCoefficients(section, l, coeffs);
+	}
+	
+	// Glide every section from its current coefficients to its target over a
+	// number of samples (1 or less jumps to the targets). A ramp started while
+	// another is running carries on from where that one got to
+	void startRamp(int samples)
+	{
+		if (samples <= 1)
+		{
+			finishRamp();
+			return;
+		}
+		float invSamples = 1.0f / samples;
+		for (int s = 0; s < BIQUAD_MAX_SECTIONS; s++)
+			for (int l = 0; l < Lanes; l++)
+			{
+				da0_[s][l] = (ta0_[s][l] - a0_[s][l]) * invSamples;
+				da1_[s][l] = (ta1_[s][l] - a1_[s][l]) * invSamples;
+				da2_[s][l] = (ta2_[s][l] - a2_[s][l]) * invSamples;
+				db1_[s][l] = (tb1_[s][l] - b1_[s][l]) * invSamples;
+				db2_[s][l] = (tb2_[s][l] - b2_[s][l]) * invSamples;
+			}
+		rampRemaining_ = samples;
+	}
+	
+	// Jump to the end of the current ramp
+	void finishRamp()
+	{
+		for (int s = 0; s < BIQUAD_MAX_SECTIONS; s++)
+			for (int l = 0; l < Lanes; l++)
+			{
+				a0_[s][l] = ta0_[s][l];
+				a1_[s][l] = ta1_[s][l];
+				a2_[s][l] = ta2_[s][l];
+				b1_[s][l] = tb1_[s][l];
+				b2_[s][l] = tb2_[s][l];
+			}
+		rampRemaining_ = 0;
+	}
+	
+	// Get coefficients one section of one lane is set to (the target while gliding)
+	BiquadCoefficients getCoefficients(int section, int lane)
+	{
+		BiquadCoefficients coeffs = {ta0_[section][lane], ta1_[section][lane], ta2_[section][lane],
+			tb1_[section][lane], tb2_[section][lane]};
+		return coeffs;
+	}
+	
+	// Reset state of every section of one lane
+	void reset(int lane)
+	{
+		for (int s = 0; s < BIQUAD_MAX_SECTIONS; s++)
+			s1_[s][lane] = s2_[s][lane] = 0;
+	}
+	
+	// Reset state of every lane, and jump to the end of a ramp since there is
+	// nothing left to glide from
+	void reset()
+	{
+		for (int l = 0; l < Lanes; l++)
+			reset(l);
+		finishRamp();
+	}
+	
+	// Set decayed state to zero before it becomes denormal (call once per block)
+	void flushDenormals()
+	{
+		for (int s = 0; s < numSections_; s++)
+			for (int l = 0; l < Lanes; l++)
+			{
+				flushDenormal(s1_[s][l]);
+				flushDenormal(s2_[s][l]);
+			}
+	}
+	
+	// Filter one sample of every lane in place
+	void process(float* samples)
+	{
+		// a sample further along a ramp, the last one lands on the targets
+		if (rampRemaining_ > 0)
+		{
+			if (--rampRemaining_ > 0)
+				stepRamp();
+			else
+				finishRamp();
+		}
+		
+		for (int s = 0; s < numSections_; s++)
+		{
+			// y[n] = a0*x[n] + s1
+			// s1 = a1*x[n] - b1*y[n] + s2
+			// s2 = a2*x[n] - b2*y[n]
+			for (int l = 0; l < Lanes; l++)
+			{
+				float x = samples[l];
+				float y = a0_[s][l] * x + s1_[s][l];
+				s1_[s][l] = a1_[s][l] * x - b1_[s][l] * y + s2_[s][l];
+				s2_[s][l] = a2_[s][l] * x - b2_[s][l] * y;
+				samples[l] = y;
+			}
+		}
+	}
+	
+	// Filter one sample of a single lane cascade
+	float process(float sample)
+	{
+		static_assert(Lanes == 1, "use process(float*) for more than one lane");
+		process(&sample);
+		return sample;
+	}
+	
+private:
+	// move every coefficient one step along the ramp
+	void stepRamp()
+	{
+		for (int s = 0; s < numSections_; s++)
+			for (int l = 0; l < Lanes; l++)
+			{
+				a0_[s][l] += da0_[s][l];
+				a1_[s][l] += da1_[s][l];
+				a2_[s][l] += da2_[s][l];
+				b1_[s][l] += db1_[s][l];
+				b2_[s][l] += db2_[s][l];
+			}
+	}
+	
+	int numSections_;
+	// coefficients, already normalized by b0
+	float a0_[BIQUAD_MAX_SECTIONS][Lanes], a1_[BIQUAD_MAX_SECTIONS][Lanes], a2_[BIQUAD_MAX_SECTIONS][Lanes];
+	float b1_[BIQUAD_MAX_SECTIONS][Lanes], b2_[BIQUAD_MAX_SECTIONS][Lanes];
+	// ramp targets and per sample steps
+	float ta0_[BIQUAD_MAX_SECTIONS][Lanes], ta1_[BIQUAD_MAX_SECTIONS][Lanes], ta2_[BIQUAD_MAX_SECTIONS][Lanes];
+	float tb1_[BIQUAD_MAX_SECTIONS][Lanes], tb2_[BIQUAD_MAX_SECTIONS][Lanes];
+	float da0_[BIQUAD_MAX_SECTIONS][Lanes], da1_[BIQUAD_MAX_SECTIONS][Lanes], da2_[BIQUAD_MAX_SECTIONS][Lanes];
+	float db1_[BIQUAD_MAX_SECTIONS][Lanes], db2_[BIQUAD_MAX_SECTIONS][Lanes];
+	int rampRemaining_; // samples left of the current ramp
+	// transposed direct form II state
+	float s1_[BIQUAD_MAX_SECTIONS][Lanes], s2_[BIQUAD_MAX_SECTIONS][Lanes];
+};
+
+#endif
@@ -1,6 +1,51 @@
 /***** filter.cpp *****/
 #include <cmath>
 #include "brightness.h"
+#include "lookupTable.h"
+
+// Size of all-pass dead zone at the center of the brightness range
+// by default all-pass is middle 10% of brightness range
+static constexpr float kAllPassZone = 0.05;
+static constexpr int kBrThresholdLP = int(MAX_BRIGHTNESS * (0.5 - kAllPassZone));
+static constexpr int kBrThresholdHP = int(MAX_BRIGHTNESS * (0.5 + kAllPassZone));
+
+// min and max low-pass and high-pass Fc values based on human hearing range
+static constexpr float kMinLPFc = 50;
+static constexpr float kMaxLPFc = 20000;
+static constexpr float kMinHPFc = 0;
+static constexpr float kMaxHPFc = 15000;
+
+// calculate Fc's for lookup table to convert from brightness to Fc
+static constexpr LookupTable<MAX_BRIGHTNESS> makeBrightToFcTable()
+{
+	LookupTable<MAX_BRIGHTNESS> table = {};
+	for (int br = 0; br < MAX_BRIGHTNESS; br++)
+	{
+		// if brightness is in low-pass zone (lower end of range)
+		if (br <= kBrThresholdLP)
+		{
+			// Fc scales exponentially with brightness
+			table.values[br] = kMinLPFc + ctmath::pow(kMaxLPFc - kMinLPFc, float(br)/float(kBrThresholdLP));
+		}
+		// if brightness is in high-pass zone (upper end of range)
+		else if (br >= kBrThresholdHP)
+		{
+			// Fc scales exponentially with brightness
+			table.values[br] = kMinHPFc + ctmath::pow(kMaxHPFc - kMinHPFc, float(br - kBrThresholdHP)/float(MAX_BRIGHTNESS - kBrThresholdHP));
+		}
+		// otherwise we are in all-pass zone and the Fc will not be used
+		else
+		{
+			table.values[br] = 0;
+		}
+	}
+	return table;
+}
+// lookup table matching brightness to Fc, shared by all Brightness objects
+static constexpr LookupTable<MAX_BRIGHTNESS> kBrightToFcTable = makeBrightToFcTable();
+
+// coefficient cache shared by all Brightness objects
+CoeffCache Brightness::coeffCache_;
 
 // Constructor
 Brightness::Brightness() : Brightness(44100.0, 440.0) {}
@@ -10,6 +55,7 @@ Brightness::Brightness(float sampleRate, float frequency)
 {
 	sampleRate_ = sampleRate;
 	frequency_ = frequency;
+	noteNumber_ = -1;
 	
 	filterQ_ = 1;
 	velocityQ_ = 1;
@@ -18,63 +64,86 @@ Brightness::Brightness(float sampleRate, float frequency)
 	
 	// All-pass setup
 	allPass_ = true;
-	// by default all-pass is middle 10% of articulation range
-	allPassZone_ = 0.05;
-	brThresholdLP_ = int(MAX_BRIGHTNESS * (0.5 - allPassZone_));
-	brThresholdHP_ = int(MAX_BRIGHTNESS * (0.5 + allPassZone_));
-	
-	// min and max low-pass and high-pass Fc values based on human hearing range
-	minLPFc_ = 50;
-	maxLPFc_ = 20000;
-	minHPFc_ = 0;
-	maxHPFc_ = 15000;
+	graphChanged_ = true;
+	rampLength_ = 0;
+	glideFilters_ = false;
+	brThresholdLP_ = kBrThresholdLP;
+	brThresholdHP_ = kBrThresholdHP;
 	
 	brightness_ = MAX_BRIGHTNESS / 2;
-	
-	// calculate Fc's for lookup table
-	initBrightnessTable();
 
-	// setup Filter objects
+	// setup filter cascade
+	// Butterworth section Q = 1 / (2 cos((2k+1) pi / (2 * FILTER_ORDER)))
+	brFilters_.setNumSections(NUMBER_OF_FILTERS);
 	for (unsigned int n = 0; n < NUMBER_OF_FILTERS; n++)
-	{
-		brFilters_[n].setSampleRate(sampleRate_);
-		brFilters_[n].setQ(filterQ_);
-	}
+		sectionQ_[n] = 0.5 / cosf((2*n + 1) * M_PI / (2 * FILTER_ORDER));
 }
 
-// calculate Fc's for lookup table to convert from brightness to Fc
-void Brightness::initBrightnessTable()
+// set sample rate of brightness and its Filter objects
+void Brightness::setSampleRate(float frequency)
 {
-	// reserve memory for brightness lookup table
-	brightToFcTable_.reserve(MAX_BRIGHTNESS);
-	for (unsigned int br = 0; br < MAX_BRIGHTNESS; br++)
+	sampleRate_ = frequency;
+	frf_.setSampleRate(sampleRate_);
+	
+	// coefficient cache is built once per sample rate and shared
+	if (!coeffCache_.isBuiltFor(sampleRate_))
+		buildCoeffCache(sampleRate_);
+	updateFilters();
+}
+
+// calculate cached coefficients for every brightness, MIDI note and Q bucket
+void Brightness::buildCoeffCache(float sampleRate)
+{
+	int filterTypes[MAX_BRIGHTNESS];
+	float offsets[MAX_BRIGHTNESS];
+	float scales[MAX_BRIGHTNESS];
+	for (int br = 0; br < MAX_BRIGHTNESS; br++)
 	{
-		// if brightness is in low-pass zone (lower end of range)
-		if (br <= brThresholdLP_)
+		// brightness zone is relative to note frequency (Marozeau)
+		offsets[br] = kBrightToFcTable[br];
+		scales[br] = 1;
+		if (br <= kBrThresholdLP)
+			filterTypes[br] = kLowPass;
+		else if (br >= kBrThresholdHP)
 		{
-			// Fc scales exponentially with brightness
-			brightToFcTable_[br] = minLPFc_ + pow(maxLPFc_ - minLPFc_, float(br)/float(brThresholdLP_));
-		}
-		// if brightness is in high-pass zone (upper end of range)
-		else if (br >= brThresholdHP_)
-		{
-			// Fc scales exponentially with brightness
-			brightToFcTable_[br] = minHPFc_ + pow(maxHPFc_ - minHPFc_, float(br - brThresholdHP_)/float(MAX_BRIGHTNESS - brThresholdHP_));
+			filterTypes[br] = kHighPass;
+			// transition zone for High-Pass where cutoff frequency starts at 0
+			if (br < kBrThresholdHP+10)
+				scales[br] = 0.1 * (br - kBrThresholdHP);
 		}
-		// otherwise we are in all-pass zone and the Fc will not be used
+		// all-pass zone is never filtered
 		else
-		{
-			brightToFcTable_[br] = 0;
-		}
+			filterTypes[br] = -1;
 	}
+	coeffCache_.build(sampleRate, MAX_BRIGHTNESS, filterTypes, offsets, scales);
+	coeffCache_.printReport();
 }
 
-// set sample rate of brightness and its Filter objects
-void Brightness::setSampleRate(float frequency)
+// update filter coefficients from filterFc_, filterQ_ and filterType_
+// while linked to MIDI, the resonant section's coefficients are fetched from the shared cache
+// the cascade glides to them over the ramp length
+void Brightness::updateFilters()
 {
-	sampleRate_ = frequency;
-	for (unsigned int n = 0; n < NUMBER_OF_FILTERS; n++)
-		brFilters_[n].setSampleRate(sampleRate_);
+	graphChanged_ = true;
+	if (allPass_)
+	{
+		// the filter is skipped, coming back it jumps to its new coefficients
+		glideFilters_ = false;
+		return;
+	}
+	
+	// Butterworth sections (only when FILTER_ORDER > 2), fixed Q
+	for (unsigned int n = 0; n + 1 < NUMBER_OF_FILTERS; n++)
+		brFilters_.setTargetCoefficients(n, Filter::designBiquad(filterFc_, sectionQ_[n], filterType_, sampleRate_));
+	
+	// resonant section
+	BiquadCoefficients coeffs;
+	if (!(midiLink_ && coeffCache_.lookup(brightness_, noteNumber_, filterQ_, coeffs)))
+		coeffs = Filter::designBiquad(filterFc_, filterQ_, filterType_, sampleRate_);
+	brFilters_.setTargetCoefficients(NUMBER_OF_FILTERS - 1, coeffs);
+	
+	brFilters_.startRamp(glideFilters_ ? rampLength_ : 0);
+	glideFilters_ = true;
 }
 
 // Getters
@@ -91,24 +160,24 @@ float Brightness::getQ()
 	return filterQ_;
 }
 
-// reset Filter objects
+// reset filter cascade
 void Brightness::reset()
 {
-	for (unsigned int n = 0; n < NUMBER_OF_FILTERS; n++)
-	{
-		brFilters_[n].reset();
-	}
+	brFilters_.reset();
 }
 
 // Set frequency (Fc is relative to frequency)
 void Brightness::setFrequency(float frequency)
 {
 	frequency_ = frequency;
+	// note number no longer known, filters can't use the coefficient cache
+	noteNumber_ = -1;
 }
 
 // set frequency of current note and filter resonance. Update filter
-void Brightness::setMidiIn(float frequency, float qFactor)
+void Brightness::setMidiIn(float frequency, float qFactor, int noteNumber)
 {
+	noteNumber_ = noteNumber;
 	// if frequency and Q factor both have not changed, nothing to do
 	if (frequency_ == frequency && velocityQ_ == qFactor)
 		return;
@@ -122,18 +191,13 @@ void Brightness::setMidiIn(float frequency, float qFactor)
 	// add transition zone for High-Pass where cutoff frequency starts at 0
 	// this smoothes out the sound when making the transition
 	if(brightness_ >= brThresholdHP_ && brightness_ < brThresholdHP_+10)
-		filterFc_ = 0.1 * (brightness_ - brThresholdHP_) * (frequency_ + brightToFcTable_[brightness_]);
+		filterFc_ = 0.1 * (brightness_ - brThresholdHP_) * (frequency_ + kBrightToFcTable[brightness_]);
 	// otherwise, brightness zone should be relative to note frequency (Marozeau)
 	else
-		filterFc_ = frequency_ + brightToFcTable_[brightness_];
+		filterFc_ = frequency_ + kBrightToFcTable[brightness_];
 		
 	//update filter
-	if (!allPass_)
-		for (unsigned int n = 0; n < NUMBER_OF_FILTERS; n++)
-		{
-			// set filter params (Fc, Q, type), -1 to skip setting
-			brFilters_[n].setFilterParams(filterFc_, filterQ_, filterType_);
-		}
+	updateFilters();
 }
 
 // Toggle enable for advanced controls
@@ -158,18 +222,13 @@ void Brightness::setAdvControls(float midiLink, float qFactor)
 			// add transition zone for High-Pass where cutoff frequency starts at 0
 			// this smoothes out the sound when making the transition
 			if(brightness_ >= brThresholdHP_ && brightness_ < brThresholdHP_+10)
-				filterFc_ = 0.1 * (brightness_ - brThresholdHP_) * (frequency_ + brightToFcTable_[brightness_]);
+				filterFc_ = 0.1 * (brightness_ - brThresholdHP_) * (frequency_ + kBrightToFcTable[brightness_]);
 			// otherwise, brightness zone should be relative to note frequency (Marozeau)
 			else
-				filterFc_ = frequency_ + brightToFcTable_[brightness_];
+				filterFc_ = frequency_ + kBrightToFcTable[brightness_];
 				
 			//update filter
-			if (!allPass_)
-				for (unsigned int n = 0; n < NUMBER_OF_FILTERS; n++)
-				{
-					// set filter params (Fc, Q, type), -1 to skip setting
-					brFilters_[n].setFilterParams(filterFc_, filterQ_, filterType_);
-				}
+			updateFilters();
 		}
 		return;
 	}
@@ -182,10 +241,10 @@ void Brightness::setAdvControls(float midiLink, float qFactor)
 		// add transition zone for High-Pass where cutoff frequency starts at 0
 		// this smoothes out the sound when making the transition
 		if(brightness_ >= brThresholdHP_ && brightness_ < brThresholdHP_+10)
-			filterFc_ = 0.1 * (brightness_ - brThresholdHP_) * (brightToFcTable_[brightness_]);
+			filterFc_ = 0.1 * (brightness_ - brThresholdHP_) * (kBrightToFcTable[brightness_]);
 		// otherwise, brightness zone should be relative to note frequency (Marozeau)
 		else
-			filterFc_ = brightToFcTable_[brightness_];
+			filterFc_ = kBrightToFcTable[brightness_];
 	}
 
 	// if we're here, midiLink is off. If we have a new Q factor from the gui, update filter
@@ -193,10 +252,9 @@ void Brightness::setAdvControls(float midiLink, float qFactor)
 		updateFilter = true;
 		filterQ_ = qFactor;
 	}
-	// if we are not in all pass mode and either the Fc or Q changed, update filter
-	if (updateFilter && !allPass_)
-		for (unsigned int n = 0; n < NUMBER_OF_FILTERS; n++)
-			brFilters_[n].setFilterParams(filterFc_, filterQ_, filterType_);
+	// if either the Fc or Q changed, update filter
+	if (updateFilter)
+		updateFilters();
 }
 
 // Update filter Fc based on new brightness value
@@ -212,10 +270,10 @@ void Brightness::updateBrightness(int brightness)
 	// if midiLink_ is true, the fundamental frequency_ is added to the Fc
 	// (brightness is relative to note frequency, Marozeau & deChevigne)
 	if (midiLink_)
-		targetFc = frequency_ + brightToFcTable_[brightness_];
+		targetFc = frequency_ + kBrightToFcTable[brightness_];
 	// otherwise, simply use the lookup table value
 	else
-		targetFc = brightToFcTable_[brightness_];
+		targetFc = kBrightToFcTable[brightness_];
 	
 	// add transition zone for High-Pass where cutoff frequency starts at 0
 	// this smoothes out the sound when making the transition
@@ -242,12 +300,13 @@ void Brightness::updateBrightness(int brightness)
 		allPass_ = true;
 
 	//update filter
-	if (!allPass_)
-		for (unsigned int n = 0; n < NUMBER_OF_FILTERS; n++)
-		{
-			// set filter params (Fc, Q, type), -1 to skip setting
-			brFilters_[n].setFilterParams(filterFc_, filterQ_, filterType_);
-		}
+	updateFilters();
+}
+
+// Set the number of samples filter changes glide over
+void Brightness::setRampLength(int samples)
+{
+	rampLength_ = samples;
 }
 
 // Apply brightness filters to input sample
@@ -255,8 +314,7 @@ float Brightness::process(float sampleIn)
 {
 	//check all-pass boolean (if true, do not apply filter)
 	if (!allPass_)
-		for (unsigned int n = 0; n < NUMBER_OF_FILTERS; n++)
-			sampleIn = brFilters_[n].process(sampleIn);
+		sampleIn = brFilters_.process(sampleIn);
 	
 	return sampleIn;
 }
@@ -267,7 +325,27 @@ void Brightness::updateFrfGraph(Gui& gui, int bufferId)
 	// if all-pass, graph y=0.75 (equivalent amplitude of 1 in our converted decibel scale)
 	if (allPass_)
 		gui.sendBuffer(bufferId, 0.75);
-	// otherwise, calculate FRF graph and send it.
+	// otherwise, calculate FRF graph of the whole cascade and send it.
 	else
-		brFilters_[0].updateFrfGraph(gui, bufferId);
+	{
+		BiquadCoefficients sections[NUMBER_OF_FILTERS];
+		for (unsigned int n = 0; n < NUMBER_OF_FILTERS; n++)
+			sections[n] = brFilters_.getCoefficients(n, 0);
+		frf_.evaluate(sections, NUMBER_OF_FILTERS);
+		gui.sendBuffer(bufferId, frf_.getGraph(), FRF_GRAPH_N);
+	}
+}
+
+// Flush filter state close to 0
+void Brightness::flushDenormals()
+{
+	brFilters_.flushDenormals();
+}
+
+// check whether the filter (or all-pass state) changed since the last call
+bool Brightness::checkGraphChanged()
+{
+	bool changed = graphChanged_;
+	graphChanged_ = false;
+	return changed;
 }
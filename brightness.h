@@ -2,9 +2,12 @@
 #ifndef BRIGHTNESS_H
 #define BRIGHTNESS_H
 
-#include <vector>
 #include "filter.h"
+#include "biquadCascade.h"
+#include "coeffCache.h"
 
+// order of the brightness filter, even from 2 to 2*BIQUAD_MAX_SECTIONS
+// higher orders add Butterworth sections for a steeper slope
 #define FILTER_ORDER 2
 #define NUMBER_OF_FILTERS FILTER_ORDER/2
 #define MAX_BRIGHTNESS 256
@@ -21,9 +24,6 @@ public:
 	// Set sample rate
 	void setSampleRate(float frequency);
 	
-	// Initialize lookup table to convert from brightness to Fc
-	void initBrightnessTable();
-	
 	// Getters
 	int getBrightness();
 	float getFc();
@@ -35,8 +35,8 @@ public:
 	// Set frequency of current note
 	void setFrequency(float frequency);
 	
-	// Set frequency of current ntoe and resonance of filter
-	void setMidiIn(float frequency, float qFactor);
+	// Set frequency and MIDI note number of current note and resonance of filter
+	void setMidiIn(float frequency, float qFactor, int noteNumber);
 	
 	// update brightness filter
 	void updateBrightness(int brightness);
@@ -47,20 +47,38 @@ public:
 	// advanced control behavior
 	void setAdvControls(float enable, float qFactor);
 	
+	// filter changes glide over this many samples (0 to jump to them)
+	void setRampLength(int samples);
+	
 	// Apply fitler to input sample
 	float process(float sampleIn);
 	
-	// update FRF graph, wrapper for Filter function
+	// Flush filter state close to 0 (call once per block)
+	void flushDenormals();
+	
+	// update FRF graph of the cascaded filters
 	void updateFrfGraph(Gui& gui, int bufferId);
 	
+	// whether the filter changed since the last call (clears the flag)
+	bool checkGraphChanged();
+	
 private:
-	// Filter array
-	// As of right now, only one filter object is used. Should probably revert this from an array.
-	Filter brFilters_[NUMBER_OF_FILTERS];
-
-	// lookup table matching brightness to Fc
-	std::vector<float> brightToFcTable_;
+	// update filter coefficients from current Fc, Q and type
+	void updateFilters();
 	
+	// calculate coefficients of every brightness, note and Q bucket
+	static void buildCoeffCache(float sampleRate);
+	
+	// coefficient cache shared by all Brightness objects
+	static CoeffCache coeffCache_;
+	
+	// Cascade of NUMBER_OF_FILTERS second-order sections, one lane for this voice
+	BiquadCascade<1> brFilters_;
+	// Q of each section: Butterworth, except the last which has the resonance (filterQ_)
+	float sectionQ_[NUMBER_OF_FILTERS];
+	// FRF graph of all filters in the cascade
+	FrfEvaluator frf_;
+
 	// current Brightness Value and brightness thresholds
 	int brightness_, brThresholdLP_, brThresholdHP_;
 	
@@ -70,15 +88,16 @@ private:
 	
 	// whether or not to apply brightness filter
 	bool allPass_;
-	// Size of all-pass dead zone at the center of the brightness range
-	float allPassZone_;
-	
+	// whether the FRF graph needs recalculating
+	bool graphChanged_;
+	// samples filter changes glide over
+	int rampLength_;
+	// whether the cascade has coefficients to glide from (false after all-pass)
+	bool glideFilters_;
 	// Filter parameters
 	float frequency_, velocityQ_;
+	int noteNumber_; // MIDI note of frequency_, -1 if unknown
 	float sampleRate_, filterType_, filterQ_, filterFc_;
-	
-	// Minimum and Maximum Fc values for both low pass and high pass conditions
-	float minLPFc_, maxLPFc_, minHPFc_, maxHPFc_;
 };
 
 #endif
\ No newline at end of file
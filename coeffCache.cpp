@@ -0,0 +1,124 @@
+/***** coeffCache.cpp *****/
+#include <Bela.h>
+#include <cmath>
+#include "coeffCache.h"
+
+// Constructor, cache is empty until build() is called
+CoeffCache::CoeffCache()
+{
+	sampleRate_ = 0;
+	numRows_ = 0;
+	minInvQ_ = 1.0 / COEFF_CACHE_MAX_Q;
+	invQStep_ = (1.0 / COEFF_CACHE_MIN_Q - minInvQ_) / (COEFF_CACHE_Q_BUCKETS - 1);
+	invInvQStep_ = 1.0 / invQStep_;
+}
+
+bool CoeffCache::isBuiltFor(float sampleRate)
+{
+	return sampleRate_ == sampleRate && numRows_ > 0;
+}
+
+// index of the first bucket of a (slot, note) entry
+int CoeffCache::entryIndex(int slot, int note)
+{
+	return (slot * NUM_MIDI_NOTES + note) * COEFF_CACHE_Q_BUCKETS;
+}
+
+// calculate coefficients of every stored row, note and Q bucket
+// CALL IN SETUP (allocates and runs every filter design)
+void CoeffCache::build(float sampleRate, int numRows, const int* filterTypes, const float* offsets, const float* scales)
+{
+	sampleRate_ = sampleRate;
+	numRows_ = numRows;
+	filterTypes_.assign(filterTypes, filterTypes + numRows);
+	offsets_.assign(offsets, offsets + numRows);
+	scales_.assign(scales, scales + numRows);
+
+	// assign a storage slot to every filtered row
+	rowSlots_.assign(numRows, -1);
+	int numSlots = 0;
+	for (int row = 0; row < numRows; row++)
+		if (filterTypes[row] >= 0)
+			rowSlots_[row] = numSlots++;
+
+	entries_.resize(numSlots * NUM_MIDI_NOTES * COEFF_CACHE_Q_BUCKETS);
+	for (int row = 0; row < numRows; row++)
+	{
+		int slot = rowSlots_[row];
+		if (slot < 0)
+			continue;
+		for (int note = 0; note < NUM_MIDI_NOTES; note++)
+		{
+			float fc = scales[row] * (kMidiToFreqTable[note] + offsets[row]);
+			int index = entryIndex(slot, note);
+			for (int b = 0; b < COEFF_CACHE_Q_BUCKETS; b++)
+			{
+				float q = 1.0 / (minInvQ_ + b * invQStep_);
+				entries_[index + b] = Filter::designBiquad(fc, q, filterTypes[row], sampleRate_);
+			}
+		}
+	}
+}
+
+// interpolate between the two Q buckets around q
+bool CoeffCache::lookup(int row, int note, float q, BiquadCoefficients& coeffs)
+{
+	if (row < 0 || row >= numRows_ || note < 0 || note >= NUM_MIDI_NOTES)
+		return false;
+	int slot = rowSlots_[row];
+	if (slot < 0)
+		return false;
+
+	// fractional bucket position, allow for rounding at both ends of the range
+	float position = (1.0f / q - minInvQ_) * invInvQStep_;
+	if (position < -0.001f || position > COEFF_CACHE_Q_BUCKETS - 1 + 0.001f)
+		return false;
+	int bucket = int(position);
+	if (bucket < 0)
+		bucket = 0;
+	if (bucket > COEFF_CACHE_Q_BUCKETS - 2)
+		bucket = COEFF_CACHE_Q_BUCKETS - 2;
+	float frac = position - bucket;
+
+	const BiquadCoefficients& lo = entries_[entryIndex(slot, note) + bucket];
+	const BiquadCoefficients& hi = entries_[entryIndex(slot, note) + bucket + 1];
+	coeffs.a0 = lo.a0 + frac * (hi.a0 - lo.a0);
+	coeffs.a1 = lo.a1 + frac * (hi.a1 - lo.a1);
+	coeffs.a2 = lo.a2 + frac * (hi.a2 - lo.a2);
+	coeffs.b1 = lo.b1 + frac * (hi.b1 - lo.b1);
+	coeffs.b2 = lo.b2 + frac * (hi.b2 - lo.b2);
+	return true;
+}
+
+// measure worst-case interpolation error (midway between buckets) for every entry
+void CoeffCache::printReport()
+{
+	int numSlots = entries_.size() / (NUM_MIDI_NOTES * COEFF_CACHE_Q_BUCKETS);
+	float maxError = 0;
+	for (int row = 0; row < numRows_; row++)
+	{
+		if (rowSlots_[row] < 0)
+			continue;
+		for (int note = 0; note < NUM_MIDI_NOTES; note++)
+		{
+			float fc = scales_[row] * (kMidiToFreqTable[note] + offsets_[row]);
+			for (int b = 0; b < COEFF_CACHE_Q_BUCKETS - 1; b++)
+			{
+				float q = 1.0 / (minInvQ_ + (b + 0.5) * invQStep_);
+				BiquadCoefficients exact = Filter::designBiquad(fc, q, filterTypes_[row], sampleRate_);
+				BiquadCoefficients cached;
+				lookup(row, note, q, cached);
+				float errors[5] = {
+					fabsf(exact.a0 - cached.a0), fabsf(exact.a1 - cached.a1), fabsf(exact.a2 - cached.a2),
+					fabsf(exact.b1 - cached.b1), fabsf(exact.b2 - cached.b2)
+				};
+				for (int i = 0; i < 5; i++)
+					if (errors[i] > maxError)
+						maxError = errors[i];
+			}
+		}
+	}
+	rt_printf("Coefficient cache: %d rows x %d notes x %d Q buckets, %.2f MB, max coefficient error %g\n",
+		numSlots, NUM_MIDI_NOTES, COEFF_CACHE_Q_BUCKETS,
+		entries_.size() * sizeof(BiquadCoefficients) / (1024.0 * 1024.0), maxError);
+}
@@ -0,0 +1,55 @@
+/***** coeffCache.h *****/
+// Precomputed biquad coefficients keyed by (row, MIDI note, Q bucket)
+// A row is one brightness value; its cutoff is a function of the note frequency:
+//     Fc = scale * (noteFrequency + offset)
+// Q buckets are spaced evenly in 1/Q, where every coefficient has the form
+// c / (d + e/Q), so interpolating between neighbouring buckets stays accurate.
+#ifndef COEFFCACHE_H
+#define COEFFCACHE_H
+
+#include <vector>
+#include "filter.h"
+#include "midiTables.h"
+
+// number of Q buckets and the Q range they cover (velocity Q range of midiTables)
+#define COEFF_CACHE_Q_BUCKETS 8
+#define COEFF_CACHE_MIN_Q 0.707
+#define COEFF_CACHE_MAX_Q 2.8
+
+class CoeffCache
+{
+public:
+	CoeffCache();
+
+	// whether the cache has been built for this sample rate
+	bool isBuiltFor(float sampleRate);
+
+	// fill the cache. For each row, filterTypes < 0 marks a row that is never
+	// filtered (not stored), offsets and scales define the row's cutoff
+	void build(float sampleRate, int numRows, const int* filterTypes, const float* offsets, const float* scales);
+
+	// interpolated coefficients for a row, MIDI note and Q
+	// returns false if the entry is not cached (row not stored, Q out of range)
+	bool lookup(int row, int note, float q, BiquadCoefficients& coeffs);
+
+	// print memory used and worst coefficient error against exact designs
+	void printReport();
+
+private:
+	// index of first Q bucket of an entry
+	int entryIndex(int slot, int note);
+
+	float sampleRate_;
+	int numRows_;
+	// storage slot of every row, -1 if not stored
+	std::vector<int> rowSlots_;
+	// parameters used for building, kept for the accuracy report
+	std::vector<int> filterTypes_;
+	std::vector<float> offsets_, scales_;
+	// slots x notes x buckets coefficients
+	std::vector<BiquadCoefficients> entries_;
+	// bucket grid in 1/Q
+	float minInvQ_, invQStep_, invInvQStep_;
+};
+
+#endif
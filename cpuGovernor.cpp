@@ -0,0 +1,187 @@
+/***** cpuGovernor.cpp *****/
+#include <Bela.h>
+#include <cmath>
+#include <ctime>
+#include "cpuGovernor.h"
+#include "quality.h"
+
+// what each level gives up, cheapest loss first
+struct GovernorLevel {
+	int analysisStride; // analysis frames and GUI updates made once every stride
+	int tierDrop; // quality tiers below the maximum
+	float voiceShare; // share of the voices that may sound
+};
+static constexpr GovernorLevel kGovernorLevels[] = {
+	{1, 0, 1}, // everything
+	{2, 0, 1}, // half rate analysis and GUI
+	{2, 1, 1}, // one quality tier lower
+	{4, 1, 0.75f}, // quarter rate analysis and GUI, a quarter of the voices fewer
+	{4, 2, 0.5f}, // two quality tiers lower, half the voices
+	{8, kNumQualityTiers, 0.25f} // lowest analysis rate, quality and polyphony
+};
+static constexpr int kNumGovernorLevels = sizeof(kGovernorLevels) / sizeof(kGovernorLevels[0]);
+
+static const char* kGovernorReasonNames[] = {"high load", "panic", "low load"};
+
+// monotonic clock in nanoseconds
+static inline uint64_t readNanoseconds()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+CpuGovernor::CpuGovernor()
+{
+	blockPeriod_ = 1;
+	release_ = 0;
+	holdBlocks_ = 1;
+	recoverBlocks_ = 1;
+	warmupBlocks_ = 0;
+	maxQualityTier_ = 0;
+	maxVoices_ = 1;
+	blockStart_ = 0;
+	numBlocks_ = 0;
+	blockTime_ = 0;
+	load_ = 0;
+	level_ = 0;
+	highBlocks_ = 0;
+	lowBlocks_ = 0;
+	logWrite_ = 0;
+	numDecisions_ = 0;
+	for (int i = 0; i < GOVERNOR_GUI_SIZE; i++)
+		guiBuffer_[i] = 0;
+}
+
+// CALL IN SETUP
+void CpuGovernor::setup(float sampleRate, int blockFrames, int maxQualityTier, int maxVoices)
+{
+	blockTime_ = blockFrames / sampleRate;
+	blockPeriod_ = 1e9f * blockTime_;
+	release_ = expf(-blockTime_ / GOVERNOR_RELEASE_TIME);
+	holdBlocks_ = int(GOVERNOR_HOLD_TIME / blockTime_) + 1;
+	recoverBlocks_ = int(GOVERNOR_RECOVER_TIME / blockTime_) + 1;
+	warmupBlocks_ = (unsigned int) (GOVERNOR_WARMUP_TIME / blockTime_);
+	maxQualityTier_ = maxQualityTier;
+	maxVoices_ = maxVoices < 1 ? 1 : maxVoices;
+	numBlocks_ = 0;
+	load_ = 0;
+	level_ = 0;
+	highBlocks_ = 0;
+	lowBlocks_ = 0;
+	numDecisions_ = 0;
+}
+
+void CpuGovernor::blockStarted()
+{
+	blockStart_ = readNanoseconds();
+}
+
+bool CpuGovernor::blockFinished()
+{
+	float blockLoad = (readNanoseconds() - blockStart_) / blockPeriod_;
+	numBlocks_++;
+	// the first blocks after setup are slow (cold caches, page faults)
+	if (numBlocks_ <= warmupBlocks_)
+		return false;
+	// peaks are followed at once, the load then falls back slowly
+	if (blockLoad > load_)
+		load_ = blockLoad;
+	else
+		load_ = blockLoad + release_ * (load_ - blockLoad);
+
+	int level = level_;
+	if (blockLoad > GOVERNOR_PANIC_LOAD && level_ < kNumGovernorLevels - 1)
+	{
+		changeLevel(level_ + 1, kGovernorPanic);
+		return true;
+	}
+
+	if (load_ > GOVERNOR_HIGH_LOAD)
+	{
+		if (++highBlocks_ >= holdBlocks_ && level_ < kNumGovernorLevels - 1)
+			changeLevel(level_ + 1, kGovernorHighLoad);
+	}
+	else
+		highBlocks_ = 0;
+
+	if (load_ < GOVERNOR_LOW_LOAD)
+	{
+		if (++lowBlocks_ >= recoverBlocks_ && level_ > 0)
+			changeLevel(level_ - 1, kGovernorLowLoad);
+	}
+	else
+		lowBlocks_ = 0;
+
+	return level != level_;
+}
+
+// restart both hold times so every step is measured at its own level
+void CpuGovernor::changeLevel(int level, int reason)
+{
+	GovernorDecision& decision = log_[logWrite_];
+	decision.time = numBlocks_ * blockTime_;
+	decision.load = load_;
+	decision.fromLevel = level_;
+	decision.toLevel = level;
+	decision.reason = reason;
+	if (++logWrite_ >= GOVERNOR_LOG_SIZE)
+		logWrite_ = 0;
+	numDecisions_++;
+
+	level_ = level;
+	highBlocks_ = 0;
+	lowBlocks_ = 0;
+	rt_printf("CPU governor: %.2f s, load %.0f%% (%s), level %d -> %d: quality tier %d, analysis 1/%d, %d voice(s)\n",
+		decision.time, 100 * decision.load, kGovernorReasonNames[reason], decision.fromLevel, level_,
+		getQualityTier(), getAnalysisStride(), getVoiceLimit());
+}
+
+int CpuGovernor::getNumLevels()
+{
+	return kNumGovernorLevels;
+}
+
+int CpuGovernor::getQualityTier()
+{
+	int tier = maxQualityTier_ - kGovernorLevels[level_].tierDrop;
+	return tier < 0 ? 0 : tier;
+}
+
+int CpuGovernor::getAnalysisStride()
+{
+	return kGovernorLevels[level_].analysisStride;
+}
+
+int CpuGovernor::getVoiceLimit()
+{
+	int voices = int(kGovernorLevels[level_].voiceShare * maxVoices_ + 0.5f);
+	return voices < 1 ? 1 : voices;
+}
+
+void CpuGovernor::sendToGui(Gui& gui, int bufferId)
+{
+	guiBuffer_[0] = load_;
+	guiBuffer_[1] = level_;
+	guiBuffer_[2] = getQualityTier();
+	guiBuffer_[3] = getAnalysisStride();
+	guiBuffer_[4] = getVoiceLimit();
+	for (int i = 0; i < GOVERNOR_LOG_SIZE; i++)
+	{
+		float* entry = &guiBuffer_[5 + 5 * i];
+		if (i >= numDecisions_)
+		{
+			// no decision yet, reason -1
+			entry[0] = entry[1] = entry[2] = entry[3] = 0;
+			entry[4] = -1;
+			continue;
+		}
+		const GovernorDecision& decision = log_[(logWrite_ - 1 - i + GOVERNOR_LOG_SIZE) % GOVERNOR_LOG_SIZE];
+		entry[0] = decision.time;
+		entry[1] = decision.load;
+		entry[2] = decision.fromLevel;
+		entry[3] = decision.toLevel;
+		entry[4] = decision.reason;
+	}
+	gui.sendBuffer(bufferId, guiBuffer_, GOVERNOR_GUI_SIZE);
+}
@@ -0,0 +1,110 @@
+/***** cpuGovernor.h *****/
+// Lowers the synth's CPU use before the audio thread runs out of time
+// render() is timed every block and, after a warm-up time for the caches and
+// pages to settle, its load (time over the block period) is followed by a
+// peak follower with a slow release. While the load stays above
+// GOVERNOR_HIGH_LOAD the governor steps down a level every hold time, a block
+// above GOVERNOR_PANIC_LOAD steps down at once. Levels cut the analysis rate
+// (FFT frames and GUI updates), the quality tier and, with several voices,
+// the number of voices that may sound, cheapest loss first. The
+// governor only steps back up after the load has stayed below
+// GOVERNOR_LOW_LOAD for the recover time, so it does not flip between levels.
+// Every decision is printed and the latest ones are sent to the GUI.
+#ifndef CPUGOVERNOR_H
+#define CPUGOVERNOR_H
+
+#include <libraries/Gui/Gui.h>
+#include <cstdint>
+
+//------------ ENABLE CPU GOVERNOR HERE -----------------
+#define CPU_GOVERNOR 1
+//------------ ENABLE CPU GOVERNOR HERE -----------------
+
+//------------ CHANGE CPU GOVERNOR HERE -----------------
+#define GOVERNOR_HIGH_LOAD 0.7f // load above which the governor steps down
+#define GOVERNOR_PANIC_LOAD 0.9f // load of a single block that steps down at once
+#define GOVERNOR_LOW_LOAD 0.4f // load below which it steps back up
+#define GOVERNOR_HOLD_TIME 0.1f // seconds above the high load between steps down
+#define GOVERNOR_RECOVER_TIME 3.0f // seconds below the low load before a step up
+#define GOVERNOR_RELEASE_TIME 0.5f // release time constant of the load follower (seconds)
+#define GOVERNOR_WARMUP_TIME 1.0f // seconds after setup before blocks are governed
+//------------ CHANGE CPU GOVERNOR HERE -----------------
+
+// decisions kept for the GUI
+#define GOVERNOR_LOG_SIZE 4
+// GUI buffer: load, level, quality tier, analysis stride, voice limit, then
+// per decision (newest first) time, load, old level, new level and reason
+#define GOVERNOR_GUI_SIZE (5 + 5 * GOVERNOR_LOG_SIZE)
+
+// enumerator for the reasons of a decision
+enum governorReasons {
+	kGovernorHighLoad = 0, // load above the high load for the hold time
+	kGovernorPanic, // one block above the panic load
+	kGovernorLowLoad // load below the low load for the recover time
+};
+
+struct GovernorDecision {
+	float time; // seconds since setup
+	float load; // followed load when the decision was made
+	int fromLevel;
+	int toLevel;
+	int reason;
+};
+
+class CpuGovernor
+{
+public:
+	CpuGovernor();
+
+	// sample rate, block size, and the quality tier and number of voices to
+	// play with enough headroom
+	// CALL IN SETUP
+	void setup(float sampleRate, int blockFrames, int maxQualityTier, int maxVoices = 1);
+
+	// audio thread -------------------------------------------------------------
+	// call at the start of render()
+	void blockStarted();
+	// call at the end of render(), returns true when the level changed
+	bool blockFinished();
+
+	// 0 for everything at full rate and quality, higher levels save more CPU
+	int getLevel() { return level_; }
+	int getNumLevels();
+	// quality tier of the current level (see quality.h)
+	int getQualityTier();
+	// analysis frames and GUI updates are made once every stride of their period
+	int getAnalysisStride();
+	// voices that may sound at the current level (at least one)
+	int getVoiceLimit();
+	// followed load (1 for a block taking its whole period)
+	float getLoad() { return load_; }
+
+	// send the state and the latest decisions to the GUI
+	void sendToGui(Gui& gui, int bufferId);
+
+private:
+	// move to a level and log why
+	void changeLevel(int level, int reason);
+
+	float blockPeriod_; // nanoseconds
+	float release_; // load follower multiplier per block
+	int holdBlocks_, recoverBlocks_;
+	unsigned int warmupBlocks_; // blocks before the first governed one
+	int maxQualityTier_;
+	int maxVoices_;
+
+	uint64_t blockStart_; // nanoseconds
+	unsigned int numBlocks_; // blocks since setup
+	float blockTime_; // seconds per block
+	float load_;
+	int level_;
+	int highBlocks_; // blocks above the high load since the last step down
+	int lowBlocks_; // consecutive blocks below the low load
+
+	GovernorDecision log_[GOVERNOR_LOG_SIZE];
+	int logWrite_; // next slot of the log
+	int numDecisions_;
+	float guiBuffer_[GOVERNOR_GUI_SIZE];
+};
+
+#endif
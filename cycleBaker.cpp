@@ -0,0 +1,145 @@
+/***** cycleBaker.cpp *****/
+#include "cycleBaker.h"
+
+// Constructor, nothing is allocated until setup()
+CycleBaker::CycleBaker()
+{
+	state_ = kBakeIdle;
+	algorithm_ = kFmConfigAdd;
+	interpolation_ = kInterpLinear;
+	tableSize_ = WAVETABLE_SIZE;
+	bandLimited_ = false;
+	numHarmonics_ = 0;
+	for (int i = 0; i < NUM_OPERATORS; i++)
+	{
+		phases_[i] = 0;
+		lastOutputs_[i] = 0;
+		wavetables_[i] = nullptr;
+	}
+}
+
+CycleBaker::~CycleBaker()
+{
+	NE10_FREE(neInput_);
+	NE10_FREE(neOutput_);
+	NE10_FREE(cfg_);
+}
+
+// CALL IN SETUP
+void CycleBaker::setup()
+{
+	if (cfg_)
+		return;
+	// "sample rate" of BAKE_CYCLE_N at 1 Hz renders one cycle per table
+	synth_.reset(new FreqMod(BAKE_CYCLE_N, 1.0));
+	amps_.assign(NUM_OPERATORS, 0);
+	ratios_.assign(NUM_OPERATORS, 1);
+	waves_.assign(NUM_OPERATORS, kWaveSine);
+	neInput_ = (ne10_fft_cpx_float32_t*) NE10_MALLOC (BAKE_CYCLE_N * sizeof (ne10_fft_cpx_float32_t));
+	neOutput_ = (ne10_fft_cpx_float32_t*) NE10_MALLOC (BAKE_CYCLE_N * sizeof (ne10_fft_cpx_float32_t));
+	cfg_ = ne10_fft_alloc_c2c_float32_neon (BAKE_CYCLE_N);
+	table_.assign(BAKE_CYCLE_N + 1, 0);
+}
+
+bool CycleBaker::request(int algorithm, const std::vector<float>& amps, const std::vector<float>& ratios,
+	const std::vector<int>& waves, const float* phases, const float* lastOutputs,
+	const float* const* wavetables, int interpolation, int tableSize, bool bandLimited,
+	int numHarmonics)
+{
+	if (!cfg_ || state_ != kBakeIdle)
+		return false;
+	algorithm_ = algorithm;
+	for (int i = 0; i < NUM_OPERATORS; i++)
+	{
+		amps_[i] = amps[i];
+		ratios_[i] = ratios[i];
+		waves_[i] = waves[i];
+		phases_[i] = phases[i];
+		lastOutputs_[i] = lastOutputs[i];
+		wavetables_[i] = wavetables[i];
+	}
+	interpolation_ = interpolation;
+	tableSize_ = tableSize;
+	bandLimited_ = bandLimited;
+	numHarmonics_ = numHarmonics;
+	state_ = kBakeRequested;
+	return true;
+}
+
+void CycleBaker::cancel()
+{
+	int expected = kBakeRequested;
+	if (state_.compare_exchange_strong(expected, kBakeIdle))
+		return;
+	expected = kBakeBaking;
+	if (state_.compare_exchange_strong(expected, kBakeCancelled))
+		return;
+	expected = kBakeReady;
+	state_.compare_exchange_strong(expected, kBakeIdle);
+}
+
+bool CycleBaker::start()
+{
+	int expected = kBakeReady;
+	return state_.compare_exchange_strong(expected, kBakePlaying);
+}
+
+void CycleBaker::stop()
+{
+	int expected = kBakePlaying;
+	state_.compare_exchange_strong(expected, kBakeIdle);
+}
+
+// render a cycle from the requested states and, from band-limited tables, keep
+// only its lowest harmonics
+void CycleBaker::bake()
+{
+	int expected = kBakeRequested;
+	if (!state_.compare_exchange_strong(expected, kBakeBaking))
+		return;
+
+	synth_->setAlgorithm(algorithm_);
+	synth_->setSpectrum(amps_, ratios_, waves_);
+	synth_->setQuality(interpolation_, tableSize_, bandLimited_, false);
+	// the live operators' band-limited tables are those for the note's frequency
+	synth_->setWavetables(wavetables_);
+	synth_->setState(phases_, lastOutputs_);
+	// operators step before they output, so the first sample is at 1 / N of a
+	// cycle from the requested states and the last one back at the start
+	for (int n = 1; n <= BAKE_CYCLE_N; n++)
+	{
+		neInput_[n % BAKE_CYCLE_N].r = synth_->process();
+		neInput_[n % BAKE_CYCLE_N].i = 0;
+	}
+	if (bandLimited_)
+	{
+		ne10_fft_c2c_1d_float32_neon (neOutput_, neInput_, cfg_, 0);
+
+		// bin k is harmonic k (or N - k). The inverse transform is the conjugate of
+		// the forward transform of the conjugate spectrum, divided by N
+		int numHarmonics = numHarmonics_;
+		if (numHarmonics > BAKE_CYCLE_N / 2 - 1)
+			numHarmonics = BAKE_CYCLE_N / 2 - 1;
+		for (int k = 0; k < BAKE_CYCLE_N; k++)
+		{
+			bool keep = (k <= numHarmonics || k >= BAKE_CYCLE_N - numHarmonics);
+			neInput_[k].r = keep ? neOutput_[k].r : 0;
+			neInput_[k].i = keep ? -neOutput_[k].i : 0;
+		}
+		ne10_fft_c2c_1d_float32_neon (neOutput_, neInput_, cfg_, 0);
+		for (int n = 0; n < BAKE_CYCLE_N; n++)
+			table_[n] = neOutput_[n].r * (1.0f / BAKE_CYCLE_N);
+	}
+	else
+	{
+		// the naive tables' harmonics above the note's Nyquist frequency alias
+		// when the table is played, as they do from the operators
+		for (int n = 0; n < BAKE_CYCLE_N; n++)
+			table_[n] = neInput_[n].r;
+	}
+	table_[BAKE_CYCLE_N] = table_[0];
+
+	expected = kBakeBaking;
+	if (!state_.compare_exchange_strong(expected, kBakeReady))
+		state_ = kBakeIdle;
+}
@@ -0,0 +1,103 @@
+/***** cycleBaker.h *****/
+// Bakes one band-limited cycle of a static FM spectrum into a table
+// When every sounding operator runs at a whole number ratio, FreqMod's output
+// repeats every cycle of the fundamental, so a note can play a single table
+// instead of four operators. The audio thread requests a bake with the live
+// synth's parameters, operator states and the wavetables its operators read;
+// the bake task renders one cycle from those states and tables at BAKE_CYCLE_N
+// samples per cycle and hands the table back. A cycle of naive tables keeps
+// every harmonic they have, so the table aliases when played just as the
+// operators do. A cycle of band-limited tables has the harmonics above the
+// note's Nyquist frequency (FM sidebands) dropped with an FFT. A table that starts at the request's operator states is in phase with the
+// live synth when read from the request onwards.
+// States are handed over with compare-exchanges, so a request cancelled while
+// it is being baked is thrown away rather than played.
+#ifndef CYCLEBAKER_H
+#define CYCLEBAKER_H
+
+#include <libraries/ne10/NE10.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "freqMod.h"
+
+// samples in a baked cycle (a power of 2 for the FFT)
+#define BAKE_CYCLE_N 2048
+
+// enumerator for the states of a baker
+enum bakeStates {
+	kBakeIdle = 0, // nothing requested, table unused
+	kBakeRequested, // parameters copied, waiting for the bake task
+	kBakeBaking, // bake task is writing the table
+	kBakeCancelled, // cancelled while baking, the table will be thrown away
+	kBakeReady, // table baked, not played yet
+	kBakePlaying // table is being played
+};
+
+class CycleBaker
+{
+public:
+	CycleBaker();
+	~CycleBaker();
+
+	// allocate the table, FFT and baking synth
+	// CALL IN SETUP (allocates)
+	void setup();
+
+	// audio thread -----------------------------------------------------------
+	// ask for a cycle of these parameters, starting from the operator states
+	// (NUM_OPERATORS phases, previous outputs and tables), read at the live
+	// operators' quality (see Operator::setQuality), keeping numHarmonics harmonics
+	// of band-limited tables. Returns false if the baker is busy (request again later)
+	bool request(int algorithm, const std::vector<float>& amps, const std::vector<float>& ratios,
+		const std::vector<int>& waves, const float* phases, const float* lastOutputs,
+		const float* const* wavetables, int interpolation, int tableSize, bool bandLimited,
+		int numHarmonics);
+	// drop a request or a table that has not been played
+	void cancel();
+	// start playing a baked table, returns false if none is ready
+	bool start();
+	// stop playing the table, the baker can take requests again
+	void stop();
+	// table value at a position in the cycle (0 to 1), linearly interpolated
+	// unless the operators truncate
+	float read(float cyclePhase)
+	{
+		float position = cyclePhase * BAKE_CYCLE_N;
+		int index = int(position);
+		if (interpolation_ == kInterpTruncate)
+			return table_[index];
+		float fraction = position - index;
+		return table_[index] + fraction * (table_[index + 1] - table_[index]);
+	}
+
+	// bake task ---------------------------------------------------------------
+	// whether a request is waiting to be baked
+	bool isRequested() { return state_ == kBakeRequested; }
+	// bake the waiting request, if there is one
+	void bake();
+
+private:
+	std::atomic<int> state_;
+
+	// request, written by the audio thread while idle
+	int algorithm_;
+	std::vector<float> amps_, ratios_;
+	std::vector<int> waves_;
+	float phases_[NUM_OPERATORS];
+	float lastOutputs_[NUM_OPERATORS];
+	const float* wavetables_[NUM_OPERATORS];
+	int interpolation_, tableSize_;
+	bool bandLimited_;
+	int numHarmonics_;
+
+	// baking synth, at one cycle per BAKE_CYCLE_N samples
+	std::unique_ptr<FreqMod> synth_;
+	ne10_fft_cpx_float32_t* neInput_ = nullptr;
+	ne10_fft_cpx_float32_t* neOutput_ = nullptr;
+	ne10_fft_cfg_float32_t cfg_ = nullptr;
+	// one cycle, plus the first sample again for interpolation
+	std::vector<float> table_;
+};
+
+#endif
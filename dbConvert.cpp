@@ -0,0 +1,62 @@
+/***** dbConvert.cpp *****/
+#include <Bela.h>
+#include <cmath>
+#include "dbConvert.h"
+
+// display = (10 * log10(power * gain^2) - min dB) / (max dB - min dB)
+//         = log2(power) * kDisplayPerLog2 + offset
+static constexpr float kDisplayScale = 1.0f / (DISPLAY_MAX_DB - DISPLAY_MIN_DB);
+static constexpr float kDisplayPerLog2 = 3.0103f * kDisplayScale; // 10 * log10(2) dB per octave of power
+
+// offset of the display value for a magnitude gain
+static float displayOffset(float gain)
+{
+	return (20.0f * log10f(gain) - DISPLAY_MIN_DB) * kDisplayScale;
+}
+
+// one loop, no branches: fminf/fmaxf map to vector min/max instructions
+void powerToDisplay(const float* power, float* display, int n, float gain)
+{
+	float offset = displayOffset(gain);
+	for (int i = 0; i < n; i++)
+	{
+		float value = fastLog2(power[i]) * kDisplayPerLog2 + offset;
+		display[i] = fminf(fmaxf(value, 0.0f), 1.0f);
+	}
+}
+
+void complexToDisplay(const float* bins, float* display, int numBins, float gain)
+{
+	float offset = displayOffset(gain);
+	for (int i = 0; i < numBins; i++)
+	{
+		float re = bins[2 * i];
+		float im = bins[2 * i + 1];
+		float value = fastLog2(re * re + im * im) * kDisplayPerLog2 + offset;
+		display[i] = fminf(fmaxf(value, 0.0f), 1.0f);
+	}
+}
+
+// sweep powers over the whole float range that can be displayed and beyond
+void runDbAccuracyCheck()
+{
+	float maxLogError = 0;
+	float maxDisplayError = 0;
+	for (float power = 1e-12f; power < 1e6f; power *= 1.0001f)
+	{
+		float exactLog2 = log10f(power) / log10f(2.0f);
+		float logError = fabsf(fastLog2(power) - exactLog2);
+		if (logError > maxLogError)
+			maxLogError = logError;
+		
+		float exactDb = fminf(fmaxf(10.0f * log10f(power), DISPLAY_MIN_DB), DISPLAY_MAX_DB);
+		float exactDisplay = (exactDb - DISPLAY_MIN_DB) * kDisplayScale;
+		float display;
+		powerToDisplay(&power, &display, 1, 1.0f);
+		float displayError = fabsf(display - exactDisplay);
+		if (displayError > maxDisplayError)
+			maxDisplayError = displayError;
+	}
+	rt_printf("dB accuracy check: max log2 error %g, max display error %g dB\n",
+		maxLogError, maxDisplayError * (DISPLAY_MAX_DB - DISPLAY_MIN_DB));
+}
@@ -0,0 +1,49 @@
+/***** dbConvert.h *****/
+// Fast conversion of spectra to the GUI's decibel display range
+// Works on squared magnitudes (10*log10, no sqrt) with a bit-trick log2:
+// the float exponent gives the integer part, a polynomial the mantissa
+// (max error 1e-4 in log2, 0.0003 dB). The result is clamped branch-free to
+// [-60, 20] dB and mapped to [0, 1], the range every graph in the GUI uses.
+#ifndef DBCONVERT_H
+#define DBCONVERT_H
+
+#include <cstdint>
+#include <cstring>
+
+//------------ ENABLE DB ACCURACY CHECK HERE -----------------
+// compare fastLog2 and the display conversion with log10f at setup
+#define DB_ACCURACY_CHECK 0
+//------------ ENABLE DB ACCURACY CHECK HERE -----------------
+
+// display range in decibels
+#define DISPLAY_MIN_DB -60.0f
+#define DISPLAY_MAX_DB 20.0f
+
+// approximate log2 of a positive float (0 gives -127)
+static inline float fastLog2(float x)
+{
+	int32_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	// exponent
+	float exponent = float(((bits >> 23) & 255) - 127);
+	// mantissa in [1, 2), polynomial in t = mantissa - 1 (minimax fit)
+	int32_t mantissaBits = (bits & 0x007FFFFF) | 0x3F800000;
+	float mantissa;
+	memcpy(&mantissa, &mantissaBits, sizeof(mantissa));
+	float t = mantissa - 1.0f;
+	float poly = t * (1.4390169f + t * (-0.67996192f + t * (0.32563374f + t * -0.084792111f)));
+	return exponent + poly;
+}
+
+// convert squared magnitudes (scaled by gain^2) to display values in [0, 1]
+void powerToDisplay(const float* power, float* display, int n, float gain);
+
+// convert complex bins, stored as interleaved real and imaginary parts, to
+// display values in [0, 1], magnitudes are scaled by gain
+void complexToDisplay(const float* bins, float* display, int numBins, float gain);
+
+// print the worst error of fastLog2 and of the display conversion against log10f
+// (dev tool, see DB_ACCURACY_CHECK)
+void runDbAccuracyCheck();
+
+#endif
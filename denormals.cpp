@@ -0,0 +1,48 @@
+/***** denormals.cpp *****/
+#include <Bela.h>
+#include <ctime>
+#include <cstdint>
+#include "denormals.h"
+#include "filter.h"
+
+// length of each timed tail in seconds
+#define DENORMAL_BENCHMARK_SECONDS 10
+
+// nanoseconds per sample for a filter tail after an impulse
+// flushStates snaps the filter state once per 16 sample block
+static double timeFilterTail(float sampleRate, bool flushStates)
+{
+	Filter filter(sampleRate);
+	filter.setFilterParams(200, 0.707, kLowPass);
+	int numSamples = DENORMAL_BENCHMARK_SECONDS * sampleRate;
+	// result is accumulated so the filter isn't optimised away
+	volatile float sink = 0;
+	
+	timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int n = 0; n < numSamples; n++)
+	{
+		sink = sink + filter.process(n == 0 ? 1.0f : 0.0f);
+		if (flushStates && (n & 15) == 15)
+			filter.flushDenormals();
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	
+	double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+	return ns / numSamples;
+}
+
+// compare the tail cost with no protection, state flushing and FTZ/DAZ
+void runDenormalBenchmark(float sampleRate)
+{
+	double unprotected = timeFilterTail(sampleRate, false);
+	double flushed = timeFilterTail(sampleRate, true);
+	// the setup thread goes back to its own settings afterwards
+	uint64_t fpControl = getFpControl();
+	enableFlushToZero();
+	double ftz = timeFilterTail(sampleRate, false);
+	setFpControl(fpControl);
+	rt_printf("Denormal benchmark (%d s filter tail): unprotected %.2f ns/sample, "
+		"state flushing %.2f ns/sample, FTZ/DAZ %.2f ns/sample\n",
+		DENORMAL_BENCHMARK_SECONDS, unprotected, flushed, ftz);
+}
@@ -0,0 +1,97 @@
+/***** denormals.h *****/
+// Denormal (subnormal) float protection
+// Filter feedback states and envelope tails decay towards zero after a note
+// is released. Once they become denormal every operation on them can be
+// 10-100x slower on x86. enableFlushToZero() makes the FPU treat denormals
+// as zero for the calling thread; flushDenormal() snaps a state variable to
+// zero once it is far below audibility, for FPUs where flushing isn't set.
+#ifndef DENORMALS_H
+#define DENORMALS_H
+
+#include <cmath>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <xmmintrin.h>
+#endif
+
+//------------ ENABLE DENORMAL BENCHMARK HERE -----------------
+// time a filter tail with and without flush-to-zero at setup
+#define DENORMAL_BENCHMARK 0
+//------------ ENABLE DENORMAL BENCHMARK HERE -----------------
+
+// states below this are set to 0 (about -300 dB)
+#define DENORMAL_THRESHOLD 1e-15f
+
+// set flush-to-zero and denormals-are-zero for the calling thread
+// CALL AT THE START OF EVERY AUDIO/ANALYSIS THREAD (settings are per thread)
+static inline void enableFlushToZero()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	// MXCSR FTZ (bit 15) and DAZ (bit 6)
+	_mm_setcsr(_mm_getcsr() | 0x8040);
+#elif defined(__aarch64__)
+	// FPCR FZ (bit 24)
+	uint64_t fpcr;
+	asm volatile("mrs %0, fpcr" : "=r"(fpcr));
+	asm volatile("msr fpcr, %0" : : "r"(fpcr | (1 << 24)));
+#elif defined(__arm__) && defined(__ARM_FP)
+	// FPSCR FZ (bit 24), NEON always flushes but VFP only with this set
+	uint32_t fpscr;
+	asm volatile("vmrs %0, fpscr" : "=r"(fpscr));
+	asm volatile("vmsr fpscr, %0" : : "r"(fpscr | (1 << 24)));
+#endif
+}
+
+// read and restore the calling thread's FP control register (flush-to-zero
+// included), for code that only wants flushing for a while
+static inline uint64_t getFpControl()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return _mm_getcsr();
+#elif defined(__aarch64__)
+	uint64_t fpcr;
+	asm volatile("mrs %0, fpcr" : "=r"(fpcr));
+	return fpcr;
+#elif defined(__arm__) && defined(__ARM_FP)
+	uint32_t fpscr;
+	asm volatile("vmrs %0, fpscr" : "=r"(fpscr));
+	return fpscr;
+#else
+	return 0;
+#endif
+}
+
+static inline void setFpControl(uint64_t control)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	_mm_setcsr(uint32_t(control));
+#elif defined(__aarch64__)
+	asm volatile("msr fpcr, %0" : : "r"(control));
+#elif defined(__arm__) && defined(__ARM_FP)
+	asm volatile("vmsr fpscr, %0" : : "r"(uint32_t(control)));
+#endif
+}
+
+// enable flush-to-zero once per thread, cheap enough to call every callback
+static inline void ensureFlushToZero()
+{
+	static thread_local bool enabled = false;
+	if (!enabled)
+	{
+		enableFlushToZero();
+		enabled = true;
+	}
+}
+
+// snap a decaying state variable to zero before it becomes denormal
+static inline void flushDenormal(float& value)
+{
+	if (fabsf(value) < DENORMAL_THRESHOLD)
+		value = 0;
+}
+
+// time a filter ringing out from an impulse with and without flushing,
+// printing the cost per sample of each (dev tool, see DENORMAL_BENCHMARK)
+void runDenormalBenchmark(float sampleRate);
+
+#endif
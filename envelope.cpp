@@ -1,6 +1,33 @@
 /***** env_adsr.cpp *****/
 #include <cmath>
 #include "envelope.h"
+#include "lookupTable.h"
+
+// minimum and maximum attack and decay times in milliseconds
+static constexpr float kMinAttackTime = 5;
+static constexpr float kMaxAttackTime = 291;
+static constexpr float kMinDecayTime = 5;
+static constexpr float kMaxDecayTime = 291;
+
+// lookup tables to convert envelope values to attack and decay times (in seconds)
+// attack and decay are inversely proportional to each other and have a logarithmic relation to envelope
+static constexpr LookupTable<MAX_ENVELOPE> makeEnvToAttackTable()
+{
+	LookupTable<MAX_ENVELOPE> table = {};
+	for (int env = 0; env < MAX_ENVELOPE; env++)
+		table.values[env] = (kMinAttackTime + ctmath::pow(kMaxAttackTime - kMinAttackTime, float(env)/float(MAX_ENVELOPE))) * 0.001;
+	return table;
+}
+static constexpr LookupTable<MAX_ENVELOPE> makeEnvToDecayTable()
+{
+	LookupTable<MAX_ENVELOPE> table = {};
+	for (int env = 0; env < MAX_ENVELOPE; env++)
+		table.values[env] = (kMaxDecayTime - ctmath::pow(kMaxDecayTime - kMinDecayTime, float(env)/float(MAX_ENVELOPE))) * 0.001;
+	return table;
+}
+// shared by all Envelope objects
+static constexpr LookupTable<MAX_ENVELOPE> kEnvToAttackTable = makeEnvToAttackTable();
+static constexpr LookupTable<MAX_ENVELOPE> kEnvToDecayTable = makeEnvToDecayTable();
 
 // Constructor
 Envelope::Envelope() : Envelope(44100.0) {}
@@ -14,53 +41,23 @@ Envelope::Envelope(float sampleRate)
 	// Release time fixed at default value (10 ms))
 	envAdsr_ = Adsr(sampleRate_);
 	
-	// initial values for the graph (always starts at 0,0)
-	adsrGraph_[0] = 0; // 0,0
-	adsrGraph_[1] = 0; // 0,1
-	adsrGraph_[3] = 1; // 1,1
-	adsrGraph_[5] = envAdsr_.getSustain(); // 2,1
-	adsrGraph_[6] = 0.99; // 3,0 release is constant at 10ms
-	adsrGraph_[7] = envAdsr_.getSustain(); // 3,1 sustain level
-	adsrGraph_[8] = 1; // 4,0 end
-	adsrGraph_[9] = 0; // 4,1
-	
 	// Note starts as off
 	noteOn_ = false;
+	advMode_ = false;
 	
 	// set duration to constant
 	setDuration(1);
-	minAttackTime_ = 5;
-	maxAttackTime_ = 291;
-	minDecayTime_ = 5;
-	maxDecayTime_ = 291;
 	sustain_ = 0.9;
 	
 	// bottom 40% of envelope range - no sustain
 	sustainThresholdRatio_ = 0.4;
 	sustainThreshold_ = int(sustainThresholdRatio_ * MAX_ENVELOPE);
 	
-	// initialize lookup tables
-	initEnvelopeTables();
-	
 	// default envelope 
 	envelope_ = 0;
 	updateEnvelope(MAX_ENVELOPE / 2);
 }
 
-// initialize lookup tables to convert envelope values to attack and decay values
-void Envelope::initEnvelopeTables()
-{
-	// reserve space for lookup tables
-	envToAttackTable_.reserve(MAX_ENVELOPE);
-	envToDecayTable_.reserve(MAX_ENVELOPE);
-	for (unsigned int env = 0; env < MAX_ENVELOPE; env++)
-	{
-		// attack and decay are inversely proportional to each other and have a logarithmic relation to envelope
-		envToAttackTable_[env] = (minAttackTime_ + powf(maxAttackTime_ - minAttackTime_, float(env)/float(MAX_ENVELOPE))) * 0.001;
-		envToDecayTable_[env] = (maxDecayTime_ - powf(maxDecayTime_ - minDecayTime_, float(env)/float(MAX_ENVELOPE))) * 0.001;
-	}
-}
-
 // set sample rate of of object and ADSR object
 void Envelope::setSampleRate(float f)
 {
@@ -75,11 +72,11 @@ int Envelope::getEnvelope()
 }
 float Envelope::getAttackTime()
 {
-	return envToAttackTable_[envelope_];
+	return kEnvToAttackTable[envelope_];
 }
 float Envelope::getDecayTime()
 {
-	return envToDecayTable_[envelope_];
+	return kEnvToDecayTable[envelope_];
 }
 
 // Returns whether or not note is currently on (ADSR not off)
@@ -88,6 +85,12 @@ bool Envelope::isNoteOn()
 	return noteOn_;
 }
 
+// Returns whether the ADSR is off, not just finishing a debounce
+bool Envelope::isIdle()
+{
+	return envAdsr_.isIdle();
+}
+
 // Set envelope to a constant duration (no sustain)
 void Envelope::setDuration(float duration)
 {
@@ -106,8 +109,7 @@ void Envelope::setAdvMode(bool advMode)
 	if (!advMode_)
 	{
 		// retrieve decay time from lookup table
-		envAdsr_.setDecay(envToDecayTable_[envelope_]);
-		adsrGraph_[4] = envToAttackTable_[envelope_] + envToDecayTable_[envelope_]; // 2,0
+		envAdsr_.setDecay(kEnvToDecayTable[envelope_]);
 		
 		// check if we should enable sustain
 		if (envelope_ >= sustainThreshold_)
@@ -115,21 +117,19 @@ void Envelope::setAdvMode(bool advMode)
 			// not constant duration, sustain fixed at 0.9
 			setDuration(0);
 			envAdsr_.setSustain(sustain_);
-			adsrGraph_[5] = sustain_; // sustain level
-			adsrGraph_[7] = sustain_; // sustain level
 		}
 		else
 		{
 			// constant duration (will set sustain to 0)
 			setDuration(1);
-			adsrGraph_[5] = 0; // sustain level
-			adsrGraph_[7] = 0; // sustain level
 		}
 		
-		// default release
+		// default release, every segment linear
 		envAdsr_.setRelease(0.01);
-		adsrGraph_[6] = 0.99;
-		
+		envAdsr_.setAttackCurve(kADSRCurveLinear);
+		envAdsr_.setDecayCurve(kADSRCurveLinear);
+		envAdsr_.setReleaseCurve(kADSRCurveLinear);
+		updateGraph();
 	}
 }
 
@@ -141,19 +141,25 @@ void Envelope::setAdvControls(float decay, float sustain, float release)
 		return;
 	
 	// update both ADSR object and graph buffer
-	// Update decay
 	envAdsr_.setDecay(decay);
-	adsrGraph_[4] = envAdsr_.getAttack() + decay;
-	
-	// Update sustain
 	envAdsr_.setSustain(sustain);
-	adsrGraph_[5] = sustain;
-	adsrGraph_[7] = sustain;
-	
-	// Update release
 	envAdsr_.setRelease(release);
-	adsrGraph_[6] = 1 - release;
+	updateGraph();
+}
+
+// set the curve of each segment (advanced mode only)
+void Envelope::setCurves(int attack, int decay, int release)
+{
+	if (!advMode_)
+		return;
+	if (attack == envAdsr_.getAttackCurve() && decay == envAdsr_.getDecayCurve()
+		&& release == envAdsr_.getReleaseCurve())
+		return;
 	
+	envAdsr_.setAttackCurve(attack);
+	envAdsr_.setDecayCurve(decay);
+	envAdsr_.setReleaseCurve(release);
+	updateGraph();
 }
 
 // Update attack and decay values based on new envelope value
@@ -166,16 +172,13 @@ void Envelope::updateEnvelope(int envelope)
 	envelope_ = envelope;
 	
 	// retrieve attack time from lookup table
-	envAdsr_.setAttack(envToAttackTable_[envelope_]);
-	adsrGraph_[2] = envToAttackTable_[envelope_]; // 1,0
+	envAdsr_.setAttack(kEnvToAttackTable[envelope_]);
 	
 	// default (non-advanced) behavior for decay, sustain, and release
-	// Update both ADSR object and graph buffer
 	if (!advMode_)
 	{
 		// retrieve decay time from lookup table
-		envAdsr_.setDecay(envToDecayTable_[envelope_]);
-		adsrGraph_[4] = envToAttackTable_[envelope_] + envToDecayTable_[envelope_]; // 2,0
+		envAdsr_.setDecay(kEnvToDecayTable[envelope_]);
 		
 		// check if we should enable sustain
 		if (envelope_ >= sustainThreshold_)
@@ -183,18 +186,20 @@ void Envelope::updateEnvelope(int envelope)
 			// not constant duration, sustain fixed at 0.9
 			setDuration(0);
 			envAdsr_.setSustain(sustain_);
-			adsrGraph_[5] = sustain_; // sustain level
-			adsrGraph_[7] = sustain_; // sustain level
 		}
 		else
 		{
 			// constant duration (will set sustain to 0)
 			setDuration(1);
-			adsrGraph_[5] = 0; // sustain level
-			adsrGraph_[7] = 0; // sustain level
 		}
 	}
+	updateGraph();
+}
 
+// Set the number of samples sustain level changes glide over
+void Envelope::setRampLength(int samples)
+{
+	envAdsr_.setRampLength(samples);
 }
 
 // Run ADSR process and check ADSR state to update noteOn_ variable
@@ -203,17 +208,54 @@ float Envelope::process(bool noteOn)
 	// update and retrieve ADSR level
 	float amplitude = envAdsr_.process(noteOn);
 	
-	// get current state to update noteOn_ member
-	int state = envAdsr_.getState();
-	if (state != kADSRStateOff && state != kADSRStateOffDebounce && state != kADSRStateButtonHeldOff)
-		noteOn_ = true;
-	else
-		noteOn_= false;
+	// update noteOn_ member from the ADSR state
+	noteOn_ = envAdsr_.isActive();
 	
 	// return ADSR level
 	return amplitude;
 }
 
+// ADSR levels for a block, the input note on must not change during the block
+void Envelope::processBlock(float* amplitudes, bool* notesOn, int numFrames, bool noteOn)
+{
+	envAdsr_.processBlock(amplitudes, notesOn, numFrames, noteOn);
+	noteOn_ = envAdsr_.isActive();
+}
+
+// graph of the ADSR as x,y pairs: attack and decay in seconds from 0,0, the
+// sustain level held until the release, which ends at 1,0. Each segment is
+// drawn along its curve
+void Envelope::updateGraph()
+{
+	float attackEnd = envAdsr_.getAttack();
+	float decayEnd = attackEnd + envAdsr_.getDecay();
+	float sustain = envAdsr_.getSustain();
+	float releaseStart = 1 - envAdsr_.getRelease();
+	
+	adsrGraph_[0] = 0;
+	adsrGraph_[1] = 0;
+	int point = 1;
+	point = graphSegment(point, 0, attackEnd, 0, 1, envAdsr_.getAttackCurve(), ADSR_ATTACK_OVERSHOOT);
+	point = graphSegment(point, attackEnd, decayEnd, 1, sustain, envAdsr_.getDecayCurve(), ADSR_DECAY_OVERSHOOT);
+	adsrGraph_[2 * point] = releaseStart;
+	adsrGraph_[2 * point + 1] = sustain;
+	point++;
+	graphSegment(point, releaseStart, 1, sustain, 0, envAdsr_.getReleaseCurve(), ADSR_DECAY_OVERSHOOT);
+}
+
+int Envelope::graphSegment(int point, float startX, float endX, float startLevel, float endLevel,
+	int curve, float overshoot)
+{
+	for (int i = 1; i <= ENVELOPE_GRAPH_SEGMENT_POINTS; i++)
+	{
+		float position = i / float(ENVELOPE_GRAPH_SEGMENT_POINTS);
+		adsrGraph_[2 * point] = startX + (endX - startX) * position;
+		adsrGraph_[2 * point + 1] = Adsr::curveLevel(startLevel, endLevel, position, curve, overshoot);
+		point++;
+	}
+	return point;
+}
+
 // send ADSR graph buffer to the GUI
 void Envelope::sendToGui(Gui& gui, int bufferId)
 {
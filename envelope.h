@@ -2,11 +2,14 @@
 #ifndef ENVELOPE_H
 #define ENVELOPE_H
 
-#include <vector>
 #include <libraries/Gui/Gui.h>
 #include "adsr.h"
 
 #define MAX_ENVELOPE 256
+// points drawn along each attack, decay and release segment of the graph
+#define ENVELOPE_GRAPH_SEGMENT_POINTS 8
+// the start, the three segments and the end of the sustain
+#define ENVELOPE_GRAPH_POINTS (2 + 3 * ENVELOPE_GRAPH_SEGMENT_POINTS)
 
 class Envelope
 {
@@ -20,9 +23,6 @@ public:
 	// set sample rate of object to that of the project
 	void setSampleRate(float frequency);
 	
-	// Initialize look up tables to convert envelope to attack and decay times
-	void initEnvelopeTables();
-	
 	// Getters
 	int getEnvelope();
 	float getAttackTime();
@@ -37,32 +37,47 @@ public:
 	// Set Advanced Controls: Decay, Sustain, Release
 	void setAdvControls(float decay, float sustain, float release);
 	
+	// Set Advanced Controls: curve of the attack, decay and release (kADSRCurve...),
+	// out of advanced mode every segment is linear
+	void setCurves(int attack, int decay, int release);
+	
 	// update envelope based on new envelope parameter
 	void updateEnvelope(int envelope);
 	
+	// a held note glides to a new sustain level over this many samples (0 to jump)
+	void setRampLength(int samples);
+	
 	// whether or not envelope is on
 	bool isNoteOn();
 	
+	// whether the envelope is off and won't change until a note on
+	bool isIdle();
+	
 	// retrieve the current value of the envelope
 	float process(bool noteOn);
 	
+	// retrieve a block of envelope values and whether the note is on at each sample
+	void processBlock(float* amplitudes, bool* notesOn, int numFrames, bool noteOn);
+	
 	void sendToGui(Gui& gui, int bufferId);
 	
 private:
+	// redraw the graph from the ADSR settings
+	void updateGraph();
+	// write the points along a segment into the graph from a point on, returns the next point
+	int graphSegment(int point, float startX, float endX, float startLevel, float endLevel,
+		int curve, float overshoot);
+	
 	// ADSR object
 	Adsr envAdsr_;
 	// Graph of ADSR, alternating x,y,x,y,x,y...
-	float adsrGraph_[10];
+	float adsrGraph_[2 * ENVELOPE_GRAPH_POINTS];
 	
 	// Envelope Timbre dimension value
 	int envelope_;
 	// boolean for toggling advanced mode
 	bool advMode_;
 	
-	// lookup tables to convert envelope to attack and decay times
-	std::vector<float> envToAttackTable_;
-	std::vector<float> envToDecayTable_;
-	
 	// default sustain level
 	float sustain_;
 	
@@ -74,8 +89,6 @@ private:
 	
 	bool noteOn_; // Whether or not note is on (ADSR state not off)
 	bool constantDuration_; // bool whether or not there is a sustain
-	// minimum and maximum attack and decay times in milliseconds
-	float minAttackTime_, maxAttackTime_, minDecayTime_,maxDecayTime_;
 };
 
 #endif
\ No newline at end of file
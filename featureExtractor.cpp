@@ -0,0 +1,165 @@
+/***** featureExtractor.cpp *****/
+#include <cmath>
+#include "featureExtractor.h"
+
+// Constructor, empty until setup() is called
+FeatureExtractor::FeatureExtractor()
+{
+	sampleRate_ = 44100;
+	numBins_ = 0;
+	binWidth_ = 1;
+	hopTime_ = 0;
+	onsetPower_ = 0;
+	sounding_ = false;
+	attacking_ = false;
+	peakHop_ = 0;
+	peakLevel_ = 0;
+	holdHops_ = 1;
+	for (int i = 0; i < kNumFeatures; i++)
+		features_[i] = 0;
+}
+
+// CALL IN SETUP
+void FeatureExtractor::setup(float sampleRate, int fftSize, int hopSize)
+{
+	sampleRate_ = sampleRate;
+	numBins_ = fftSize / 2;
+	binWidth_ = sampleRate_ / fftSize;
+	hopTime_ = hopSize / sampleRate_;
+	// a full scale sine through a Hann window puts 3N^2/32 of power in the positive bins
+	onsetPower_ = 3.0f * fftSize * fftSize / 32.0f * powf(10.0f, 0.1f * FEATURE_ONSET_DB);
+	lastMagnitude_.assign(numBins_, 0);
+	holdHops_ = int(FEATURE_ATTACK_HOLD / hopTime_) + 1;
+	attackLevels_.clear();
+	attackLevels_.reserve(int(FEATURE_ATTACK_MAX_TIME / hopTime_) + 1);
+	sounding_ = false;
+	attacking_ = false;
+	peakHop_ = 0;
+	peakLevel_ = 0;
+	for (int i = 0; i < kNumFeatures; i++)
+		features_[i] = 0;
+}
+
+float FeatureExtractor::harmonicPower(const float* power, float frequency)
+{
+	int bin = int(frequency / binWidth_ + 0.5f);
+	if (bin < 1 || bin >= numBins_ - 1)
+		return 0;
+	return fmaxf(power[bin], fmaxf(power[bin - 1], power[bin + 1]));
+}
+
+float FeatureExtractor::attackCrossing(float level)
+{
+	for (unsigned int i = 0; i < attackLevels_.size(); i++)
+	{
+		if (attackLevels_[i] < level)
+			continue;
+		if (i == 0)
+			return 0;
+		float below = attackLevels_[i - 1];
+		return (i - 1) + (level - below) / (attackLevels_[i] - below);
+	}
+	return attackLevels_.size();
+}
+
+void FeatureExtractor::process(const float* power, float fundamental, unsigned int hop)
+{
+	// moments and flux in one pass over the bins, skipping DC
+	float totalPower = 0;
+	float sumMagnitude = 0, sumFrequency = 0, sumFrequency2 = 0;
+	float risingMagnitude = 0;
+	for (int k = 1; k < numBins_; k++)
+	{
+		float magnitude = sqrtf(power[k]);
+		float frequency = k * binWidth_;
+		totalPower += power[k];
+		sumMagnitude += magnitude;
+		sumFrequency += frequency * magnitude;
+		sumFrequency2 += frequency * frequency * magnitude;
+		risingMagnitude += fmaxf(magnitude - lastMagnitude_[k], 0.0f);
+		lastMagnitude_[k] = magnitude;
+	}
+	
+	features_[kFeatureTime] = hop * hopTime_;
+	if (sumMagnitude > 0)
+	{
+		float centroid = sumFrequency / sumMagnitude;
+		features_[kFeatureCentroid] = centroid;
+		features_[kFeatureSpread] = sqrtf(fmaxf(sumFrequency2 / sumMagnitude - centroid * centroid, 0.0f));
+		features_[kFeatureFlux] = risingMagnitude / sumMagnitude;
+		
+		// rolloff: walk up the bins until the share of power is reached
+		float threshold = FEATURE_ROLLOFF * totalPower;
+		float cumulative = 0;
+		int k = 1;
+		for (; k < numBins_ - 1; k++)
+		{
+			cumulative += power[k];
+			if (cumulative >= threshold)
+				break;
+		}
+		features_[kFeatureRolloff] = k * binWidth_;
+	}
+	else
+	{
+		features_[kFeatureCentroid] = 0;
+		features_[kFeatureSpread] = 0;
+		features_[kFeatureFlux] = 0;
+		features_[kFeatureRolloff] = 0;
+	}
+	
+	// odd/even harmonic power of the note
+	if (fundamental > 0 && sumMagnitude > 0)
+	{
+		float oddPower = 0, evenPower = 0;
+		int harmonic = 1;
+		for (float frequency = fundamental; frequency < (numBins_ - 1) * binWidth_; frequency += fundamental, harmonic++)
+		{
+			if (harmonic & 1)
+				oddPower += harmonicPower(power, frequency);
+			else
+				evenPower += harmonicPower(power, frequency);
+		}
+		float ratio = 10.0f * log10f((oddPower + 1e-12f) / (evenPower + 1e-12f));
+		features_[kFeatureOddEven] = fminf(fmaxf(ratio, -FEATURE_ODD_EVEN_MAX_DB), FEATURE_ODD_EVEN_MAX_DB);
+	}
+	else
+	{
+		features_[kFeatureOddEven] = 0;
+	}
+	
+	// attack time: onset when the frame power crosses the threshold, the
+	// attack lasts until the level has made no new peak for the hold time,
+	// and is updated on every new peak
+	if (totalPower > onsetPower_)
+	{
+		float level = sqrtf(totalPower);
+		if (!sounding_)
+		{
+			sounding_ = true;
+			attacking_ = true;
+			attackLevels_.clear();
+			peakHop_ = 0;
+			peakLevel_ = 0;
+			features_[kFeatureAttack] = 0;
+		}
+		if (attacking_)
+		{
+			attackLevels_.push_back(level);
+			if (level > peakLevel_)
+			{
+				peakLevel_ = level;
+				peakHop_ = attackLevels_.size() - 1;
+				float rise = attackCrossing(FEATURE_ATTACK_HIGH * peakLevel_) - attackCrossing(FEATURE_ATTACK_LOW * peakLevel_);
+				features_[kFeatureAttack] = rise * hopTime_;
+			}
+			if (attackLevels_.size() - 1 - peakHop_ >= (unsigned int) holdHops_
+				|| attackLevels_.size() >= attackLevels_.capacity())
+				attacking_ = false;
+		}
+	}
+	else
+	{
+		sounding_ = false;
+	}
+}
@@ -0,0 +1,94 @@
+/***** featureExtractor.h *****/
+// Timbre features of the output, measured from the output analyzer's frames
+// Runs in the FFT task on the bin powers of every analyzed frame (no extra
+// FFTs) and keeps the latest value of each feature:
+//     centroid, spread:   magnitude weighted mean and deviation of frequency (Hz)
+//     flux:               share of the frame's magnitude that is new since the last frame
+//     rolloff:            frequency below which FEATURE_ROLLOFF of the power lies (Hz)
+//     odd/even:           power of odd over even harmonics of the note (dB)
+//     attack time:        time the level takes from FEATURE_ATTACK_LOW to
+//                         FEATURE_ATTACK_HIGH of its peak after onset (seconds)
+// The frame level of every hop since onset is kept until the attack ends (no
+// new peak for FEATURE_ATTACK_HOLD), the crossings are interpolated between
+// hops so slow and fast attacks both resolve finer than a hop.
+#ifndef FEATUREEXTRACTOR_H
+#define FEATUREEXTRACTOR_H
+
+#include <vector>
+
+//------------ ENABLE FEATURE LOG HERE -----------------
+// log every analyzed frame's features to a text file in the project folder
+#define FEATURE_LOG 0
+#define FEATURE_LOG_FILE "features.txt"
+//------------ ENABLE FEATURE LOG HERE -----------------
+
+// share of the power below the rolloff frequency
+#define FEATURE_ROLLOFF 0.85f
+// frame level (dB relative to a full scale sine) above which a note has started
+#define FEATURE_ONSET_DB -50.0f
+// shares of the peak level (amplitude) the attack time is measured between
+#define FEATURE_ATTACK_LOW 0.1f
+#define FEATURE_ATTACK_HIGH 0.9f
+// time without a new peak level that ends the attack (seconds)
+#define FEATURE_ATTACK_HOLD 0.1f
+// longest attack measured (seconds)
+#define FEATURE_ATTACK_MAX_TIME 4.0f
+// limit of the odd/even ratio when a set of harmonics is silent (dB)
+#define FEATURE_ODD_EVEN_MAX_DB 60.0f
+
+// enumerator to index features (and the features GUI buffer)
+enum features {
+	kFeatureTime = 0, // time of the frame (seconds)
+	kFeatureCentroid,
+	kFeatureSpread,
+	kFeatureFlux,
+	kFeatureRolloff,
+	kFeatureOddEven,
+	kFeatureAttack,
+	kNumFeatures
+};
+
+class FeatureExtractor
+{
+public:
+	FeatureExtractor();
+	
+	// set the FFT size and hop of the frames
+	// CALL IN SETUP (allocates)
+	void setup(float sampleRate, int fftSize, int hopSize);
+	
+	// update features with a frame's bin powers (fftSize / 2 of them), the note
+	// frequency and the number of hops elapsed up to the frame
+	void process(const float* power, float fundamental, unsigned int hop);
+	
+	// latest features, indexed by the features enum
+	const float* getFeatures() { return features_; }
+	// whether the last frame was above the onset threshold
+	bool isSounding() { return sounding_; }
+	
+private:
+	// power of the bin nearest a frequency, or of its neighbours if louder
+	float harmonicPower(const float* power, float frequency);
+	// hops since onset until the attack levels first reach a level, interpolated
+	float attackCrossing(float level);
+	
+	float sampleRate_;
+	int numBins_;
+	float binWidth_; // Hz per bin
+	float hopTime_; // seconds per hop
+	float onsetPower_; // frame power at FEATURE_ONSET_DB
+	
+	std::vector<float> lastMagnitude_; // magnitudes of the previous frame, for flux
+	
+	// attack time tracking
+	bool sounding_; // frame power is above the onset threshold
+	bool attacking_; // level still reaching new peaks since the onset
+	unsigned int peakHop_; // hops from the onset to the loudest frame
+	float peakLevel_; // loudest frame level (amplitude) since the onset
+	int holdHops_; // hops without a new peak that end the attack
+	std::vector<float> attackLevels_; // frame level of every hop since the onset
+	
+	float features_[kNumFeatures];
+};
+
+#endif
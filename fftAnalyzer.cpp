@@ -0,0 +1,174 @@
+/***** fftAnalyzer.cpp *****/
+#include <cmath>
+#include "fftAnalyzer.h"
+
+// Constructor, buffers are allocated in setup()
+FftAnalyzer::FftAnalyzer()
+{
+	sampleRate_ = 44100;
+	mode_ = kFftModeSnapshot;
+	hopSize_ = FFT_BUFFER_N;
+	hopsPerDisplay_ = 1;
+	writePtr_ = 0;
+	hopCounter_ = 0;
+	frameStride_ = 1;
+	strideCounter_ = 0;
+	ready_ = false;
+	hopCount_ = 0;
+	frameHop_ = 0;
+	previousFrameHop_ = 0;
+	displayHop_ = 0;
+	sumCount_ = 0;
+	peakDecay_ = 1;
+	smoothCoeff_ = 1;
+}
+
+FftAnalyzer::~FftAnalyzer()
+{
+	NE10_FREE(neInput_);
+	NE10_FREE(neOutput_);
+	NE10_FREE(cfg_);
+}
+
+// CALL IN SETUP
+void FftAnalyzer::setup(float sampleRate, int mode, int hopSize, int displayPeriod)
+{
+	mode_ = mode;
+	// a snapshot only shows the last frame, so only analyze that one
+	if (mode_ == kFftModeSnapshot || hopSize > displayPeriod)
+		hopSize = displayPeriod;
+	hopSize_ = hopSize;
+	hopsPerDisplay_ = (displayPeriod + hopSize_ / 2) / hopSize_;
+	
+	inputBuffer_.assign(FFT_BUFFER_N, 0);
+	writePtr_ = 0;
+	hopCounter_ = 0;
+	strideCounter_ = 0;
+	ready_ = false;
+	hopCount_ = 0;
+	frameHop_ = 0;
+	previousFrameHop_ = 0;
+	displayHop_ = 0;
+	
+	if (!cfg_)
+	{
+		neInput_ = (ne10_fft_cpx_float32_t*) NE10_MALLOC (FFT_BUFFER_N * sizeof (ne10_fft_cpx_float32_t));
+		neOutput_ = (ne10_fft_cpx_float32_t*) NE10_MALLOC (FFT_BUFFER_N * sizeof (ne10_fft_cpx_float32_t));
+		cfg_ = ne10_fft_alloc_c2c_float32_neon (FFT_BUFFER_N);
+	}
+	// Calculate a Hann window
+	window_.resize(FFT_BUFFER_N);
+	for (int n = 0; n < FFT_BUFFER_N; n++)
+		window_[n] = 0.5f * (1.0f - cosf(2.0f * M_PI * n / (float)(FFT_BUFFER_N - 1)));
+	
+	framePower_.assign(FFT_OUT_N, 0);
+	displayPower_.assign(FFT_OUT_N, 0);
+	powerSum_.assign(FFT_OUT_N, 0);
+	sumCount_ = 0;
+	
+	setSampleRate(sampleRate);
+}
+
+void FftAnalyzer::setSampleRate(float sampleRate)
+{
+	sampleRate_ = sampleRate;
+	float hopTime = hopSize_ / sampleRate_;
+	// power falls FFT_PEAK_DECAY_DB per second
+	peakDecay_ = powf(10.0f, -0.1f * FFT_PEAK_DECAY_DB * hopTime);
+	// one pole average with a FFT_SMOOTH_TIME time constant
+	smoothCoeff_ = 1.0f - expf(-hopTime / FFT_SMOOTH_TIME);
+}
+
+void FftAnalyzer::setFrameStride(int stride)
+{
+	frameStride_ = stride < 1 ? 1 : stride;
+}
+
+// one FFT per call at most; hops missed while the task was busy are skipped
+bool FftAnalyzer::process()
+{
+	if (!ready_.exchange(false))
+		return false;
+	
+	previousFrameHop_ = frameHop_;
+	frameHop_ = hopCount_;
+	// Copy data from circular buffer to NE10 buffer, oldest sample first
+	int readPtr = writePtr_;
+	for (int n = 0; n < FFT_BUFFER_N; n++)
+	{
+		// data is fully real, no imaginary component
+		neInput_[n].r = (ne10_float32_t) inputBuffer_[readPtr] * window_[n];
+		neInput_[n].i = 0;
+		if (++readPtr >= FFT_BUFFER_N)
+			readPtr = 0;
+	}
+	
+	// Run FFT
+	ne10_fft_c2c_1d_float32_neon (neOutput_, neInput_, cfg_, 0);
+	
+	accumulate();
+	
+	// display once per display period, however many frames were analyzed
+	if (frameHop_ - displayHop_ < (unsigned int) hopsPerDisplay_)
+		return false;
+	displayHop_ = frameHop_;
+	// Welch: the display spectrum is the mean of the frames since the last one
+	if (mode_ == kFftModeWelch)
+	{
+		float invCount = 1.0f / sumCount_;
+		for (int k = 0; k < FFT_OUT_N; k++)
+		{
+			displayPower_[k] = powerSum_[k] * invCount;
+			powerSum_[k] = 0;
+		}
+		sumCount_ = 0;
+	}
+	return true;
+}
+
+void FftAnalyzer::accumulate()
+{
+	// decay and smoothing follow the hops since the last analyzed frame
+	int hops = frameHop_ - previousFrameHop_;
+	if (hops < 1)
+		hops = 1;
+	float total = 0;
+	for (int k = 0; k < FFT_OUT_N; k++)
+	{
+		float power = neOutput_[k].r * neOutput_[k].r + neOutput_[k].i * neOutput_[k].i;
+		framePower_[k] = power;
+		total += power;
+	}
+	// silence: forget the held and averaged powers
+	if (total == 0)
+	{
+		for (int k = 0; k < FFT_OUT_N; k++)
+			displayPower_[k] = powerSum_[k] = 0;
+		sumCount_ = 0;
+	}
+	
+	switch (mode_)
+	{
+		case kFftModeWelch:
+			for (int k = 0; k < FFT_OUT_N; k++)
+				powerSum_[k] += framePower_[k];
+			sumCount_++;
+			break;
+		case kFftModePeakHold: {
+			float decay = powf(peakDecay_, hops);
+			for (int k = 0; k < FFT_OUT_N; k++)
+				displayPower_[k] = fmaxf(displayPower_[k] * decay, framePower_[k]);
+			break;
+		}
+		case kFftModeSmooth: {
+			float coeff = hops == 1 ? smoothCoeff_ : 1.0f - powf(1.0f - smoothCoeff_, hops);
+			for (int k = 0; k < FFT_OUT_N; k++)
+				displayPower_[k] += coeff * (framePower_[k] - displayPower_[k]);
+			break;
+		}
+		default:
+			for (int k = 0; k < FFT_OUT_N; k++)
+				displayPower_[k] = framePower_[k];
+			break;
+	}
+}
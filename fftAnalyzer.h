@@ -0,0 +1,119 @@
+/***** fftAnalyzer.h *****/
+// Running spectrum analyzer for one signal
+// The audio thread pushes samples into a circular buffer and flags a frame
+// every hop; the FFT task windows the latest FFT_BUFFER_N samples, runs one
+// FFT per hop and folds the frame's bin powers into the display spectrum.
+// Frames are combined according to the mode and the display spectrum is
+// handed out once per display period, which is independent of the hop:
+//     snapshot:  the last frame only (hop = display period)
+//     Welch:     mean power of every frame since the last display
+//     peak hold: per bin maximum, decaying at a fixed dB per second
+//     smooth:    exponential moving average of the frame powers
+// A silent frame clears the held and averaged powers, so the display goes
+// silent with the signal. To save CPU, frames can be analyzed on only every
+// few hops (the frame stride): the display period stays the same and the peak
+// decay and smoothing follow the hops between analyzed frames.
+#ifndef FFTANALYZER_H
+#define FFTANALYZER_H
+
+#include <libraries/ne10/NE10.h>
+#include <atomic>
+#include <vector>
+
+#define FFT_BUFFER_N 1024
+#define FFT_OUT_N (FFT_BUFFER_N / 2)
+
+// peak hold decay (dB per second) and smoothing time constant (seconds)
+#define FFT_PEAK_DECAY_DB 20.0f
+#define FFT_SMOOTH_TIME 0.3f
+
+// enumerator for the ways frames are combined
+enum {
+	kFftModeSnapshot = 0,
+	kFftModeWelch,
+	kFftModePeakHold,
+	kFftModeSmooth
+};
+
+class FftAnalyzer
+{
+public:
+	FftAnalyzer();
+	~FftAnalyzer();
+	
+	// allocate buffers and set hop (samples between frames) and display period
+	// (samples between display spectra, rounded to a whole number of hops)
+	// CALL IN SETUP (allocates)
+	void setup(float sampleRate, int mode, int hopSize, int displayPeriod);
+	// recalculate the decay and smoothing coefficients
+	void setSampleRate(float sampleRate);
+	// analyze a frame every stride hops (1 for every hop, audio thread)
+	void setFrameStride(int stride);
+	
+	// add a sample, flagging a frame every hop (audio thread)
+	void push(float in)
+	{
+		inputBuffer_[writePtr_] = in;
+		if (++writePtr_ >= FFT_BUFFER_N)
+			writePtr_ = 0;
+		if (++hopCounter_ >= hopSize_)
+		{
+			hopCounter_ = 0;
+			hopCount_++;
+			if (++strideCounter_ >= frameStride_)
+			{
+				strideCounter_ = 0;
+				ready_ = true;
+			}
+		}
+	}
+	
+	// whether a frame is waiting to be analyzed
+	bool isReady() { return ready_; }
+	
+	// analyze the waiting frame, if there is one (FFT task)
+	// returns true when a new display spectrum is ready
+	bool process();
+	
+	// number of hops pushed up to the end of the last frame
+	unsigned int getFrameHop() { return frameHop_; }
+	// squared bin magnitudes (FFT_OUT_N) of the last frame
+	const float* getFramePower() { return framePower_.data(); }
+	// squared bin magnitudes (FFT_OUT_N) of the display spectrum
+	const float* getDisplayPower() { return displayPower_.data(); }
+	
+private:
+	// fold the last frame into the display spectrum
+	void accumulate();
+	
+	float sampleRate_;
+	int mode_;
+	int hopSize_;
+	int hopsPerDisplay_; // hops between display spectra
+	
+	// audio thread side
+	std::vector<float> inputBuffer_; // circular buffer of sample values
+	int writePtr_; // next sample to write, also the oldest sample in the buffer
+	int hopCounter_; // samples since the last hop
+	int frameStride_; // hops between analyzed frames
+	int strideCounter_; // hops since the last analyzed frame
+	std::atomic<bool> ready_; // a frame is waiting to be analyzed
+	std::atomic<unsigned int> hopCount_; // hops pushed since setup
+	
+	// FFT task side
+	ne10_fft_cpx_float32_t* neInput_ = nullptr; // windowed input of the FFT
+	ne10_fft_cpx_float32_t* neOutput_ = nullptr; // output of the FFT
+	ne10_fft_cfg_float32_t cfg_ = nullptr; // size of the FFT
+	std::vector<float> window_; // Hann window
+	unsigned int frameHop_; // hopCount_ when the last frame was analyzed
+	unsigned int previousFrameHop_; // frameHop_ of the frame before
+	unsigned int displayHop_; // frameHop_ of the last display spectrum
+	std::vector<float> framePower_; // bin powers of the last frame
+	std::vector<float> displayPower_; // display spectrum (running state for peak hold and smooth)
+	std::vector<float> powerSum_; // Welch sum of bin powers since the last display
+	int sumCount_; // frames in powerSum_
+	float peakDecay_; // peak hold power multiplier per hop
+	float smoothCoeff_; // smoothing coefficient per hop
+};
+
+#endif
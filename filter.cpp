@@ -7,8 +7,8 @@ filter.cpp: implement a second-order lowpass filter of variable frequency and Q
 // Copied from MAP code, modified by Joshua Ryan Lam, further streamlined by Joshua Ryan Lam
 
 #include <cmath>
-#include <complex>
 #include "filter.h"
+#include "denormals.h"
 
 // Constructor
 Filter::Filter() : Filter(44100.0) {}
@@ -24,6 +24,8 @@ Filter::Filter(float sampleRate)
 	frequency_ = 1000.0;
 	q_ = 0.707;
 	ready_ = false;	// This flag will be set to true when the coefficients are calculated
+	rampLength_ = 0;
+	rampRemaining_ = 0;
 }
 	
 // Set the sample rate, used for all calculations
@@ -31,6 +33,7 @@ void Filter::setSampleRate(float frequency)
 {
 	sampleRate_ = frequency;
 	T_ = 1.0/sampleRate_;
+	frf_.setSampleRate(sampleRate_);
 	
 	if(ready_)
 		calculateCoefficients(frequency_, q_);
@@ -90,10 +93,68 @@ void Filter::setFilterParams(float frequency, float q, int filterType)
 	calculateCoefficients(frequency_, q_);
 }
 	
+// set precomputed coefficients (e.g. from a coefficient cache)
+void Filter::setCoefficients(const BiquadCoefficients& coeffs, float frequency, float q, int filterType)
+{
+	frequency_ = frequency;
+	q_ = q;
+	filterType_ = filterType;
+	moveCoefficients(coeffs);
+}
+
+// get the coefficients the filter is set to
+const BiquadCoefficients& Filter::getCoefficients()
+{
+	return targetCoeffs_;
+}
+
+// Set the number of samples new coefficients glide over
+void Filter::setRampLength(int samples)
+{
+	rampLength_ = samples;
+}
+
+// jump to the end of the current glide
+void Filter::finishRamp()
+{
+	coeffs_ = targetCoeffs_;
+	rampRemaining_ = 0;
+}
+
 // Calculate coefficients
 void Filter::calculateCoefficients(float frequency, float q)
+{
+	moveCoefficients(designBiquad(frequency, q, filterType_, sampleRate_));
+}
+
+// glide from the current coefficients, or jump when there are none yet
+// every filter along the way is stable: the stable (b1, b2) form a triangle,
+// which holds the straight line between any two of its points
+void Filter::moveCoefficients(const BiquadCoefficients& coeffs)
+{
+	targetCoeffs_ = coeffs;
+	if (rampLength_ <= 1 || !ready_)
+	{
+		coeffs_ = coeffs;
+		rampRemaining_ = 0;
+		ready_ = true;
+		return;
+	}
+	float invSamples = 1.0f / rampLength_;
+	coeffSteps_.a0 = (coeffs.a0 - coeffs_.a0) * invSamples;
+	coeffSteps_.a1 = (coeffs.a1 - coeffs_.a1) * invSamples;
+	coeffSteps_.a2 = (coeffs.a2 - coeffs_.a2) * invSamples;
+	coeffSteps_.b1 = (coeffs.b1 - coeffs_.b1) * invSamples;
+	coeffSteps_.b2 = (coeffs.b2 - coeffs_.b2) * invSamples;
+	rampRemaining_ = rampLength_;
+}
+
+// Calculate coefficients for any set of parameters
+BiquadCoefficients Filter::designBiquad(float frequency, float q, int filterType, float sampleRate)
 {
 	// y[n] = 1/b0 * (a0*x[n] + a1*x[n-1] + a2*x[n-2] - b1*y[n-1] - b2*y[n-2])
+	BiquadCoefficients coeffs;
+	float T = 1.0/sampleRate;
 
 	// variables to calculate coefficients
 	float wd = 2*M_PI*frequency; // normalised desired digital frequency
@@ -101,40 +162,47 @@ void Filter::calculateCoefficients(float frequency, float q)
 
 	float w0 = wd; // debug line to toggle pre-warping (w0 should be either wa or wd)
 
-	float qT2w2 = q*pow(T_,2)*pow(w0,2); // q * T^2 * w0^2 comes up pretty often
+	float qT2w2 = q*pow(T,2)*pow(w0,2); // q * T^2 * w0^2 comes up pretty often
 
 	//divide other coefficients by B0 so we won't have to divide each time we use the filter
 	//division is pretty slow dude
 	// y[n] coefficients
-	invCoeffB0_ = 1.0 / (4*q + 2*w0*T_ + qT2w2);
-	coeffB1_ = (2*qT2w2 - 8*q) * invCoeffB0_;
-	coeffB2_ = (4*q + qT2w2 - 2*w0*T_) * invCoeffB0_;
+	float invCoeffB0 = 1.0 / (4*q + 2*w0*T + qT2w2);
+	coeffs.b1 = (2*qT2w2 - 8*q) * invCoeffB0;
+	coeffs.b2 = (4*q + qT2w2 - 2*w0*T) * invCoeffB0;
 	
 	// x[n] coefficients
-	switch (filterType_)
+	switch (filterType)
 	{
 	case kLowPass:
-		coeffA0_ = coeffA2_ = (qT2w2) * invCoeffB0_;
-		coeffA1_ = 2.0 * coeffA0_;
+		coeffs.a0 = coeffs.a2 = (qT2w2) * invCoeffB0;
+		coeffs.a1 = 2.0 * coeffs.a0;
 		break;
 	case kHighPass:
-		coeffA0_ = coeffA2_ = (4*q) * invCoeffB0_;
-		coeffA1_ = -2 * coeffA0_;
+		coeffs.a0 = coeffs.a2 = (4*q) * invCoeffB0;
+		coeffs.a1 = -2 * coeffs.a0;
 		break;
 	case kBandPass:
-		coeffA0_ = (2*q*T_*w0) * invCoeffB0_;
-		coeffA1_ = 0;
-		coeffA2_ = -coeffA0_;
+	default:
+		coeffs.a0 = (2*q*T*w0) * invCoeffB0;
+		coeffs.a1 = 0;
+		coeffs.a2 = -coeffs.a0;
 		break;
 	}
-	ready_ = true;
+	return coeffs;
 }
 	
 // Reset previous history of filter
 void Filter::reset()
 {
-	lastX_[0] = lastX_[1] = 0;
-	lastY_[0] = lastY_[1] = 0;
+	s1_ = s2_ = 0;
+}
+
+// Flush filter state close to 0
+void Filter::flushDenormals()
+{
+	flushDenormal(s1_);
+	flushDenormal(s2_);
 }
 	
 // Calculate the next sample of output
@@ -142,17 +210,29 @@ float Filter::process(float input)
 {
 	if(!ready_)
 		return input;
+	
+	// a sample further along a glide, the last one lands on the target
+	if (rampRemaining_ > 0)
+	{
+		if (--rampRemaining_ > 0)
+		{
+			coeffs_.a0 += coeffSteps_.a0;
+			coeffs_.a1 += coeffSteps_.a1;
+			coeffs_.a2 += coeffSteps_.a2;
+			coeffs_.b1 += coeffSteps_.b1;
+			coeffs_.b2 += coeffSteps_.b2;
+		}
+		else
+			coeffs_ = targetCoeffs_;
+	}
+	// transposed direct form II, same response as
 	// y[n] = 1/b0 * (a0*x[n] + a1*x[n-1] + a2*x[n-2] - b1*y[n-1] - b2*y[n-2])
+	// with two state variables instead of shifting previous inputs and outputs
 	
 	//1/b0 already applied in coefficient calculation
-	float out = input * coeffA0_ + lastX_[0] * coeffA1_ + lastX_[1] * coeffA2_
-    			- lastY_[0] * coeffB1_ - lastY_[1] * coeffB2_;
-
-	// save previous inputs and outputs for next iteration
-    lastX_[1] = lastX_[0];
-    lastX_[0] = input;
-    lastY_[1] = lastY_[0];
-    lastY_[0] = out;
+	float out = input * coeffs_.a0 + s1_;
+	s1_ = input * coeffs_.a1 - out * coeffs_.b1 + s2_;
+	s2_ = input * coeffs_.a2 - out * coeffs_.b2;
     
     return out;
 }
@@ -160,47 +240,9 @@ float Filter::process(float input)
 // calculate Frequency Response Function and send to GUI
 void Filter::updateFrfGraph(Gui& gui, int bufferId)
 {
-	// calculate FRF from 0 to 20000 Hz
-	// Y(w) / X(w) = sum_n(an(exp(-jwn))) / sum_n(bn(exp(-jwn)))
-	for (int i = 0; i < FRF_GRAPH_N; i++)
-	{
-		
-		// linear scale between 0 and 2pi
-		float w = M_PI * float(i)/(FRF_GRAPH_N - 1);
-		// exponential scale between 0 and 2pi
-		// float w = powf(1+M_PI,float(i)/(FRF_GRAPH_N - 1))-1;
-		
-		// complex variables for jw and 2jw
-		std::complex<float> jw = 1i * w;
-		std::complex<float> jw2 = 2* 1i * w;
-		
-		// variables for complex exponentials (std::exp adapts to imaginary input)
-		std::complex<float> expa1 = coeffA1_ * std::exp(jw);
-		std::complex<float> expa2 = coeffA2_ * std::exp(jw2);
-		std::complex<float> expb1 = coeffB1_ * std::exp(jw);
-		std::complex<float> expb2 = coeffB2_ * std::exp(jw2);
-		
-		// magnitude of sum of exponentials for numerator and denomerator
-		float sumAMag = abs(std::complex<float>(coeffA0_) + expa1 + expa2);
-		// all coefficients have already been normalized by B0, so here it is 1.
-		float sumBMag = abs(std::complex<float>(1) + expb1 + expb2);
-		
-		// calculate FRF magnitude
-		frf_[i] = sumAMag / sumBMag;
-		
-		// convert to decibels
-		if (frf_[i] > 0.001)
-			frf_[i] = 20 * log10(frf_[i]);
-		// set threshold for minimum decibel values (avoid log(0))
-		else
-			frf_[i] = -60;
-
-		//convert to range [-60, 20] to [0, 1] (0.0125 is dividing by 80)
-		frf_[i] = (frf_[i] + 60) * 0.0125;
-	}
-	
-	//send to GUI
-	gui.sendBuffer(bufferId, frf_);
+	// only recalculated if the coefficients changed
+	frf_.evaluate(&targetCoeffs_, 1);
+	gui.sendBuffer(bufferId, frf_.getGraph(), FRF_GRAPH_N);
 }
 	
 // Destructor
@@ -10,8 +10,7 @@ filter.h: header file for defining a second order resonant kow pass filter
 #define FILTER_H
 
 #include <libraries/Gui/Gui.h>
-
-#define FRF_GRAPH_N 60
+#include "frfEvaluator.h"
 
 //enumerator for filterType
 enum {
@@ -20,6 +19,12 @@ enum {
 	kBandPass
 };
 
+// Biquad coefficients, already normalized by b0
+// y[n] = a0*x[n] + a1*x[n-1] + a2*x[n-2] - b1*y[n-1] - b2*y[n-2]
+struct BiquadCoefficients {
+	float a0, a1, a2, b1, b2;
+};
+
 //2nd order IIR filter
 class Filter {
 public:
@@ -48,12 +53,31 @@ public:
 	// input -1 to skip setting
 	void setFilterParams(float frequency, float q, int filterType);
 	
+	// set precomputed coefficients, along with the parameters they were designed for
+	void setCoefficients(const BiquadCoefficients& coeffs, float frequency, float q, int filterType);
+	
+	// get current coefficients (the target while gliding)
+	const BiquadCoefficients& getCoefficients();
+	
+	// new coefficients glide from the current ones over this many samples
+	// (0 or 1 to jump to them, the default)
+	void setRampLength(int samples);
+	// jump to the end of a glide
+	void finishRamp();
+	
+	// Calculate coefficients for given parameters without changing any filter
+	static BiquadCoefficients designBiquad(float frequency, float q, int filterType, float sampleRate);
+	
 	// Reset previous history of filter
 	void reset();
 	
+	// Set decayed filter state to zero before it becomes denormal (call once per block)
+	void flushDenormals();
+	
 	// Calculate the next sample of output
 	float process(float input); 
 	
+	// calculate FRF graph (see frfEvaluator.h) and send to GUI
 	void updateFrfGraph(Gui& gui, int bufferId);
 	
 	// Destructor
@@ -62,6 +86,8 @@ public:
 private:
 	// Calculate coefficients
 	void calculateCoefficients(float frequency, float q);
+	// move to new coefficients, gliding if there is a ramp length
+	void moveCoefficients(const BiquadCoefficients& coeffs);
 
 	// State variables, not accessible to the outside world
 	bool ready_;	// Have the coefficients been calculated?
@@ -70,14 +96,17 @@ private:
 	float frequency_; // cutoff frequency
 	float q_; // Q factor
 	// Coefficients
-	float coeffA0_, coeffA1_, coeffA2_, invCoeffB0_, coeffB1_, coeffB2_;
-	// previous inputs
-	float lastX_[2];
-	//previous outputs
-	float lastY_[2];
-	
-	// FRF graph y-values
-	float frf_[FRF_GRAPH_N] = {0};
+	BiquadCoefficients coeffs_;
+	// glide to new coefficients
+	BiquadCoefficients targetCoeffs_; // coefficients at the end of the glide
+	BiquadCoefficients coeffSteps_; // change of coeffs_ per sample
+	int rampLength_; // samples a glide takes
+	int rampRemaining_; // samples left of the current glide
+	// transposed direct form II state
+	float s1_, s2_;
+	
+	// FRF graph calculation
+	FrfEvaluator frf_;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,345 @@
+/***** fmFitter.cpp *****/
+#include <Bela.h>
+#include <libraries/AudioFile/AudioFile.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+#include "fmFitter.h"
+#include "fftAnalyzer.h"
+#include "featureExtractor.h"
+#include "midiTables.h"
+#include "note.h"
+#include "denormals.h"
+
+// levels below this (dB of the total power) are compared as equal, so faint
+// partials and leakage do not outweigh the audible harmonics
+static constexpr float kFitFloorDb = -40.0f;
+
+// search ranges, as allowed by the advanced spectrum controls
+static constexpr int kFitNumAlgorithms = kFmConfigFourStack + 1;
+static constexpr int kFitNumShapes = kWaveSaw + 1;
+static constexpr float kFitMinRatio = 0.25f;
+static constexpr float kFitMaxRatio = 12.0f;
+static constexpr float kFitMaxAmp = 4.0f;
+
+// (1+1) evolution strategy: initial and limiting step sizes, and the chance
+// of each kind of step (the rest are gaussian steps of ratios and amplitudes)
+static constexpr float kFitInitialStep = 0.5f;
+static constexpr float kFitMinStep = 0.005f;
+static constexpr float kFitMaxStep = 2.0f;
+static constexpr float kFitAlgorithmChance = 0.1f;
+static constexpr float kFitShapeChance = 0.1f;
+static constexpr float kFitSnapChance = 0.1f;
+
+// split bin powers into levels: each harmonic takes the three bins around its
+// frequency, the last level is the power of every other bin
+template <typename T>
+static void harmonicLevels(const T* power, float binsPerHarmonic, float* levels)
+{
+	T total = 0;
+	for (int k = 0; k < FFT_OUT_N; k++)
+		total += power[k];
+	T harmonicTotal = 0;
+	for (int h = 1; h <= FM_FIT_HARMONICS; h++)
+	{
+		int centre = lrintf(h * binsPerHarmonic);
+		T level = 0;
+		for (int k = centre - 1; k <= centre + 1; k++)
+			if (k >= 0 && k < FFT_OUT_N)
+				level += power[k];
+		levels[h - 1] = level;
+		harmonicTotal += level;
+	}
+	levels[FM_FIT_HARMONICS] = total > harmonicTotal ? total - harmonicTotal : 0;
+}
+
+// Constructor, the synth and FFT are allocated in setup()
+FmEvaluator::FmEvaluator()
+{
+	for (int i = 0; i < FM_FIT_LEVELS; i++)
+	{
+		targetDb_[i] = kFitFloorDb;
+		modelDb_[i] = kFitFloorDb;
+	}
+}
+
+FmEvaluator::~FmEvaluator()
+{
+	NE10_FREE(neInput_);
+	NE10_FREE(neOutput_);
+	NE10_FREE(cfg_);
+}
+
+// powers to dB of their total, floored
+static void levelsToDb(const float* levels, float* db)
+{
+	float total = 0;
+	for (int i = 0; i < FM_FIT_LEVELS; i++)
+		total += levels[i];
+	for (int i = 0; i < FM_FIT_LEVELS; i++)
+	{
+		float level = total > 0 ? 10.0f * log10f(levels[i] / total + 1e-12f) : kFitFloorDb;
+		db[i] = fmaxf(level, kFitFloorDb);
+	}
+}
+
+// CALL IN SETUP
+void FmEvaluator::setup(float sampleRate, float fundamental, const float* target)
+{
+	synth_.reset(new FreqMod(sampleRate, fundamental));
+	binsPerHarmonic_ = fundamental * FFT_BUFFER_N / sampleRate;
+	ratios_.assign(NUM_OPERATORS, 1);
+	amps_.assign(NUM_OPERATORS, 0);
+	shapes_.assign(NUM_OPERATORS, kWaveSine);
+
+	if (!cfg_)
+	{
+		neInput_ = (ne10_fft_cpx_float32_t*) NE10_MALLOC (FFT_BUFFER_N * sizeof (ne10_fft_cpx_float32_t));
+		neOutput_ = (ne10_fft_cpx_float32_t*) NE10_MALLOC (FFT_BUFFER_N * sizeof (ne10_fft_cpx_float32_t));
+		cfg_ = ne10_fft_alloc_c2c_float32_neon (FFT_BUFFER_N);
+	}
+	// same Hann window as FftAnalyzer, which measured the target
+	window_.resize(FFT_BUFFER_N);
+	for (int n = 0; n < FFT_BUFFER_N; n++)
+		window_[n] = 0.5f * (1.0f - cosf(2.0f * M_PI * n / (float)(FFT_BUFFER_N - 1)));
+	power_.resize(FFT_OUT_N);
+
+	levelsToDb(target, targetDb_);
+}
+
+// render one frame of the candidate and compare its levels to the target
+float FmEvaluator::evaluate(const FmParams& params)
+{
+	for (int i = 0; i < NUM_OPERATORS; i++)
+	{
+		ratios_[i] = params.ratios[i];
+		amps_[i] = params.amps[i];
+		shapes_[i] = params.shapes[i];
+	}
+	synth_->setAlgorithm(params.algorithm);
+	synth_->setSpectrum(amps_, ratios_, shapes_);
+	synth_->reset();
+	for (int n = 0; n < FFT_BUFFER_N; n++)
+	{
+		neInput_[n].r = window_[n] * synth_->process();
+		neInput_[n].i = 0;
+	}
+	ne10_fft_c2c_1d_float32_neon (neOutput_, neInput_, cfg_, 0);
+
+	float total = 0;
+	for (int k = 0; k < FFT_OUT_N; k++)
+	{
+		power_[k] = neOutput_[k].r * neOutput_[k].r + neOutput_[k].i * neOutput_[k].i;
+		total += power_[k];
+	}
+	// a silent candidate can not match anything
+	if (total <= 0)
+		return 1e9f;
+	float levels[FM_FIT_LEVELS];
+	harmonicLevels(power_.data(), binsPerHarmonic_, levels);
+
+	levelsToDb(levels, modelDb_);
+	float error = 0;
+	for (int i = 0; i < FM_FIT_LEVELS; i++)
+	{
+		float difference = modelDb_[i] - targetDb_[i];
+		error += difference * difference;
+	}
+	return error / FM_FIT_LEVELS;
+}
+
+bool measureHarmonicLevels(const float* samples, int numSamples, float sampleRate, float fundamental, float* levels)
+{
+	FftAnalyzer analyzer;
+	FeatureExtractor extractor;
+	analyzer.setup(sampleRate, kFftModeSnapshot, FFT_HOP_SIZE, FFT_HOP_SIZE);
+	extractor.setup(sampleRate, FFT_BUFFER_N, FFT_HOP_SIZE);
+
+	// Welch average of the sounding frames
+	std::vector<double> powerSum(FFT_OUT_N, 0);
+	int soundingFrames = 0;
+	for (int n = 0; n < numSamples; n++)
+	{
+		analyzer.push(samples[n]);
+		if (!analyzer.isReady())
+			continue;
+		analyzer.process();
+		extractor.process(analyzer.getFramePower(), fundamental, analyzer.getFrameHop());
+		if (!extractor.isSounding())
+			continue;
+		const float* power = analyzer.getFramePower();
+		for (int k = 0; k < FFT_OUT_N; k++)
+			powerSum[k] += power[k];
+		soundingFrames++;
+	}
+	if (soundingFrames == 0)
+	{
+		for (int i = 0; i < FM_FIT_LEVELS; i++)
+			levels[i] = 0;
+		return false;
+	}
+
+	for (int k = 0; k < FFT_OUT_N; k++)
+		powerSum[k] /= soundingFrames;
+	harmonicLevels(powerSum.data(), fundamental * FFT_BUFFER_N / sampleRate, levels);
+	return true;
+}
+
+// best candidate found from one start
+struct FmFitResult {
+	FmParams params;
+	float error;
+};
+
+// random starting point. Every other start uses whole number ratios, which
+// harmonic recordings usually need
+static void randomStart(std::mt19937& random, bool harmonic, FmParams& params)
+{
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	params.algorithm = random() % kFitNumAlgorithms;
+	for (int i = 0; i < NUM_OPERATORS; i++)
+	{
+		if (harmonic)
+			params.ratios[i] = 1 + random() % 8;
+		else
+			params.ratios[i] = 0.5f + 7.5f * unit(random);
+		params.amps[i] = 2.0f * unit(random);
+		params.shapes[i] = random() % kFitNumShapes;
+	}
+}
+
+// refine one start with a (1+1) evolution strategy and the one fifth rule
+static FmFitResult searchFromStart(FmEvaluator& evaluator, int start)
+{
+	std::mt19937 random(start + 1);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::normal_distribution<float> gaussian(0.0f, 1.0f);
+
+	FmFitResult best;
+	randomStart(random, start % 2 == 0, best.params);
+	best.error = evaluator.evaluate(best.params);
+	float step = kFitInitialStep;
+
+	for (int e = 1; e < FM_FIT_EVALS_PER_START; e++)
+	{
+		FmParams candidate = best.params;
+		float choice = unit(random);
+		bool gaussianStep = false;
+		if (choice < kFitAlgorithmChance)
+			candidate.algorithm = random() % kFitNumAlgorithms;
+		else if ((choice -= kFitAlgorithmChance) < kFitShapeChance)
+			candidate.shapes[random() % NUM_OPERATORS] = random() % kFitNumShapes;
+		else if ((choice -= kFitShapeChance) < kFitSnapChance)
+		{
+			// snap a ratio to the nearest half
+			int i = random() % NUM_OPERATORS;
+			candidate.ratios[i] = fmaxf(0.5f * roundf(2.0f * candidate.ratios[i]), 0.5f);
+		}
+		else
+		{
+			gaussianStep = true;
+			for (int i = 0; i < NUM_OPERATORS; i++)
+			{
+				candidate.ratios[i] = fminf(fmaxf(candidate.ratios[i] + step * gaussian(random), kFitMinRatio), kFitMaxRatio);
+				candidate.amps[i] = fminf(fmaxf(candidate.amps[i] + step * gaussian(random), 0.0f), kFitMaxAmp);
+			}
+		}
+
+		float error = evaluator.evaluate(candidate);
+		bool success = error < best.error;
+		// equal errors are accepted too, to move across flat regions
+		if (error <= best.error)
+		{
+			best.params = candidate;
+			best.error = error;
+		}
+		if (gaussianStep)
+			step = success ? fminf(step * 1.5f, kFitMaxStep) : fmaxf(step * 0.9036f, kFitMinStep);
+	}
+	return best;
+}
+
+float fitFmSpectrum(float sampleRate, float fundamental, const float* target, float* buffer, double& evalsPerSecond)
+{
+	int numThreads = FM_FIT_THREADS > 0 ? FM_FIT_THREADS : std::thread::hardware_concurrency();
+	if (numThreads < 1)
+		numThreads = 1;
+	if (numThreads > FM_FIT_STARTS)
+		numThreads = FM_FIT_STARTS;
+
+	std::vector<FmEvaluator> evaluators(numThreads);
+	for (auto& evaluator : evaluators)
+		evaluator.setup(sampleRate, fundamental, target);
+
+	// starts are handed out in order, every start is seeded by its index so the
+	// result does not depend on the number of threads
+	std::vector<FmFitResult> results(FM_FIT_STARTS);
+	std::atomic<int> nextStart(0);
+	auto workerLoop = [&](int t) {
+		ensureFlushToZero();
+		for (int start = nextStart++; start < FM_FIT_STARTS; start = nextStart++)
+			results[start] = searchFromStart(evaluators[t], start);
+	};
+
+	auto startTime = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (int t = 0; t < numThreads; t++)
+		threads.emplace_back(workerLoop, t);
+	for (auto& thread : threads)
+		thread.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	evalsPerSecond = seconds > 0 ? (double) FM_FIT_STARTS * FM_FIT_EVALS_PER_START / seconds : 0;
+
+	// lowest error, first start on ties
+	int bestStart = 0;
+	for (int start = 1; start < FM_FIT_STARTS; start++)
+		if (results[start].error < results[bestStart].error)
+			bestStart = start;
+
+	// round to the precision of the GUI inputs, and score what will be sent
+	FmParams& params = results[bestStart].params;
+	buffer[0] = 1;
+	buffer[1] = params.algorithm;
+	for (int i = 0; i < NUM_OPERATORS; i++)
+	{
+		params.ratios[i] = roundf(params.ratios[i] * 100.0f) / 100.0f;
+		params.amps[i] = roundf(params.amps[i] * 100.0f) / 100.0f;
+		buffer[2 + 3 * i] = params.ratios[i];
+		buffer[3 + 3 * i] = params.amps[i];
+		buffer[4 + 3 * i] = params.shapes[i];
+	}
+	return evaluators[0].evaluate(params);
+}
+
+void runFmFit(float sampleRate)
+{
+	std::vector<float> recording = AudioFileUtilities::loadMono(FM_FIT_FILE);
+	if (recording.empty())
+	{
+		rt_printf("FM fit: unable to load %s\n", FM_FIT_FILE);
+		return;
+	}
+	float fundamental = kMidiToFreqTable[FM_FIT_NOTE];
+	if (fundamental * FFT_BUFFER_N / sampleRate < 3)
+		rt_printf("FM fit: note %d is below the FFT resolution, neighbouring harmonics will mix\n", FM_FIT_NOTE);
+	float target[FM_FIT_LEVELS];
+	if (!measureHarmonicLevels(recording.data(), recording.size(), sampleRate, fundamental, target))
+	{
+		rt_printf("FM fit: %s never rises above the onset threshold\n", FM_FIT_FILE);
+		return;
+	}
+
+	float buffer[FM_FIT_BUFFER_SIZE];
+	double evalsPerSecond;
+	float error = fitFmSpectrum(sampleRate, fundamental, target, buffer, evalsPerSecond);
+
+	rt_printf("FM fit: %s (note %d), %d starts x %d evaluations, %.0f evaluations per second\n",
+		FM_FIT_FILE, FM_FIT_NOTE, FM_FIT_STARTS, FM_FIT_EVALS_PER_START, evalsPerSecond);
+	rt_printf("FM fit: rms level error %.2f dB, advanced spectrum buffer:\n", sqrtf(error));
+	rt_printf("\tadvFmBuffer = [1, %d", int(buffer[1]));
+	for (int i = 0; i < NUM_OPERATORS; i++)
+		rt_printf(", %.2f, %.2f, %d", buffer[2 + 3 * i], buffer[3 + 3 * i], int(buffer[4 + 3 * i]));
+	rt_printf("];\n");
+}
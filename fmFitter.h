@@ -0,0 +1,98 @@
+/***** fmFitter.h *****/
+// Fits the advanced mode FM parameters to the harmonic spectrum of a recording
+// The target is the power of each harmonic of the recording's note, and of
+// everything between and above them, averaged over its sounding frames. A
+// candidate (algorithm, and a ratio, amplitude and waveshape per operator) is
+// scored by rendering one FFT frame of FreqMod at the same note and measuring
+// it the same way: the error is the mean squared dB difference of the levels.
+// The search is a multi-start (1+1) evolution strategy: each start is a
+// deterministic random point refined by gaussian steps of an adapted size, with
+// occasional changes of algorithm, waveshape or a ratio snapped to a half.
+// Starts are shared out between threads, each with its own FreqMod, and the
+// best result is kept.
+#ifndef FMFITTER_H
+#define FMFITTER_H
+
+#include <libraries/ne10/NE10.h>
+#include <memory>
+#include <vector>
+#include "freqMod.h"
+
+//------------ ENABLE FM FIT HERE -----------------
+// fit FM parameters to a recording at setup and print them
+#define FM_FIT 0
+//------------ ENABLE FM FIT HERE -----------------
+
+//------------ CHANGE FM FIT HERE -----------------
+#define FM_FIT_FILE "target.wav" // mono or first channel
+#define FM_FIT_NOTE 60 // MIDI note played in the recording
+#define FM_FIT_HARMONICS 24 // harmonics compared
+#define FM_FIT_STARTS 128 // random starting points
+#define FM_FIT_EVALS_PER_START 200 // spectrum evaluations per start
+#define FM_FIT_THREADS 0 // worker threads, 0 for one per core
+//------------ CHANGE FM FIT HERE -----------------
+
+// levels compared: every harmonic, then the power between and above them
+#define FM_FIT_LEVELS (FM_FIT_HARMONICS + 1)
+
+// size of an advanced spectrum buffer: update flag, algorithm, then
+// ratio, amplitude and shape of every operator (see Spectrum::updateAdvSpectrum)
+#define FM_FIT_BUFFER_SIZE (2 + 3 * NUM_OPERATORS)
+
+// one set of FreqMod parameters
+struct FmParams {
+	int algorithm;
+	float ratios[NUM_OPERATORS];
+	float amps[NUM_OPERATORS];
+	int shapes[NUM_OPERATORS];
+};
+
+// renders and scores candidates, one per thread
+class FmEvaluator
+{
+public:
+	FmEvaluator();
+	~FmEvaluator();
+
+	// allocate the synth and FFT, target holds FM_FIT_LEVELS powers measured
+	// at the fundamental
+	// CALL IN SETUP (allocates)
+	void setup(float sampleRate, float fundamental, const float* target);
+
+	// error of a candidate against the target, lower is better
+	float evaluate(const FmParams& params);
+
+	// levels (FM_FIT_LEVELS, dB of the total) of the last candidate evaluated
+	const float* getLevelsDb() { return modelDb_; }
+
+private:
+	std::unique_ptr<FreqMod> synth_;
+	// vectors handed to FreqMod::setSpectrum
+	std::vector<float> ratios_, amps_;
+	std::vector<int> shapes_;
+
+	ne10_fft_cpx_float32_t* neInput_ = nullptr;
+	ne10_fft_cpx_float32_t* neOutput_ = nullptr;
+	ne10_fft_cfg_float32_t cfg_ = nullptr;
+	std::vector<float> window_;
+	std::vector<float> power_; // bin powers of the candidate
+	float binsPerHarmonic_;
+
+	float targetDb_[FM_FIT_LEVELS];
+	float modelDb_[FM_FIT_LEVELS];
+};
+
+// measure the levels (FM_FIT_LEVELS powers) of a recording of a note, averaged
+// over its sounding frames. returns false if the recording never sounds
+bool measureHarmonicLevels(const float* samples, int numSamples, float sampleRate, float fundamental, float* levels);
+
+// fit parameters to target levels (FM_FIT_LEVELS powers) with the multi-start
+// search, fill an advanced spectrum buffer (FM_FIT_BUFFER_SIZE, update flag set)
+// and return the error of the fit. evalsPerSecond is the measured search speed
+float fitFmSpectrum(float sampleRate, float fundamental, const float* target, float* buffer, double& evalsPerSecond);
+
+// load FM_FIT_FILE, fit it and print the advanced spectrum buffer
+// (dev tool, see FM_FIT)
+void runFmFit(float sampleRate);
+
+#endif
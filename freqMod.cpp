@@ -14,58 +14,38 @@ FreqMod::FreqMod(float sampleRate, float frequency)
 	
 	// default config is additive synthesis
 	opAlgorithm_ = kFmConfigAdd;
+	// parameters jump by default
+	rampLength_ = 0;
+	rampRemaining_ = 0;
 	
 	// initialize wavetables
 	initWavetables();
 	
 	// initialize operator defaults 
-	// operators are non-copyable (have const references) so they must be
-	// constructed here, which is why we are using a vector of Operators
+	// operators are constructed here, which is why we are using a vector of Operators
 	for (unsigned int i = 0; i < NUM_OPERATORS; i++)
 	{
 		opFreqRatios_[i] = 1;
 		opAmplitudes_[i] = 1;
 		opFrequencies_[i] = opFreqRatios_[i]*frequency_;
-		operators_.push_back(Operator(sampleRate_, tableVector_));
+		operators_.push_back(Operator(sampleRate_));
 		operators_[i].setup(kWaveSine, frequency_);
 		operators_[i].setFrequency(opFrequencies_[i]);
 	}
 }
 
 
-// Calculate wavetables
+// Build the shared wavetables (see wavetables.h), once for every FreqMod
 void FreqMod::initWavetables()
 {
-	//inverse of wavetable size
-	float invWavetableSize = 1.0 / float(WAVETABLE_SIZE+1);
-	for (int i = 0; i < WAVETABLE_SIZE; i++)
-	{
-		sineWaveTable_.push_back(sinf(2*M_PI*i*invWavetableSize));
-		// all wavetables calculated to be between 1 and -1
-		sawWaveTable_.push_back(2*float(WAVETABLE_SIZE - i)/WAVETABLE_SIZE - 1);
-		if (i < WAVETABLE_SIZE / 2)
-		{
-			triWaveTable_.push_back(4*float(i)/WAVETABLE_SIZE - 1);
-			squareWaveTable_.push_back(1);
-		}
-		else
-		{
-			triWaveTable_.push_back(3.0 - 4* float(i)/WAVETABLE_SIZE);
-			squareWaveTable_.push_back(-1);
-		}
-		
-	}
-	// add wavetables to vector of vectors
-	tableVector_.push_back(sineWaveTable_);
-	tableVector_.push_back(triWaveTable_);
-	tableVector_.push_back(squareWaveTable_);
-	tableVector_.push_back(sawWaveTable_);
+	WavetableSet::get(WAVETABLE_SIZE);
 }
 
 // Set sample rate of class and its operator objects
 void FreqMod::setSampleRate(float frequency)
 {
 	sampleRate_ = frequency;
+	finishRamp();
 	for (unsigned int i = 0; i < NUM_OPERATORS; i++)
 		operators_[i].setSampleRate(sampleRate_);
 }
@@ -77,6 +57,34 @@ void FreqMod::reset()
 		operators_[i].reset();
 }
 
+// get operator states
+void FreqMod::getState(float* phases, float* lastOutputs)
+{
+	for (unsigned int i = 0; i < NUM_OPERATORS; i++)
+		operators_[i].getState(phases[i], lastOutputs[i]);
+}
+
+// set operator states
+void FreqMod::setState(const float* phases, const float* lastOutputs)
+{
+	for (unsigned int i = 0; i < NUM_OPERATORS; i++)
+		operators_[i].setState(phases[i], lastOutputs[i]);
+}
+
+// get operator tables
+void FreqMod::getWavetables(const float** wavetables)
+{
+	for (unsigned int i = 0; i < NUM_OPERATORS; i++)
+		wavetables[i] = operators_[i].getWavetable();
+}
+
+// set operator tables
+void FreqMod::setWavetables(const float* const* wavetables)
+{
+	for (unsigned int i = 0; i < NUM_OPERATORS; i++)
+		operators_[i].setWavetable(wavetables[i]);
+}
+
 // return a reference to the 0th operator object
 const Operator& FreqMod::getDebugOperator()
 {
@@ -88,13 +96,12 @@ int FreqMod::getWaveTableSize()
 {
 	// return WAVETABLE_SIZE;
 	// return static_cast<int>(operators_.size());
-	return static_cast<int>(tableVector_[2].size());
+	return static_cast<int>(operators_[0].tableLength());
 }
 float FreqMod::getDebugWaveValue()
 {
 	// return 0;
-	return tableVector_[2][256];
-	// return sineWaveTable_.at(256);
+	return WavetableSet::get(WAVETABLE_SIZE).naive(kWaveSquare)[256];
 }
 
 // Set base frequency of FM sound
@@ -102,10 +109,15 @@ void FreqMod::setFrequency(float frequency)
 {
 	frequency_ = frequency;
 	for (unsigned int i = 0; i < NUM_OPERATORS; i++)
-	{
 		opFrequencies_[i] = opFreqRatios_[i]*frequency_;
-		operators_[i].setFrequency(opFrequencies_[i]);
+	if (rampLength_ > 1)
+	{
+		moveOperators();
+		return;
 	}
+	finishRamp();
+	for (unsigned int i = 0; i < NUM_OPERATORS; i++)
+		operators_[i].setFrequency(opFrequencies_[i]);
 }
 
 // Set frequency ratios of operators
@@ -115,18 +127,30 @@ void FreqMod::setFrequencyRatios(const std::vector<float>& ratios)
 	{
 		opFreqRatios_[i] = ratios[i];
 		opFrequencies_[i] = opFreqRatios_[i]*frequency_;
-		operators_[i].setFrequency(opFrequencies_[i]);
 	}
+	if (rampLength_ > 1)
+	{
+		moveOperators();
+		return;
+	}
+	finishRamp();
+	for (unsigned int i = 0; i < NUM_OPERATORS; i++)
+		operators_[i].setFrequency(opFrequencies_[i]);
 }
 
 // Set amplitudes of operators
 void FreqMod::setAmplitudes(const std::vector<float>& amps)
 {
 	for (unsigned int i = 0; i < NUM_OPERATORS; i++)
-	{
 		opAmplitudes_[i] = amps[i];
-		operators_[i].setAmplitude(opAmplitudes_[i]);
+	if (rampLength_ > 1)
+	{
+		moveOperators();
+		return;
 	}
+	finishRamp();
+	for (unsigned int i = 0; i < NUM_OPERATORS; i++)
+		operators_[i].setAmplitude(opAmplitudes_[i]);
 }
 
 // Set waveshapes of operators
@@ -145,8 +169,52 @@ void FreqMod::setSpectrum(const std::vector<float>& amps, const std::vector<floa
 	{
 		opFreqRatios_[i] = ratios[i];
 		opFrequencies_[i] = opFreqRatios_[i]*frequency_;
-		operators_[i].setParameters(amps[i], opFrequencies_[i], waves[i]);
+		opAmplitudes_[i] = amps[i];
+	}
+	if (rampLength_ > 1)
+	{
+		for (unsigned int i = 0; i < NUM_OPERATORS; i++)
+			operators_[i].setTable(waves[i]);
+		moveOperators();
+		return;
 	}
+	finishRamp();
+	for (unsigned int i = 0; i < NUM_OPERATORS; i++)
+		operators_[i].setParameters(amps[i], opFrequencies_[i], waves[i]);
+}
+
+// Set how every operator reads its wavetables
+void FreqMod::setQuality(int interpolation, int tableSize, bool bandLimited, bool fade)
+{
+	// glides are in units of the old tables
+	finishRamp();
+	for (unsigned int i = 0; i < NUM_OPERATORS; i++)
+		operators_[i].setQuality(interpolation, tableSize, bandLimited, fade);
+}
+
+// Set the number of samples parameter changes glide over
+void FreqMod::setRampLength(int samples)
+{
+	rampLength_ = samples;
+}
+
+// start every operator gliding from where it is to its amplitude and frequency
+// all operators share one glide, so they arrive together
+void FreqMod::moveOperators()
+{
+	for (unsigned int i = 0; i < NUM_OPERATORS; i++)
+		operators_[i].rampTo(opAmplitudes_[i], opFrequencies_[i], rampLength_);
+	rampRemaining_ = rampLength_;
+}
+
+// end the current glide
+void FreqMod::finishRamp()
+{
+	if (rampRemaining_ == 0)
+		return;
+	for (unsigned int i = 0; i < NUM_OPERATORS; i++)
+		operators_[i].finishRamp();
+	rampRemaining_ = 0;
 }
 
 // Set operator algorithm based on enumerator (how operators are strung together)
@@ -158,6 +226,21 @@ void FreqMod::setAlgorithm(int algorithm)
 // calculate and return current sample of the FM waveform
 float FreqMod::process()
 {
+	// a sample further along the glide, the last one lands on the targets
+	if (rampRemaining_ > 0)
+	{
+		if (--rampRemaining_ > 0)
+		{
+			for (unsigned int i = 0; i < NUM_OPERATORS; i++)
+				operators_[i].stepRamp();
+		}
+		else
+		{
+			for (unsigned int i = 0; i < NUM_OPERATORS; i++)
+				operators_[i].finishRamp();
+		}
+	}
+	
 	float out = 0;
 	switch(opAlgorithm_)
 	{
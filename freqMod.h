@@ -48,7 +48,14 @@ public:
 	// reset operator phases
 	void reset();
 	
-	// calculate wavetable values
+	// get or set the phase (in cycles) and previous output of every operator (NUM_OPERATORS each)
+	void getState(float* phases, float* lastOutputs);
+	void setState(const float* phases, const float* lastOutputs);
+	// get or set the table every operator reads (see Operator::setWavetable)
+	void getWavetables(const float** wavetables);
+	void setWavetables(const float* const* wavetables);
+	
+	// build the shared wavetables (allocates the first time)
 	void initWavetables();
 	
 	// retrieve a reference to an operators for debug purposes
@@ -75,21 +82,25 @@ public:
 	// Set operator algorithm based on enumerator (how operators are strung together)
 	void setAlgorithm(int algorithm);
 	
+	// Set interpolation, wavetable size and band-limiting of every operator
+	// (see Operator::setQuality)
+	void setQuality(int interpolation, int tableSize, bool bandLimited, bool fade);
+	
+	// Operator amplitudes and frequencies glide to new values over this many
+	// samples (0 or 1 to jump to them, the default). Waveshapes and the
+	// algorithm always change at once
+	void setRampLength(int samples);
+	
 	// calculate and return current sample of the FM waveform
 	float process();
 	
 private:
-	// Source Wavetable 
-	// wavetables as a vector of vectors.
-	// First index selects the wavetable, second index indexes wavetable contents
-	std::vector<std::vector<float>> tableVector_;
-	//individual wavetables as vectors
-	std::vector<float> sineWaveTable_; // sine
-	std::vector<float> triWaveTable_; // triangle
-	std::vector<float> squareWaveTable_; // square
-	std::vector<float> sawWaveTable_; //sawtooth
-	
-	// FM Operators
+	// move every operator to its amplitude and frequency, gliding if there is a ramp length
+	void moveOperators();
+	// jump to the end of a glide
+	void finishRamp();
+	
+	// FM Operators, reading the shared wavetables
 	std::vector<Operator> operators_;
 	
 	// ratios of FM operator frequencies to the base frequency
@@ -101,6 +112,9 @@ private:
 	// current FM algorithm (how to arrange operators)
 	int opAlgorithm_;
 	
+	int rampLength_; // samples parameter changes glide over
+	int rampRemaining_; // samples left of the current glide
+	
 	// sample rate
 	float sampleRate_;
 	// Base Frequency
@@ -0,0 +1,112 @@
+/***** frfEvaluator.cpp *****/
+#include <cmath>
+#include <cstring>
+#include "frfEvaluator.h"
+#include "filter.h"
+#include "dbConvert.h"
+
+// Constructor
+FrfEvaluator::FrfEvaluator()
+{
+	gridType_ = kFrfGridLinear;
+	sampleRate_ = 44100.0;
+	minFrequency_ = 20.0;
+	calculateGrid();
+	for (int i = 0; i < FRF_GRAPH_N; i++)
+		graph_[i] = 0;
+}
+
+void FrfEvaluator::setSampleRate(float sampleRate)
+{
+	if (sampleRate_ == sampleRate)
+		return;
+	sampleRate_ = sampleRate;
+	if (gridType_ == kFrfGridLog)
+		calculateGrid();
+}
+
+void FrfEvaluator::setGrid(int gridType, float minFrequency)
+{
+	gridType_ = gridType;
+	minFrequency_ = minFrequency;
+	calculateGrid();
+}
+
+// tabulate cos and sin of w and 2w at each point of the grid
+void FrfEvaluator::calculateGrid()
+{
+	for (int i = 0; i < FRF_GRAPH_N; i++)
+	{
+		float w;
+		// logarithmic scale between minimum frequency and pi
+		if (gridType_ == kFrfGridLog)
+		{
+			float minW = 2 * M_PI * minFrequency_ / sampleRate_;
+			w = minW * powf(M_PI / minW, float(i) / (FRF_GRAPH_N - 1));
+		}
+		// linear scale between 0 and pi
+		else
+			w = M_PI * float(i) / (FRF_GRAPH_N - 1);
+		cosW_[i] = cosf(w);
+		sinW_[i] = sinf(w);
+		cos2W_[i] = cosf(2 * w);
+		sin2W_[i] = sinf(2 * w);
+	}
+	// grid changed, graph has to be recalculated
+	valid_ = false;
+}
+
+uint32_t FrfEvaluator::hashCoefficients(const BiquadCoefficients* sections, int numSections)
+{
+	uint32_t hash = 2166136261u;
+	const unsigned char* bytes = (const unsigned char*) sections;
+	for (unsigned int n = 0; n < numSections * sizeof(BiquadCoefficients); n++)
+	{
+		hash ^= bytes[n];
+		hash *= 16777619u;
+	}
+	return hash ^ numSections;
+}
+
+// calculate FRF of cascaded sections
+bool FrfEvaluator::evaluate(const BiquadCoefficients* sections, int numSections)
+{
+	if (numSections > FRF_MAX_SECTIONS)
+		numSections = FRF_MAX_SECTIONS;
+	uint32_t hash = hashCoefficients(sections, numSections);
+	if (valid_ && hash == hash_)
+		return false;
+	
+	// |H(w)|^2 of a cascade is the product of the sections' |H(w)|^2
+	// H(w) = (a0 + a1 e^{-jw} + a2 e^{-2jw}) / (1 + b1 e^{-jw} + b2 e^{-2jw})
+	// the sign of the imaginary part doesn't change the magnitude
+	for (int i = 0; i < FRF_GRAPH_N; i++)
+		magSq_[i] = 1;
+	for (int s = 0; s < numSections; s++)
+	{
+		const BiquadCoefficients& c = sections[s];
+		for (int i = 0; i < FRF_GRAPH_N; i++)
+		{
+			float numRe = c.a0 + c.a1 * cosW_[i] + c.a2 * cos2W_[i];
+			float numIm = c.a1 * sinW_[i] + c.a2 * sin2W_[i];
+			// all coefficients have already been normalized by B0, so here it is 1.
+			float denRe = 1 + c.b1 * cosW_[i] + c.b2 * cos2W_[i];
+			float denIm = c.b1 * sinW_[i] + c.b2 * sin2W_[i];
+			// avoid dividing by 0 for a pole on the unit circle
+			float denSq = denRe * denRe + denIm * denIm + 1e-20f;
+			magSq_[i] *= (numRe * numRe + numIm * numIm) / denSq;
+		}
+	}
+	
+	// convert to decibels in range [-60, 20] mapped to [0, 1]
+	powerToDisplay(magSq_, graph_, FRF_GRAPH_N, 1.0f);
+	
+	hash_ = hash;
+	valid_ = true;
+	return true;
+}
+
+const float* FrfEvaluator::getGraph()
+{
+	return graph_;
+}
@@ -0,0 +1,68 @@
+/***** frfEvaluator.h *****/
+// Frequency response magnitude of a cascade of biquad sections
+// cos/sin of w and 2w are tabulated once for the fixed graph grid, so each
+// refresh is a few multiply-adds per point in plain structure-of-arrays loops
+// (no complex exp). Results are cached on a hash of the coefficients, an
+// unchanged filter is not evaluated again.
+#ifndef FRFEVALUATOR_H
+#define FRFEVALUATOR_H
+
+#include <cstdint>
+
+// number of points in the FRF graph
+#define FRF_GRAPH_N 60
+// maximum number of cascaded sections that can be evaluated together
+#define FRF_MAX_SECTIONS 8
+
+struct BiquadCoefficients;
+
+// enumerator for frequency grid spacing
+enum {
+	kFrfGridLinear = 0, // 0 to Nyquist, evenly spaced
+	kFrfGridLog // minimum frequency to Nyquist, evenly spaced in octaves
+};
+
+class FrfEvaluator
+{
+public:
+	// Constructor, linear grid
+	FrfEvaluator();
+	
+	// Set the sample rate (only changes the log grid)
+	void setSampleRate(float sampleRate);
+	
+	// Set grid spacing, minFrequency is the first point of the log grid
+	void setGrid(int gridType, float minFrequency);
+	
+	// Evaluate the cascade on the grid, returns false if the coefficients
+	// haven't changed since the last call (graph is already up to date)
+	bool evaluate(const BiquadCoefficients* sections, int numSections);
+	
+	// graph values, in dB mapped from [-60, 20] to [0, 1]
+	const float* getGraph();
+	
+private:
+	// Calculate cos/sin table for the current grid
+	void calculateGrid();
+	
+	// FNV-1a hash of the coefficients of every section
+	static uint32_t hashCoefficients(const BiquadCoefficients* sections, int numSections);
+	
+	int gridType_;
+	float sampleRate_, minFrequency_;
+	
+	// e^{-jw} and e^{-2jw} at each grid point, stored as separate arrays
+	float cosW_[FRF_GRAPH_N], sinW_[FRF_GRAPH_N];
+	float cos2W_[FRF_GRAPH_N], sin2W_[FRF_GRAPH_N];
+	
+	// squared magnitude accumulated over sections
+	float magSq_[FRF_GRAPH_N];
+	// FRF graph y-values
+	float graph_[FRF_GRAPH_N];
+	
+	// hash of the coefficients the graph was calculated for
+	uint32_t hash_;
+	bool valid_;
+};
+
+#endif
@@ -0,0 +1,65 @@
+/***** lookupTable.h *****/
+// Fixed-size lookup table and constexpr math used to build tables at compile time
+// Tables are generated by constexpr functions so startup does no math and every
+// voice shares one read-only copy of each table.
+#ifndef LOOKUPTABLE_H
+#define LOOKUPTABLE_H
+
+// fixed size table of floats, filled in by a constexpr generator function
+template <int N>
+struct LookupTable {
+	float values[N];
+
+	constexpr float operator[](int index) const { return values[index]; }
+	constexpr int size() const { return N; }
+};
+
+// compile-time versions of log, exp and pow (double precision)
+namespace ctmath {
+
+constexpr double kLn2 = 0.69314718055994530942;
+
+// natural log: x = m * 2^e with m in [1, 2), ln(m) = 2 * atanh((m-1)/(m+1))
+constexpr double log(double x)
+{
+	int e = 0;
+	while (x >= 2.0) { x *= 0.5; e++; }
+	while (x < 1.0) { x *= 2.0; e--; }
+	double t = (x - 1.0) / (x + 1.0);
+	double t2 = t * t;
+	double term = t;
+	double sum = 0;
+	for (int n = 1; n < 60; n += 2)
+	{
+		sum += term / n;
+		term *= t2;
+	}
+	return e * kLn2 + 2.0 * sum;
+}
+
+// exponential: x = k * ln2 + r with |r| <= ln2/2, Taylor series for e^r
+constexpr double exp(double x)
+{
+	int k = int(x / kLn2 + (x < 0 ? -0.5 : 0.5));
+	double r = x - k * kLn2;
+	double term = 1.0;
+	double sum = 1.0;
+	for (int n = 1; n < 30; n++)
+	{
+		term *= r / n;
+		sum += term;
+	}
+	for (; k > 0; k--) sum *= 2.0;
+	for (; k < 0; k++) sum *= 0.5;
+	return sum;
+}
+
+// base^exponent for base > 0
+constexpr double pow(double base, double exponent)
+{
+	return exp(exponent * log(base));
+}
+
+}
+
+#endif
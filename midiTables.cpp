@@ -0,0 +1,30 @@
+/***** midiTables.cpp *****/
+#include "midiTables.h"
+
+// MIDI note number to frequency, A4 (69) = 440 Hz
+static constexpr LookupTable<NUM_MIDI_NOTES> makeMidiToFreqTable()
+{
+	LookupTable<NUM_MIDI_NOTES> table = {};
+	for (int i = 0; i < NUM_MIDI_NOTES; i++)
+		table.values[i] = ctmath::pow(2.0, (i - 69)/12.0) * 440.0;
+	return table;
+}
+constexpr LookupTable<NUM_MIDI_NOTES> kMidiToFreqTable = makeMidiToFreqTable();
+
+// MIDI velocity to brightness Q-value
+static constexpr LookupTable<NUM_MIDI_NOTES> makeVelocityToQTable()
+{
+	LookupTable<NUM_MIDI_NOTES> table = {};
+	//maximum velocity is 128
+	for (int i = 0; i < NUM_MIDI_NOTES; i++)
+	{
+		if (i <= 40) // 0-40
+			table.values[i] = .707;
+		else if (i <= 80) // 41-80
+			table.values[i] = .707 + (i - 40) * 0.007325;
+		else // 81 - 128
+			table.values[i] = 1 + (i - 80) * 0.0375;
+	}
+	return table;
+}
+constexpr LookupTable<NUM_MIDI_NOTES> kVelocityToQTable = makeVelocityToQTable();
@@ -0,0 +1,15 @@
+/***** midiTables.h *****/
+// Lookup tables converting MIDI note numbers and velocities, shared by every module
+#ifndef MIDITABLES_H
+#define MIDITABLES_H
+
+#include "lookupTable.h"
+
+#define NUM_MIDI_NOTES 128
+
+// table to convert MIDI numbers to frequencies
+extern const LookupTable<NUM_MIDI_NOTES> kMidiToFreqTable;
+// table to convert MIDI velocities to brightness Q-values
+extern const LookupTable<NUM_MIDI_NOTES> kVelocityToQTable;
+
+#endif
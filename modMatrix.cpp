@@ -0,0 +1,285 @@
+/***** modMatrix.cpp *****/
+#include <cmath>
+#include "modMatrix.h"
+#include "spectrum.h"
+#include "brightness.h"
+#include "articulation.h"
+#include "envelope.h"
+
+struct ModLfoSettings {
+	int shape;
+	float rate; // Hz
+	bool retrigger;
+};
+
+struct ModEnvelopeSettings {
+	float attack, decay, sustain, release;
+};
+
+// range of a target's modulated value, octave targets multiply their base
+struct ModTargetRange {
+	float min, max;
+	bool octaves;
+};
+
+// default routings, LFOs and envelopes. Every routed source stays at 0 until
+// the mod wheel, aftertouch or slide is played (the slide rests at its centre),
+// so notes sound as they did without them
+//------------ CHANGE DEFAULT ROUTINGS HERE -----------------
+static const ModSlot kDefaultModSlots[] = {
+	{kModSourceModWheel, kModSourceNone, kModTargetBrightness, 64},
+	{kModSourceAftertouch, kModSourceNone, kModTargetBrightness, 32},
+	{kModSourceLfo1, kModSourceModWheel, kModTargetBrightness, 16},
+	{kModSourceSlide, kModSourceNone, kModTargetSpectrum, 32}
+};
+static const ModLfoSettings kDefaultModLfos[MOD_NUM_LFOS] = {
+	{kModLfoSine, 5, false},
+	{kModLfoTriangle, 0.5, false}
+};
+static const ModEnvelopeSettings kDefaultModEnvelopes[MOD_NUM_ENVELOPES] = {
+	{0.5, 0.5, 0.5, 0.5},
+	{0.01, 1.0, 0, 0.5}
+};
+//------------ CHANGE DEFAULT ROUTINGS HERE -----------------
+
+static_assert(kModTargetAmp1 - kModTargetRatio1 == NUM_OPERATORS && kModTargetBrQ - kModTargetAmp1 == NUM_OPERATORS,
+	"one ratio and one amplitude target per operator");
+static const ModTargetRange kModTargetRanges[kNumModTargets] = {
+	{0, MAX_SPECTRUM - 1, false},
+	{0, MAX_BRIGHTNESS - 1, false},
+	{0, MAX_ARTICULATION - 1, false},
+	{0, MAX_ENVELOPE - 1, false},
+	{0, 64, true}, {0, 64, true}, {0, 64, true}, {0, 64, true},
+	{0, 16, false}, {0, 16, false}, {0, 16, false}, {0, 16, false},
+	{0.5, 10, false},
+	{0.5, 10, false},
+	{0.001, 10, false},
+	{0, 1, false},
+	{0.001, 10, false}
+};
+
+// Constructor
+ModMatrix::ModMatrix() : ModMatrix(44100.0, 1) {}
+
+// Constructor specifying the sample rate and the samples between control ticks
+ModMatrix::ModMatrix(float sampleRate, int controlPeriod)
+{
+	sampleRate_ = sampleRate;
+	controlPeriod_ = controlPeriod;
+	randomSeed_ = 1;
+	envelopeSamples_ = 0;
+	gate_ = false;
+
+	for (int i = 0; i < kNumModSources; i++)
+		sources_[i] = 0;
+	// a slot without a via is scaled by 1
+	sources_[kModSourceNone] = 1;
+	for (int i = 0; i < kNumModTargets; i++)
+	{
+		outputs_[i] = 0;
+		lastOutputs_[i] = 0;
+	}
+
+	for (int i = 0; i < MOD_NUM_SLOTS; i++)
+		clearSlot(i);
+	int numDefaults = sizeof(kDefaultModSlots) / sizeof(kDefaultModSlots[0]);
+	for (int i = 0; i < numDefaults && i < MOD_NUM_SLOTS; i++)
+		setSlot(i, kDefaultModSlots[i].source, kDefaultModSlots[i].via, kDefaultModSlots[i].target, kDefaultModSlots[i].amount);
+
+	for (int i = 0; i < MOD_NUM_LFOS; i++)
+	{
+		setLfo(i, kDefaultModLfos[i].shape, kDefaultModLfos[i].rate, kDefaultModLfos[i].retrigger);
+		lfoPhases_[i] = 0;
+		lfoRandom_[i] = 0;
+	}
+
+	// envelopes run once per control period
+	for (int i = 0; i < MOD_NUM_ENVELOPES; i++)
+	{
+		envelopes_[i] = Adsr(sampleRate_ / controlPeriod_);
+		const ModEnvelopeSettings& envelope = kDefaultModEnvelopes[i];
+		setEnvelope(i, envelope.attack, envelope.decay, envelope.sustain, envelope.release);
+	}
+}
+
+// envelopes are rebuilt at the new rate with their times
+void ModMatrix::setSampleRate(float sampleRate)
+{
+	sampleRate_ = sampleRate;
+	for (int i = 0; i < MOD_NUM_ENVELOPES; i++)
+	{
+		Adsr& envelope = envelopes_[i];
+		float attack = envelope.getAttack();
+		float decay = envelope.getDecay();
+		float sustain = envelope.getSustain();
+		float release = envelope.getRelease();
+		envelope = Adsr(sampleRate_ / controlPeriod_);
+		setEnvelope(i, attack, decay, sustain, release);
+		sources_[kModSourceEnv1 + i] = 0;
+	}
+	envelopeSamples_ = 0;
+}
+
+void ModMatrix::setSlot(int slot, int source, int via, int target, float amount)
+{
+	if (slot < 0 || slot >= MOD_NUM_SLOTS)
+		return;
+	if (source < 0 || source >= kNumModSources || via < 0 || via >= kNumModSources)
+		return;
+	if (target < 0 || target >= kNumModTargets)
+		return;
+	slots_[slot].source = source;
+	slots_[slot].via = via;
+	slots_[slot].target = target;
+	slots_[slot].amount = amount;
+}
+
+void ModMatrix::clearSlot(int slot)
+{
+	if (slot < 0 || slot >= MOD_NUM_SLOTS)
+		return;
+	slots_[slot].source = kModSourceNone;
+	slots_[slot].via = kModSourceNone;
+	slots_[slot].target = 0;
+	slots_[slot].amount = 0;
+}
+
+void ModMatrix::setLfo(int lfo, int shape, float rate, bool retrigger)
+{
+	if (lfo < 0 || lfo >= MOD_NUM_LFOS || shape < 0 || shape >= kNumModLfoShapes)
+		return;
+	lfoShapes_[lfo] = shape;
+	lfoRates_[lfo] = rate;
+	lfoRetrigger_[lfo] = retrigger;
+}
+
+void ModMatrix::setEnvelope(int envelope, float attack, float decay, float sustain, float release)
+{
+	if (envelope < 0 || envelope >= MOD_NUM_ENVELOPES)
+		return;
+	envelopes_[envelope].setAttack(attack);
+	envelopes_[envelope].setDecay(decay);
+	envelopes_[envelope].setSustain(sustain);
+	envelopes_[envelope].setRelease(release);
+}
+
+// performance sources
+void ModMatrix::setVelocity(float velocity)
+{
+	sources_[kModSourceVelocity] = velocity;
+}
+void ModMatrix::setAftertouch(float aftertouch)
+{
+	sources_[kModSourceAftertouch] = aftertouch;
+}
+void ModMatrix::setModWheel(float modWheel)
+{
+	sources_[kModSourceModWheel] = modWheel;
+}
+void ModMatrix::setSlide(float slide)
+{
+	sources_[kModSourceSlide] = slide;
+}
+float ModMatrix::slideFromController(int value)
+{
+	if (value >= SLIDE_CENTRE)
+		return (value - SLIDE_CENTRE) / float(127 - SLIDE_CENTRE);
+	return (value - SLIDE_CENTRE) / float(SLIDE_CENTRE);
+}
+
+// Control tick: move the LFOs and envelopes on, then sum every slot into its target
+void ModMatrix::update(bool gate, int samples)
+{
+	bool noteOn = (gate && !gate_);
+	gate_ = gate;
+
+	for (int i = 0; i < MOD_NUM_LFOS; i++)
+	{
+		float& phase = lfoPhases_[i];
+		if (noteOn && lfoRetrigger_[i])
+			phase = 0;
+		phase += lfoRates_[i] * samples / sampleRate_;
+		if (phase >= 1)
+		{
+			phase -= floorf(phase);
+			// the random shape holds a new level every cycle
+			randomSeed_ = randomSeed_ * 1664525 + 1013904223;
+			lfoRandom_[i] = float(randomSeed_ >> 8) / float(1 << 23) - 1.0f;
+		}
+		sources_[kModSourceLfo1 + i] = lfoValue(i);
+	}
+
+	// the envelopes keep their level between their steps
+	for (envelopeSamples_ += samples; envelopeSamples_ >= controlPeriod_; envelopeSamples_ -= controlPeriod_)
+	{
+		for (int i = 0; i < MOD_NUM_ENVELOPES; i++)
+			sources_[kModSourceEnv1 + i] = envelopes_[i].process(gate);
+	}
+
+	for (int i = 0; i < kNumModTargets; i++)
+	{
+		lastOutputs_[i] = outputs_[i];
+		outputs_[i] = 0;
+	}
+	for (int i = 0; i < MOD_NUM_SLOTS; i++)
+	{
+		const ModSlot& slot = slots_[i];
+		if (slot.source == kModSourceNone)
+			continue;
+		outputs_[slot.target] += slot.amount * sources_[slot.source] * sources_[slot.via];
+	}
+}
+
+float ModMatrix::lfoValue(int lfo)
+{
+	float phase = lfoPhases_[lfo];
+	switch (lfoShapes_[lfo])
+	{
+		case kModLfoSine: return sinf(2 * M_PI * phase);
+		case kModLfoTriangle: return (phase < 0.5f) ? 4 * phase - 1 : 3 - 4 * phase;
+		case kModLfoSaw: return 1 - 2 * phase;
+		case kModLfoSquare: return (phase < 0.5f) ? 1 : -1;
+		case kModLfoRandom: return lfoRandom_[lfo];
+	}
+	return 0;
+}
+
+// Getters
+float ModMatrix::getSource(int source)
+{
+	return sources_[source];
+}
+float ModMatrix::getOutput(int target)
+{
+	return outputs_[target];
+}
+
+bool ModMatrix::hasChanged(int firstTarget, int numTargets)
+{
+	for (int i = firstTarget; i < firstTarget + numTargets; i++)
+	{
+		if (outputs_[i] != lastOutputs_[i])
+			return true;
+	}
+	return false;
+}
+
+// an unmodulated target keeps its base value, even outside the target's range
+float ModMatrix::apply(int target, float base)
+{
+	float output = outputs_[target];
+	if (output == 0)
+		return base;
+	const ModTargetRange& range = kModTargetRanges[target];
+	float value = range.octaves ? base * exp2f(output) : base + output;
+	if (value < range.min)
+		value = range.min;
+	if (value > range.max)
+		value = range.max;
+	return value;
+}
+
+int ModMatrix::applyDimension(int target, int base)
+{
+	return int(lrintf(apply(target, base)));
+}
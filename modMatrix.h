@@ -0,0 +1,152 @@
+/***** modMatrix.h *****/
+// Modulation matrix, evaluated once per control tick
+// Sources are free running LFOs, auxiliary envelopes following the key, and
+// the note's velocity, aftertouch, mod wheel and MPE slide. Each of a fixed number of
+// slots routes a source, optionally scaled by a second (via) source, to a
+// target with an amount in the target's units. The outputs of all slots are
+// summed per target and added to the target's base value (see apply). Slots
+// are preallocated and all evaluated every tick, so the cost of the matrix is
+// bounded by MOD_NUM_SLOTS whatever the routing.
+#ifndef MODMATRIX_H
+#define MODMATRIX_H
+
+#include "adsr.h"
+
+//------------ CHANGE MODULATION HERE -----------------
+#define MOD_NUM_SLOTS 8 // routing slots (default routings in modMatrix.cpp)
+#define MOD_WHEEL_CC 1 // MIDI controller number of the mod wheel
+#define SLIDE_CC 74 // MIDI controller number of the slide (MPE timbre)
+#define SLIDE_CENTRE 64 // controller value the slide rests at (MPE controllers start there)
+//------------ CHANGE MODULATION HERE -----------------
+
+#define MOD_NUM_LFOS 2
+#define MOD_NUM_ENVELOPES 2
+
+// enumerator for the modulation sources
+// LFOs and the slide are bipolar (-1 to 1), all other sources go from 0 to 1
+enum modSources {
+	kModSourceNone = 0, // a slot without a source is off, a slot without a via is not scaled
+	kModSourceLfo1,
+	kModSourceLfo2,
+	kModSourceEnv1,
+	kModSourceEnv2,
+	kModSourceVelocity,
+	kModSourceAftertouch,
+	kModSourceModWheel,
+	kModSourceSlide, // MPE slide (SLIDE_CC) of the note's channel, 0 at SLIDE_CENTRE
+	kNumModSources
+};
+
+// enumerator for the modulation targets, with the units of their amounts
+// the operator and Q, DSR targets only act in advanced mode
+enum modTargets {
+	kModTargetSpectrum = 0, // timbre dimension steps (not in advanced mode)
+	kModTargetBrightness, // timbre dimension steps
+	kModTargetArticulation, // timbre dimension steps
+	kModTargetEnvelope, // timbre dimension steps
+	kModTargetRatio1, // octaves, for each operator
+	kModTargetRatio2,
+	kModTargetRatio3,
+	kModTargetRatio4,
+	kModTargetAmp1, // amplitude, for each operator
+	kModTargetAmp2,
+	kModTargetAmp3,
+	kModTargetAmp4,
+	kModTargetBrQ, // brightness Q (with the MIDI link off)
+	kModTargetArQ, // articulation Q
+	kModTargetDecay, // seconds
+	kModTargetSustain, // level
+	kModTargetRelease, // seconds
+	kNumModTargets
+};
+
+// enumerator for the LFO shapes
+enum modLfoShapes {
+	kModLfoSine = 0,
+	kModLfoTriangle,
+	kModLfoSaw,
+	kModLfoSquare,
+	kModLfoRandom, // a new random level every cycle (sample and hold)
+	kNumModLfoShapes
+};
+
+struct ModSlot {
+	int source; // kModSourceNone for an unused slot
+	int via; // source scaling the amount, kModSourceNone for none
+	int target;
+	float amount; // in the target's units for a source at 1
+};
+
+class ModMatrix
+{
+public:
+	// Constructor
+	ModMatrix();
+
+	// Constructor specifying the sample rate and the samples between control ticks
+	ModMatrix(float sampleRate, int controlPeriod);
+
+	// Set sample rate (restarts the auxiliary envelopes)
+	void setSampleRate(float sampleRate);
+
+	// Routing, slots outside the range or with an unknown source or target are ignored
+	void setSlot(int slot, int source, int via, int target, float amount);
+	void clearSlot(int slot);
+
+	// LFO shape, rate (Hz) and whether it restarts its cycle on each note on
+	void setLfo(int lfo, int shape, float rate, bool retrigger);
+	// auxiliary envelope times (seconds) and sustain level
+	void setEnvelope(int envelope, float attack, float decay, float sustain, float release);
+
+	// performance sources (0 to 1, the slide -1 to 1)
+	void setVelocity(float velocity);
+	void setAftertouch(float aftertouch);
+	void setModWheel(float modWheel);
+	void setSlide(float slide);
+	// slide of a SLIDE_CC value, -1 at 0, 0 at SLIDE_CENTRE and 1 at 127
+	static float slideFromController(int value);
+
+	// CALL EVERY CONTROL TICK
+	// advance the LFOs and envelopes by the samples since the last tick and
+	// evaluate every slot. gate is whether the key is held
+	void update(bool gate, int samples);
+
+	// current value of a source
+	float getSource(int source);
+	// summed modulation of a target
+	float getOutput(int target);
+	// whether any of numTargets targets from firstTarget moved at the last update
+	bool hasChanged(int firstTarget, int numTargets);
+	// modulated value of a target from its base value, within the target's range
+	float apply(int target, float base);
+	// modulated timbre dimension, rounded to a whole step
+	int applyDimension(int target, int base);
+
+private:
+	// value of an LFO at its phase
+	float lfoValue(int lfo);
+
+	float sampleRate_;
+	int controlPeriod_;
+
+	ModSlot slots_[MOD_NUM_SLOTS];
+
+	// LFOs
+	int lfoShapes_[MOD_NUM_LFOS];
+	float lfoRates_[MOD_NUM_LFOS]; // Hz
+	bool lfoRetrigger_[MOD_NUM_LFOS];
+	float lfoPhases_[MOD_NUM_LFOS]; // 0 to 1
+	float lfoRandom_[MOD_NUM_LFOS]; // held level of the random shape
+	unsigned int randomSeed_;
+
+	// auxiliary envelopes, run once per control period
+	Adsr envelopes_[MOD_NUM_ENVELOPES];
+	int envelopeSamples_; // samples not yet run by the envelopes
+	bool gate_; // gate at the last update
+
+	float sources_[kNumModSources];
+	float outputs_[kNumModTargets];
+	float lastOutputs_[kNumModTargets]; // outputs before the last update
+};
+
+#endif
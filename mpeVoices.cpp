@@ -0,0 +1,295 @@
+/***** mpeVoices.cpp *****/
+#include "mpeVoices.h"
+
+MpeVoices::MpeVoices()
+{
+	numVoices_ = 0;
+	voiceLimit_ = 0;
+	noteCount_ = 0;
+	zoneBend_ = 0;
+	for (int v = 0; v < MPE_MAX_VOICES; v++)
+	{
+		channels_[v] = -1;
+		notes_[v] = -1;
+		ages_[v] = 0;
+		bends_[v] = 0;
+		pressures_[v] = 0;
+		slides_[v] = 0;
+		for (int d = 0; d < kNumTimbreDimensions; d++)
+			timbres_[d][v] = -1;
+	}
+	for (int c = 0; c < MPE_NUM_CHANNELS; c++)
+	{
+		channelBends_[c] = 0;
+		channelPressures_[c] = 0;
+		channelSlides_[c] = 0;
+	}
+}
+
+// CALL IN SETUP
+void MpeVoices::setup(const std::vector<Note*>& voices)
+{
+	voices_ = voices;
+	if (voices_.size() > MPE_MAX_VOICES)
+		voices_.resize(MPE_MAX_VOICES);
+	numVoices_ = voices_.size();
+	voiceLimit_ = numVoices_;
+}
+
+// CALL IN SETUP
+bool MpeVoices::initMidi()
+{
+	if (midi_.readFrom(MPE_MIDI_PORT) < 0) {
+		rt_printf("Unable to read from MIDI port %s\n", MPE_MIDI_PORT);
+		return false;
+	}
+	midi_.writeTo(MPE_MIDI_PORT);
+	midi_.enableParser(true);
+	return true;
+}
+
+// read incoming MIDI messages, the GUI shows the latest note while any is held
+void MpeVoices::processMidi(Gui& gui)
+{
+	PROFILE_STAGE(kStageMidi);
+	while (midi_.getParser()->numAvailableMessages() > 0)
+	{
+		MidiChannelMessage message;
+		message = midi_.getParser()->getNextChannelMessage();
+		int channel = message.getChannel();
+
+		if (message.getType() == kmmNoteOn && message.getDataByte(1) > 0) {
+			int midiBuffer[2] = {message.getDataByte(0), message.getDataByte(1)};
+			if (noteOn(channel, midiBuffer[0], midiBuffer[1]) >= 0)
+				gui.sendBuffer(kBtGMidi, midiBuffer);
+		}
+		else if (message.getType() == kmmNoteOn || message.getType() == kmmNoteOff) {
+			noteOff(channel, message.getDataByte(0));
+			bool held = false;
+			for (int v = 0; v < numVoices_; v++)
+				held = held || (channels_[v] >= 0);
+			if (!held)
+				gui.sendBuffer(kBtGMidi, 0);
+		}
+		else if (message.getType() == kmmPitchBend)
+			pitchBend(channel, (message.getDataByte(1) << 7) + message.getDataByte(0));
+		else if (message.getType() == kmmChannelPressure)
+			channelPressure(channel, message.getDataByte(0));
+		else if (message.getType() == kmmPolyphonicKeyPressure)
+			polyPressure(channel, message.getDataByte(0), message.getDataByte(1));
+		else if (message.getType() == kmmControlChange)
+			controlChange(channel, message.getDataByte(0), message.getDataByte(1));
+	}
+}
+
+// the note takes the expression its channel already has
+int MpeVoices::noteOn(int channel, int noteNumber, int velocity)
+{
+	if (channel < 0 || channel >= MPE_NUM_CHANNELS)
+		return -1;
+	if (velocity == 0)
+	{
+		noteOff(channel, noteNumber);
+		return -1;
+	}
+	int voice = allocateVoice();
+	if (voice < 0)
+		return -1;
+	channels_[voice] = channel;
+	notes_[voice] = noteNumber;
+	ages_[voice] = noteCount_++;
+	bends_[voice] = channelBends_[channel];
+	pressures_[voice] = channelPressures_[channel];
+	slides_[voice] = channelSlides_[channel];
+
+	Note* note = voices_[voice];
+	sendBend(voice);
+	note->setAftertouch(pressures_[voice]);
+	note->setSlide(slides_[voice]);
+	note->triggerNote(noteNumber, velocity);
+	return voice;
+}
+
+void MpeVoices::noteOff(int channel, int noteNumber)
+{
+	int voice = findVoice(channel, noteNumber);
+	if (voice < 0)
+		return;
+	channels_[voice] = -1;
+	voices_[voice]->triggerNote(noteNumber, 0);
+}
+
+// the master channel bends the whole zone by its own range
+void MpeVoices::pitchBend(int channel, int value)
+{
+	if (channel < 0 || channel >= MPE_NUM_CHANNELS)
+		return;
+	float bend = (value - 8192) / 8192.0f;
+	if (channel == MPE_MASTER_CHANNEL)
+	{
+		zoneBend_ = PITCH_BEND_RANGE * bend;
+		for (int v = 0; v < numVoices_; v++)
+			sendBend(v);
+		return;
+	}
+	channelBends_[channel] = MPE_MEMBER_BEND_RANGE * bend;
+	for (int v = 0; v < numVoices_; v++)
+	{
+		if (channels_[v] != channel)
+			continue;
+		bends_[v] = channelBends_[channel];
+		sendBend(v);
+	}
+}
+
+void MpeVoices::channelPressure(int channel, int value)
+{
+	if (channel < 0 || channel >= MPE_NUM_CHANNELS)
+		return;
+	channelPressures_[channel] = value / 127.0f;
+	for (int v = 0; v < numVoices_; v++)
+	{
+		if (!reaches(channel, v))
+			continue;
+		pressures_[v] = channelPressures_[channel];
+		voices_[v]->setAftertouch(pressures_[v]);
+	}
+}
+
+void MpeVoices::polyPressure(int channel, int noteNumber, int value)
+{
+	int voice = findVoice(channel, noteNumber);
+	if (voice < 0)
+		return;
+	pressures_[voice] = value / 127.0f;
+	voices_[voice]->setAftertouch(pressures_[voice]);
+}
+
+void MpeVoices::controlChange(int channel, int controller, int value)
+{
+	if (channel < 0 || channel >= MPE_NUM_CHANNELS)
+		return;
+	if (controller == SLIDE_CC)
+	{
+		channelSlides_[channel] = ModMatrix::slideFromController(value);
+		for (int v = 0; v < numVoices_; v++)
+		{
+			if (!reaches(channel, v))
+				continue;
+			slides_[v] = channelSlides_[channel];
+			voices_[v]->setSlide(slides_[v]);
+		}
+	}
+	else if (controller == MOD_WHEEL_CC)
+	{
+		for (int v = 0; v < numVoices_; v++)
+			if (reaches(channel, v))
+				voices_[v]->setModWheel(value / 127.0f);
+	}
+}
+
+void MpeVoices::setTimbre(int dimension, int value)
+{
+	for (int v = 0; v < numVoices_; v++)
+		setVoiceTimbre(v, dimension, value);
+}
+
+void MpeVoices::setVoiceTimbre(int voice, int dimension, int value)
+{
+	if (voice < 0 || voice >= numVoices_ || dimension < 0 || dimension >= kNumTimbreDimensions)
+		return;
+	if (timbres_[dimension][voice] == value)
+		return;
+	timbres_[dimension][voice] = value;
+	voices_[voice]->setTimbre(dimension, value);
+}
+
+// advanced mode and quality are shared by every voice
+void MpeVoices::setAdvMode(float advMode)
+{
+	for (int v = 0; v < numVoices_; v++)
+		voices_[v]->setAdvMode(advMode);
+}
+void MpeVoices::setAdvControls(float* controlData)
+{
+	for (int v = 0; v < numVoices_; v++)
+		voices_[v]->setAdvControls(controlData);
+}
+void MpeVoices::updateAdvSpectrum(float* fmBuffer)
+{
+	for (int v = 0; v < numVoices_; v++)
+		voices_[v]->updateAdvSpectrum(fmBuffer);
+}
+void MpeVoices::setQualityTier(int tier)
+{
+	for (int v = 0; v < numVoices_; v++)
+		voices_[v]->setQualityTier(tier);
+}
+
+// a voice above the limit plays its release tail out and is then idle
+void MpeVoices::setVoiceLimit(int voiceLimit)
+{
+	if (voiceLimit < 1)
+		voiceLimit = 1;
+	if (voiceLimit > numVoices_)
+		voiceLimit = numVoices_;
+	for (int v = voiceLimit; v < voiceLimit_; v++)
+	{
+		if (channels_[v] < 0)
+			continue;
+		channels_[v] = -1;
+		voices_[v]->triggerNote(notes_[v], 0);
+	}
+	voiceLimit_ = voiceLimit;
+}
+
+bool MpeVoices::checkBakeRequested()
+{
+	for (int v = 0; v < numVoices_; v++)
+		if (voices_[v]->checkBakeRequested())
+			return true;
+	return false;
+}
+void MpeVoices::bakeSpectra()
+{
+	for (int v = 0; v < numVoices_; v++)
+		voices_[v]->bakeSpectrum();
+}
+
+int MpeVoices::findVoice(int channel, int noteNumber)
+{
+	for (int v = 0; v < numVoices_; v++)
+		if (channels_[v] == channel && notes_[v] == noteNumber)
+			return v;
+	return -1;
+}
+
+// an idle voice, else the one released longest ago, else the oldest held,
+// within the voice limit (a stolen voice carries on from its envelope's level)
+int MpeVoices::allocateVoice()
+{
+	for (int v = 0; v < voiceLimit_; v++)
+		if (voices_[v]->isIdle())
+			return v;
+	int voice = -1;
+	for (int v = 0; v < voiceLimit_; v++)
+		if (channels_[v] < 0 && (voice < 0 || ages_[v] < ages_[voice]))
+			voice = v;
+	if (voice >= 0)
+		return voice;
+	for (int v = 0; v < voiceLimit_; v++)
+		if (voice < 0 || ages_[v] < ages_[voice])
+			voice = v;
+	return voice;
+}
+
+// the master channel reaches every voice, released or not
+bool MpeVoices::reaches(int channel, int voice)
+{
+	return (channel == MPE_MASTER_CHANNEL || channels_[voice] == channel);
+}
+
+void MpeVoices::sendBend(int voice)
+{
+	voices_[voice]->setPitchBend(bends_[voice] + zoneBend_);
+}
@@ -0,0 +1,117 @@
+/***** mpeVoices.h *****/
+// MIDI Polyphonic Expression (MPE) over a set of voices (Note objects)
+// In an MPE zone every sounding note has a member channel of its own, so the
+// pitch bend, pressure and slide of that channel steer that note alone.
+// MpeVoices reads the MIDI port, gives each note on to a voice (an idle one,
+// else the one released longest ago, else the oldest) among the first voice
+// limit ones, which the CPU governor lowers under load, and passes each
+// message on to the voices playing its channel only. Messages on the master channel
+// act on the whole zone, its pitch bend adding to that of every note.
+// The state of the voices is kept as a structure of arrays indexed by voice,
+// so a message scans one small array for its voices and changes nothing but
+// their entries. A released voice keeps its expression while its tail plays,
+// even once its channel carries a new note.
+#ifndef MPEVOICES_H
+#define MPEVOICES_H
+
+#include <libraries/Midi/Midi.h>
+#include <libraries/Gui/Gui.h>
+#include <vector>
+#include "note.h"
+
+//------------ ENABLE MPE HERE -----------------
+// play MPE_NUM_VOICES voices from an MPE controller instead of a single note
+#define MPE 0
+//------------ ENABLE MPE HERE -----------------
+
+//------------ CHANGE MPE HERE -----------------
+#define MPE_NUM_VOICES 8 // up to MPE_MAX_VOICES
+#define MPE_MASTER_CHANNEL 0 // 0 for a lower zone, 15 for an upper zone
+#define MPE_MEMBER_BEND_RANGE 48 // semitones, the master channel uses PITCH_BEND_RANGE
+#define MPE_MIDI_PORT "hw:1,0,0"
+//------------ CHANGE MPE HERE -----------------
+
+#define MPE_MAX_VOICES 16
+#define MPE_NUM_CHANNELS 16
+
+class MpeVoices
+{
+public:
+	MpeVoices();
+
+	// voices to play, up to MPE_MAX_VOICES
+	// CALL IN SETUP
+	void setup(const std::vector<Note*>& voices);
+	// initialize communication with MIDI device
+	// CALL IN SETUP
+	bool initMidi();
+
+	// read incoming MIDI messages and pass them on to the voices (once per block)
+	void processMidi(Gui& gui);
+
+	// MIDI messages by hand, channels 0 to 15 and values as in the messages
+	// noteOn returns the voice playing the note (velocity 0 is a note off, -1)
+	int noteOn(int channel, int noteNumber, int velocity);
+	void noteOff(int channel, int noteNumber);
+	void pitchBend(int channel, int value); // 0 to 16383, centred on 8192
+	void channelPressure(int channel, int value);
+	void polyPressure(int channel, int noteNumber, int value);
+	void controlChange(int channel, int controller, int value);
+
+	// set a timbre dimension (timbreDimensions) of every voice or of one,
+	// each voice is only updated if its value changes
+	void setTimbre(int dimension, int value);
+	void setVoiceTimbre(int voice, int dimension, int value);
+
+	// advanced mode and quality of every voice (see Note)
+	void setAdvMode(float advMode);
+	void setAdvControls(float* controlData);
+	void updateAdvSpectrum(float* fmBuffer);
+	void setQualityTier(int tier);
+	// voices new notes may take (at least one), a lower limit releases the held
+	// notes of the voices above it
+	void setVoiceLimit(int voiceLimit);
+	int getVoiceLimit() { return voiceLimit_; }
+
+	// whether any voice is waiting for a baked cycle (check every block,
+	// schedule the bake task), and bake every waiting voice (bake task)
+	bool checkBakeRequested();
+	void bakeSpectra();
+
+	int getNumVoices() { return numVoices_; }
+	// voice holding a note on a channel (-1 if none)
+	int findVoice(int channel, int noteNumber);
+
+private:
+	// voice for a new note
+	int allocateVoice();
+	// whether a message on a channel reaches a voice
+	bool reaches(int channel, int voice);
+	// send a voice its pitch bend, its channel's plus the zone's
+	void sendBend(int voice);
+
+	std::vector<Note*> voices_;
+	int numVoices_;
+	int voiceLimit_; // voices [0, voiceLimit_) take new notes
+	unsigned int noteCount_; // note ons so far, orders the voices by age
+
+	// voice state (structure of arrays)
+	int channels_[MPE_MAX_VOICES]; // channel of the held note, -1 once released
+	int notes_[MPE_MAX_VOICES]; // MIDI note number
+	unsigned int ages_[MPE_MAX_VOICES]; // note count at its note on
+	float bends_[MPE_MAX_VOICES]; // pitch bend of its channel (semitones)
+	float pressures_[MPE_MAX_VOICES]; // 0 to 1
+	float slides_[MPE_MAX_VOICES]; // -1 to 1, 0 at rest
+	int timbres_[kNumTimbreDimensions][MPE_MAX_VOICES]; // -1 until set
+
+	// channel state, controllers send it before their notes start
+	float channelBends_[MPE_NUM_CHANNELS];
+	float channelPressures_[MPE_NUM_CHANNELS];
+	float channelSlides_[MPE_NUM_CHANNELS];
+	float zoneBend_; // pitch bend of the master channel (semitones)
+
+	// Object for handling MIDI messages
+	Midi midi_;
+};
+
+#endif
@@ -1,9 +1,8 @@
 /***** note.cpp *****/
 //==NOTE==
 //==failed polyphony prototype included for future reference==
-// raw and final spectrum FFT code can and probably should be collapsed into arrays for more compact code
-// ran out of time
 #include "note.h"
+#include "dbConvert.h"
 
 // Constructor
 Note::Note() : Note(44100.0, 440.0) {}
@@ -12,24 +11,48 @@ Note::Note() : Note(44100.0, 440.0) {}
 // all vectors initialized  here to set starting size
 Note::Note(float sampleRate, float frequency) :
 spectrum_(sampleRate, frequency),
-outFftInputBuffer_(FFT_BUFFER_N),
-outFftOutputBuffer_(FFT_OUT_N),
-fftWindowBuffer_(FFT_BUFFER_N),
+modMatrix_(sampleRate, CONTROL_PERIOD),
+outFftOutputBuffer_(FFT_NUM_BANDS),
+fftBandPower_(FFT_NUM_BANDS),
 fftSpectrum_(sampleRate, frequency),
-specFftInputBuffer_(FFT_BUFFER_N),
-specFftOutputBuffer_(FFT_OUT_N)
+specFftOutputBuffer_(FFT_NUM_BANDS)
 {
 	sampleRate_ = sampleRate;
 	frequency_ = frequency;
+	noteNumber_ = -1;
+	pitchBend_ = 0;
+	pendingPitchBend_ = 0;
+	qFactor_ = 1;
 	velocity_ = 0;
 	noteOn_ = false;
+	midiNoteOn_ = false;
+	advMode_ = false;
 	fftSpectrumFreq_ = 440;
+	silentSamples_ = 0;
+	spectrumFftHold_ = 0;
+	analyzed_ = true;
 
 	// Initialize timbre parameter objects
 	// Spectrum constructor not called here since it is not copyable
 	brightness_ = Brightness(sampleRate_, frequency_);
 	articulation_ = Articulation(sampleRate_);
 	envelope_ = Envelope(sampleRate_);
+	// only the played spectrum is baked, the raw spectrum FFT keeps its operators
+	spectrum_.enableBaking(SPECTRUM_BAKE);
+	qualityTier_ = -1;
+	setQualityTier(QUALITY_TIER);
+	
+	// nothing waits for the first control tick
+	controlCount_ = 0;
+	tickSamples_ = 0;
+	pendingSpectrum_ = spectrum_.getSpectrum();
+	pendingBrightness_ = brightness_.getBrightness();
+	pendingArticulation_ = articulation_.getArticulation();
+	pendingEnvelope_ = envelope_.getEnvelope();
+	advControlsPending_ = false;
+	advControlsSet_ = false;
+	advSpectrumPending_ = false;
+	advSpectrumSet_ = false;
 	
 	// polyphony ==DOES NOT WORK==
 	// for (int i = 0; i < NUM_VOICES; i++)
@@ -46,42 +69,22 @@ specFftOutputBuffer_(FFT_OUT_N)
 	// }
 	
 	// FFT variables and setup
-	outFftReady_ = false;
-	outFftWritePtr_ = 0;
-	outFftNeWritePtr_ = 0;
-	outFftSampleCounter_ = 0;
-	outFftNeInput_ = (ne10_fft_cpx_float32_t*) NE10_MALLOC (FFT_BUFFER_N * sizeof (ne10_fft_cpx_float32_t));
-	outFftNeOutput_ = (ne10_fft_cpx_float32_t*) NE10_MALLOC (FFT_BUFFER_N * sizeof (ne10_fft_cpx_float32_t));
-	outFftcfg_ = ne10_fft_alloc_c2c_float32_neon (FFT_BUFFER_N);
-	// Calculate a Hann window
-	for(int n = 0; n < FFT_BUFFER_N; n++) {
-		fftWindowBuffer_[n] = 0.5f * (1.0f - cosf(2.0f * M_PI * n / (float)(FFT_BUFFER_N - 1)));
-	}
+	outFft_.setup(sampleRate_, FFT_OUT_MODE, FFT_HOP_SIZE, FFT_DISPLAY_PERIOD);
+	specFft_.setup(sampleRate_, kFftModeSnapshot, FFT_DISPLAY_PERIOD, FFT_DISPLAY_PERIOD);
+	features_.setup(sampleRate_, FFT_BUFFER_N, FFT_HOP_SIZE);
+	// Display bands, depend on the sample rate
+	fftBands_.setup(FFT_OUT_N, sampleRate_, FFT_NUM_BANDS, FFT_BAND_SCALE, FFT_BAND_POOLING, FFT_BAND_MIN_FREQ);
 	fftSpectrum_.setFrequency(fftSpectrumFreq_);
-	specFftReady_ = false;
-	specFftWritePtr_ = 0;
-	specFftNeWritePtr_ = 0;
-	specFftSampleCounter_ = 0;
-	specFftNeInput_ = (ne10_fft_cpx_float32_t*) NE10_MALLOC (FFT_BUFFER_N * sizeof (ne10_fft_cpx_float32_t));
-	specFftNeOutput_ = (ne10_fft_cpx_float32_t*) NE10_MALLOC (FFT_BUFFER_N * sizeof (ne10_fft_cpx_float32_t));
-	specFftcfg_ = ne10_fft_alloc_c2c_float32_neon (FFT_BUFFER_N);
+	
+	// graphs are calculated once the graph task first runs
+	brGraphDirty_ = true;
+	arGraphDirty_ = true;
 	
 	// debug variables for square wave timing
 	frameCount_ = 0;
 	framePeriod_ = int(sampleRate / frequency_);
 }
 
-// Destructor - clear NE10 pointers allocated in setup
-Note::~Note()
-{
-	NE10_FREE(outFftNeInput_);
-	NE10_FREE(outFftNeOutput_);
-	NE10_FREE(outFftcfg_);
-	NE10_FREE(specFftNeInput_);
-	NE10_FREE(specFftNeOutput_);
-	NE10_FREE(specFftcfg_);
-}
-
 // Set sample rate of object and all timbre objects
 void Note::setSampleRate(float sampleRate)
 {
@@ -92,6 +95,7 @@ void Note::setSampleRate(float sampleRate)
 	brightness_.setSampleRate(sampleRate_);
 	articulation_.setSampleRate(sampleRate_);
 	envelope_.setSampleRate(sampleRate_);
+	modMatrix_.setSampleRate(sampleRate_);
 	
 	// Polyphony ==DOES NOT WORK==
 	// for (int i = 0; i < NUM_VOICES; i++)
@@ -103,6 +107,10 @@ void Note::setSampleRate(float sampleRate)
 	// }
 	
 	fftSpectrum_.setSampleRate(sampleRate_);
+	outFft_.setSampleRate(sampleRate_);
+	specFft_.setSampleRate(sampleRate_);
+	features_.setup(sampleRate_, FFT_BUFFER_N, FFT_HOP_SIZE);
+	fftBands_.setup(FFT_OUT_N, sampleRate_, FFT_NUM_BANDS, FFT_BAND_SCALE, FFT_BAND_POOLING, FFT_BAND_MIN_FREQ);
 }
 
 // CALL IN SETUP
@@ -115,19 +123,6 @@ bool Note::initMidi()
 	}
 	midi_.writeTo(midiPort0_);
 	midi_.enableParser(true);
-	
-	// Initialize midi to frequency table
-	for (int i = 0; i < NUM_MIDI_NOTES; i++)
-	{
-		midiToFreqTable_[i] = powf(2.0, (i - 69)/12.0) * 440.0;
-		//maximum velocity is 128
-		if (i <= 40) // 0-40
-			velocityToQTable_[i] = .707;
-		else if (i <= 80) // 41-80
-			velocityToQTable_[i] = .707 + (i - 40) * 0.007325;
-		else // 81 - 128
-			velocityToQTable_[i] = 1 + (i - 80) * 0.0375;
-	}	
 	return true;
 }
 
@@ -150,32 +145,100 @@ int Note::envelope()
 }
 
 // Setters for Timbre Parameters
+// changes wait for the next control tick
 void Note::setSpectrum(int spectrum)
 {
-	spectrum_.updateSpectrum(spectrum);
-	fftSpectrum_.updateSpectrum(spectrum);
-	
+	pendingSpectrum_ = spectrum;
 	
 	// Polyphony ==DOES NOT WORK==// for (int i = 0; i < NUM_VOICES; i++)
 	// 	spectrums_[i].updateSpectrum(spectrum);
 }
 void Note::setBrightness(int brightness)
 {
-	brightness_.updateBrightness(brightness);
+	pendingBrightness_ = brightness;
 	// Polyphony ==DOES NOT WORK==
 	// for (int i = 0; i < NUM_VOICES; i++)
 	// 	brightnesses_[i].updateBrightness(brightness);
 }
 void Note::setArticulation(int articulation)
 {
-	articulation_.updateArticulation(articulation);
+	pendingArticulation_ = articulation;
 	// Polyphony ==DOES NOT WORK==
 	// for (int i = 0; i < NUM_VOICES; i++)
 	// 	articulations_[i].updateArticulation(articulation);
 }
+void Note::setTimbre(int dimension, int value)
+{
+	switch (dimension)
+	{
+		case kTimbreSpectrum: setSpectrum(value); break;
+		case kTimbreBrightness: setBrightness(value); break;
+		case kTimbreArticulation: setArticulation(value); break;
+		case kTimbreEnvelope: setEnvelope(value); break;
+	}
+}
+
+// Modulation routing and sources, used from the next control tick
+void Note::setModSlot(int slot, int source, int via, int target, float amount)
+{
+	modMatrix_.setSlot(slot, source, via, target, amount);
+}
+void Note::setModWheel(float modWheel)
+{
+	modMatrix_.setModWheel(modWheel);
+}
+void Note::setAftertouch(float aftertouch)
+{
+	modMatrix_.setAftertouch(aftertouch);
+}
+void Note::setSlide(float slide)
+{
+	modMatrix_.setSlide(slide);
+}
+
+// Pitch bend, at the next control tick
+void Note::setPitchBend(float semitones)
+{
+	pendingPitchBend_ = semitones;
+}
+
+// Set quality tier of the spectrum and articulation
+void Note::setQualityTier(int tier)
+{
+	if (tier < 0)
+		tier = 0;
+	if (tier >= kNumQualityTiers)
+		tier = kNumQualityTiers - 1;
+	if (tier == qualityTier_)
+		return;
+	// the first tier is set by the constructor, nothing is sounding yet
+	bool fade = (qualityTier_ >= 0);
+	qualityTier_ = tier;
+	
+	const QualitySettings& quality = getQualitySettings(qualityTier_);
+	spectrum_.setQuality(quality.interpolation, quality.tableSize, quality.bandLimited, fade);
+	// the raw spectrum FFT shows what the tier plays
+	fftSpectrum_.setQuality(quality.interpolation, quality.tableSize, quality.bandLimited, false);
+	articulation_.setControlPeriod(quality.articulationPeriod);
+}
+int Note::getQualityTier()
+{
+	return qualityTier_;
+}
+// the output FFT keeps its display period, made of fewer frames. The raw
+// spectrum FFT has a single frame per display, so it displays every stride periods
+void Note::setAnalysisStride(int stride)
+{
+	outFft_.setFrameStride(stride);
+	specFft_.setFrameStride(stride);
+}
+void Note::setAnalyzed(bool analyzed)
+{
+	analyzed_ = analyzed;
+}
 void Note::setEnvelope(int envelope)
 {
-	envelope_.updateEnvelope(envelope);
+	pendingEnvelope_ = envelope;
 	// Polyphony ==DOES NOT WORK==
 	// for (int i = 0; i < NUM_VOICES; i++)
 	// 	envelopes_[i].updateEnvelope(envelope);
@@ -197,6 +260,7 @@ void Note::setAdvMode(float advMode)
 	articulation_.setAdvMode(advMode_);
 	envelope_.setAdvMode(advMode_);
 	fftSpectrum_.setAdvMode(advMode_);
+	wakeSpectrumFft();
 	
 	// Polyphony ==DOES NOT WORK==
 	// for (int i = 0; i < NUM_VOICES; i++)
@@ -208,15 +272,16 @@ void Note::setAdvMode(float advMode)
 	// }
 }
 
-// Set advanced controls
+// Set advanced controls, at the next control tick
 void Note::setAdvControls(float* controlData)
 {
 	if (!advMode_)
 		return;
 	
-	brightness_.setAdvControls(controlData[kACIBrMidiLink], controlData[kACIBrQ]);
-	articulation_.setAdvControls(controlData[kACIArQ]);
-	envelope_.setAdvControls(controlData[kACIDecay], controlData[kACISustain], controlData[kACIRelease]);
+	for (int i = 0; i < kACBufferSize; i++)
+		pendingAdvControls_[i] = controlData[i];
+	advControlsPending_ = true;
+	advControlsSet_ = true;
 	
 	// Polyphony ==DOES NOT WORK==
 	// for (int i = 0; i < NUM_VOICES; i++)
@@ -227,14 +292,17 @@ void Note::setAdvControls(float* controlData)
 	// }
 }
 
-// update FM spectrum
+// update FM spectrum, at the next control tick
 void Note::updateAdvSpectrum(float* fmBuffer)
 {
-	if (!advMode_)
+	// first element is whether the spectrum changed
+	if (!advMode_ || fmBuffer[0] == 0)
 		return;
 	
-	spectrum_.updateAdvSpectrum(fmBuffer);
-	fftSpectrum_.updateAdvSpectrum(fmBuffer);
+	for (int i = 0; i < ADV_SPECTRUM_SIZE; i++)
+		pendingAdvSpectrum_[i] = fmBuffer[i];
+	advSpectrumPending_ = true;
+	advSpectrumSet_ = true;
 	
 	// Polyphony ==DOES NOT WORK==
 	// for (int i = 0; i < NUM_VOICES; i++)
@@ -242,14 +310,19 @@ void Note::updateAdvSpectrum(float* fmBuffer)
 }
 
 // Set Frequency of the note and relevant timbre dimensions
-void Note::setMidiIn(float frequency, float qFactor, int indx)
+// a bent note is not on the brightness coefficient cache's grid of notes
+void Note::setMidiIn(int noteNumber, float qFactor, int indx)
 {
+	noteNumber_ = noteNumber;
+	float frequency = kMidiToFreqTable[noteNumber];
+	if (pitchBend_ != 0)
+		frequency *= exp2f(pitchBend_ / 12);
 	if (frequency_ == frequency && qFactor_ == qFactor)
 		return;
 	frequency_ = frequency;
 	qFactor_ = qFactor;
 	spectrum_.setFrequency(frequency_);
-	brightness_.setMidiIn(frequency_, qFactor_);
+	brightness_.setMidiIn(frequency_, qFactor_, pitchBend_ == 0 ? noteNumber : -1);
 	articulation_.setFrequency(frequency_);
 	
 	// Polyphony ==DOES NOT WORK==
@@ -261,15 +334,24 @@ void Note::setMidiIn(float frequency, float qFactor, int indx)
 }
 
 // Run full signal chain of note, triggered by MIDI
+// get next audio sample
 float Note::process(Gui& gui, bool noteOn)
 {
-	// Check MIDI messages
+	float out;
+	processBlock(gui, &out, 1);
+	return out;
+}
+
+// read incoming MIDI messages and update note and brightness
+void Note::processMidi(Gui& gui)
+{
+	PROFILE_STAGE(kStageMidi);
 	while (midi_.getParser()->numAvailableMessages() > 0)
 	{
 		// retrieve MIDI message
 		MidiChannelMessage message;
 		message = midi_.getParser()->getNextChannelMessage();
-		
+	
 		// A MIDI "note on" message type might actually hold a real
 		// note onset (e.g. key press), or it might hold a note off (key release).
 		// The latter is signified by a velocity of 0.
@@ -277,11 +359,10 @@ float Note::process(Gui& gui, bool noteOn)
 			// message.prettyPrint();
 			int noteNumber = message.getDataByte(0);
 			int velocity = message.getDataByte(1);
-			float noteFrequency = midiToFreqTable_[noteNumber];
-			float qFactor = velocityToQTable_[velocity];
-			
+			float qFactor = kVelocityToQTable[velocity];
+		
 			// Velocity of 0 is really a note off
-			if (velocity == 0 && noteFrequency == frequency_)
+			if (velocity == 0 && noteNumber == noteNumber_)
 			{
 				midiNoteOn_ = false;
 				// Tell GUI to stop displaying midi information (note is off)
@@ -290,7 +371,9 @@ float Note::process(Gui& gui, bool noteOn)
 			else if (!noteOn_)
 			{
 				// last input is meant for polyphony (not used here)
-				setMidiIn(noteFrequency, qFactor, 0);
+				setMidiIn(noteNumber, qFactor, 0);
+				velocity_ = velocity / 127.0f;
+				modMatrix_.setVelocity(velocity_);
 				midiNoteOn_ = true;
 				// Send MIDI information to GUI
 				int midiBuffer[2] = {noteNumber, velocity};
@@ -301,26 +384,205 @@ float Note::process(Gui& gui, bool noteOn)
 			// We can also encounter the "note off" message type which is the same
 			// as "note on" with a velocity of 0.
 			int noteNumber = message.getDataByte(0);
-			float noteFrequency = midiToFreqTable_[noteNumber];
-			if (noteFrequency == frequency_)
+			if (noteNumber == noteNumber_)
 			{
 				midiNoteOn_ = false;
 				// Tell GUI to stop displaying midi information (note is off)
 				gui.sendBuffer(kBtGMidi, 0);
 			}
 		}
+		// modulation sources
+		else if(message.getType() == kmmControlChange) {
+			if (message.getDataByte(0) == MOD_WHEEL_CC)
+				modMatrix_.setModWheel(message.getDataByte(1) / 127.0f);
+			else if (message.getDataByte(0) == SLIDE_CC)
+				modMatrix_.setSlide(ModMatrix::slideFromController(message.getDataByte(1)));
+		}
+		else if(message.getType() == kmmChannelPressure) {
+			modMatrix_.setAftertouch(message.getDataByte(0) / 127.0f);
+		}
+		else if(message.getType() == kmmPolyphonicKeyPressure) {
+			// only the pressure of the key being played
+			if (message.getDataByte(0) == noteNumber_)
+				modMatrix_.setAftertouch(message.getDataByte(1) / 127.0f);
+		}
+		else if(message.getType() == kmmPitchBend) {
+			// 14 bits, centred on 8192
+			int bend = (message.getDataByte(1) << 7) + message.getDataByte(0) - 8192;
+			setPitchBend(PITCH_BEND_RANGE * bend / 8192.0f);
+		}
+	}
+}
+
+// render a block of audio samples
+// MIDI is read once per block and the envelope is rendered a chunk at a time
+void Note::processBlock(Gui& gui, float* output, int numFrames)
+{
+	// Check MIDI messages
+	processMidi(gui);
+	renderBlock(output, numFrames);
+}
+
+// same as a MIDI note on (or off, for velocity 0) of this note
+void Note::triggerNote(int noteNumber, int velocity)
+{
+	if (velocity > 0)
+	{
+		setMidiIn(noteNumber, kVelocityToQTable[velocity], 0);
+		velocity_ = velocity / 127.0f;
+		modMatrix_.setVelocity(velocity_);
+	}
+	midiNoteOn_ = (velocity > 0);
+}
+
+bool Note::isIdle()
+{
+	return (!midiNoteOn_ && envelope_.isIdle());
+}
+
+// envelope is rendered a chunk at a time, chunks end on control ticks
+void Note::renderBlock(float* output, int numFrames)
+{
+	// a silent note takes parameter changes at once, there is nothing to glide
+	if (!noteOn_)
+		controlCount_ = 0;
+	
+	int chunkFrames;
+	for (int start = 0; start < numFrames; start += chunkFrames)
+	{
+		if (controlCount_ <= 0)
+		{
+			controlTick();
+			controlCount_ = CONTROL_PERIOD;
+		}
+		chunkFrames = numFrames - start;
+		if (chunkFrames > NOTE_CHUNK_SIZE)
+			chunkFrames = NOTE_CHUNK_SIZE;
+		if (chunkFrames > controlCount_)
+			chunkFrames = controlCount_;
+		controlCount_ -= chunkFrames;
+		tickSamples_ += chunkFrames;
+		
+		// idle: nothing can sound until a note on, write silence and skip the chain
+		// a note on starts from a reset chain and a 0 envelope, so resuming doesn't click
+		if (!midiNoteOn_ && envelope_.isIdle() && silentSamples_ >= NOTE_IDLE_HOLD)
+		{
+			for (int n = 0; n < chunkFrames; n++)
+				output[start + n] = 0;
+			// raw spectrum FFT still follows changes to the spectrum
+			if (analyzed_)
+			{
+				PROFILE_STAGE(kStageSpectrumFft);
+				for (int n = 0; n < chunkFrames && spectrumFftHold_ > 0; n++, spectrumFftHold_--)
+					feedSpectrumFft();
+			}
+			continue;
+		}
+		
+		// use envelope to see if we are producing sound, input midiNoteOn
+		{
+			PROFILE_STAGE(kStageEnvelope);
+			envelope_.processBlock(amplitudes_, envelopeNotesOn_, chunkFrames, midiNoteOn_);
+		}
+		
+		for (int n = 0; n < chunkFrames; n++)
+			output[start + n] = processSample(amplitudes_[n], envelopeNotesOn_[n]);
+		
+		// filter tails decay towards 0 after release, keep them out of the denormal range
+		brightness_.flushDenormals();
+		articulation_.flushDenormals();
 	}
+}
+
+// Control tick: apply the parameter changes since the last tick and their
+// modulation, so filters are designed and spectra set at most once per tick.
+// While the note sounds the changes glide over the tick, a silent note jumps to them
+void Note::controlTick()
+{
+	PROFILE_STAGE(kStageControl);
+	int rampLength = noteOn_ ? CONTROL_PERIOD : 0;
+	spectrum_.setRampLength(rampLength);
+	brightness_.setRampLength(rampLength);
+	envelope_.setRampLength(rampLength);
+	
+	modMatrix_.update(midiNoteOn_, tickSamples_);
+	tickSamples_ = 0;
 	
-	// use envelope to see if we are producing sound, input midiNoteOn
-	float amplitude = envelope_.process(midiNoteOn_);
+	// pitch bend moves the note's frequency
+	if (pendingPitchBend_ != pitchBend_)
+	{
+		pitchBend_ = pendingPitchBend_;
+		if (noteNumber_ >= 0)
+			setMidiIn(noteNumber_, qFactor_, 0);
+	}
 	
-	// Alternatively, have envelope controlled by noteOn input (debug)
-	// float amplitude = envelope_.process(noteOn);
+	// timbre dimensions (each skips an unchanged value)
+	// the raw spectrum FFT shows the spectrum as set, without its modulation
+	if (pendingSpectrum_ != fftSpectrum_.getSpectrum())
+	{
+		wakeSpectrumFft();
+		fftSpectrum_.updateSpectrum(pendingSpectrum_);
+	}
+	// in advanced mode the operator targets modulate the spectrum instead
+	if (advMode_)
+		spectrum_.updateSpectrum(pendingSpectrum_);
+	else
+		spectrum_.updateSpectrum(modMatrix_.applyDimension(kModTargetSpectrum, pendingSpectrum_));
+	brightness_.updateBrightness(modMatrix_.applyDimension(kModTargetBrightness, pendingBrightness_));
+	articulation_.updateArticulation(modMatrix_.applyDimension(kModTargetArticulation, pendingArticulation_));
+	envelope_.updateEnvelope(modMatrix_.applyDimension(kModTargetEnvelope, pendingEnvelope_));
 	
+	// advanced controls, unless advanced mode was turned off since, and again
+	// whenever their modulation moves
+	bool advControlsModulated = advControlsSet_ && modMatrix_.hasChanged(kModTargetBrQ, kModTargetRelease - kModTargetBrQ + 1);
+	if (advControlsPending_ || advControlsModulated)
+	{
+		advControlsPending_ = false;
+		if (advMode_)
+		{
+			brightness_.setAdvControls(pendingAdvControls_[kACIBrMidiLink],
+				modMatrix_.apply(kModTargetBrQ, pendingAdvControls_[kACIBrQ]));
+			articulation_.setAdvControls(modMatrix_.apply(kModTargetArQ, pendingAdvControls_[kACIArQ]));
+			envelope_.setAdvControls(modMatrix_.apply(kModTargetDecay, pendingAdvControls_[kACIDecay]),
+				modMatrix_.apply(kModTargetSustain, pendingAdvControls_[kACISustain]),
+				modMatrix_.apply(kModTargetRelease, pendingAdvControls_[kACIRelease]));
+			envelope_.setCurves(int(pendingAdvControls_[kACIAttackCurve]),
+				int(pendingAdvControls_[kACIDecayCurve]), int(pendingAdvControls_[kACIReleaseCurve]));
+		}
+	}
+	bool advSpectrumModulated = advSpectrumSet_ && modMatrix_.hasChanged(kModTargetRatio1, kModTargetAmp4 - kModTargetRatio1 + 1);
+	if (advSpectrumPending_ || advSpectrumModulated)
+	{
+		bool spectrumChanged = advSpectrumPending_;
+		advSpectrumPending_ = false;
+		if (advMode_)
+		{
+			if (spectrumChanged)
+			{
+				wakeSpectrumFft();
+				fftSpectrum_.updateAdvSpectrum(pendingAdvSpectrum_);
+			}
+			// operator ratios and amplitudes with their modulation
+			float modSpectrum[ADV_SPECTRUM_SIZE];
+			for (int i = 0; i < ADV_SPECTRUM_SIZE; i++)
+				modSpectrum[i] = pendingAdvSpectrum_[i];
+			for (int i = 0; i < NUM_OPERATORS; i++)
+			{
+				modSpectrum[2+3*i] = modMatrix_.apply(kModTargetRatio1 + i, pendingAdvSpectrum_[2+3*i]);
+				modSpectrum[3+3*i] = modMatrix_.apply(kModTargetAmp1 + i, pendingAdvSpectrum_[3+3*i]);
+			}
+			spectrum_.updateAdvSpectrum(modSpectrum);
+		}
+	}
+}
+
+// apply timbre to one sample, given the envelope amplitude and state at that sample
+float Note::processSample(float amplitude, bool envelopeNoteOn)
+{
 	float out = 0;
 	
 	// if note just turned on (was previously off)
-	if (!noteOn_ && envelope_.isNoteOn())
+	if (!noteOn_ && envelopeNoteOn)
 	{
 		//reset as necessary
 		brightness_.reset();
@@ -328,7 +590,13 @@ float Note::process(Gui& gui, bool noteOn)
 	}
 	
 	// even if input midiNoteOn_ is off, the envelope may still be playing
-	noteOn_ = envelope_.isNoteOn();
+	noteOn_ = envelopeNoteOn;
+	
+	// count silent samples towards idle mode
+	if (noteOn_)
+		silentSamples_ = 0;
+	else if (silentSamples_ < NOTE_IDLE_HOLD)
+		silentSamples_++;
 
 	// obtain waveform value
 	if (noteOn_)
@@ -337,44 +605,53 @@ float Note::process(Gui& gui, bool noteOn)
 		// out = squareWaveDev();
 		
 		// Get basic FM-generated waveform
-		out = spectrum_.process();
+		{
+			PROFILE_STAGE(kStageSpectrum);
+			out = spectrum_.process();
+		}
 		
 		// apply brightness filter
-		out = brightness_.process(out);
+		{
+			PROFILE_STAGE(kStageBrightness);
+			out = brightness_.process(out);
+		}
 		
 		// apply articulation filter
-		out = articulation_.process(out);
+		{
+			PROFILE_STAGE(kStageArticulation);
+			out = articulation_.process(out);
+		}
 		
 		// apply volume envelope
 		out = out * amplitude;
 	}
 	
-	// add output to fft buffer
-	outFftInputBuffer_[outFftWritePtr_] = out;
-	// if write pointer has reached end of buffer, reset to start.
-	if (++outFftWritePtr_ >= FFT_BUFFER_N)
-		outFftWritePtr_ = 0;
-	// if a full hop has been passed, reset counter and indicate an fft is ready
-	if (++outFftSampleCounter_ >= FFT_HOP_SIZE)
-	{
-		outFftSampleCounter_ = 0;
-		outFftReady_ = true;
-	}
-	
-	// run fftSpectrum's process and add its output to fft buffer
-	specFftInputBuffer_[specFftWritePtr_] = fftSpectrum_.process();
-	// if write pointer has reached end of buffer, reset to start.
-	if (++specFftWritePtr_ >= FFT_BUFFER_N)
-		specFftWritePtr_ = 0;
-	// if a full hop has been passed, reset counter and indicate an fft is ready
-	if (++specFftSampleCounter_ >= FFT_HOP_SIZE)
+	if (analyzed_)
 	{
-		specFftSampleCounter_ = 0;
-		specFftReady_ = true;
+		{
+			PROFILE_STAGE(kStageFftRing);
+			outFft_.push(out);
+		}
+		{
+			PROFILE_STAGE(kStageSpectrumFft);
+			feedSpectrumFft();
+		}
 	}
 	return out;
 }
 
+// run the fixed frequency spectrum and add it to the raw spectrum FFT
+void Note::feedSpectrumFft()
+{
+	specFft_.push(fftSpectrum_.process());
+}
+
+// run the raw spectrum FFT for two display periods, enough to show a change while idle
+void Note::wakeSpectrumFft()
+{
+	spectrumFftHold_ = 2 * FFT_DISPLAY_PERIOD;
+}
+
 // Polyphony ==DOES NOT WORK==
 // // Run full signal chain of note, triggered by MIDI
 // float Note::process(Gui& gui, bool noteOn)
@@ -393,8 +670,8 @@ float Note::process(Gui& gui, bool noteOn)
 // 			message.prettyPrint();
 // 			int noteNumber = message.getDataByte(0);
 // 			int velocity = message.getDataByte(1);
-// 			float noteFrequency = midiToFreqTable_[noteNumber];
-// 			float qFactor = velocityToQTable_[velocity];
+// 			float noteFrequency = kMidiToFreqTable[noteNumber];
+// 			float qFactor = kVelocityToQTable[velocity];
 			
 // 			for (int i = 0; i < NUM_VOICES; i++)
 // 			{
@@ -427,7 +704,7 @@ float Note::process(Gui& gui, bool noteOn)
 // 			// We can also encounter the "note off" message type which is the same
 // 			// as "note on" with a velocity of 0.
 // 			int noteNumber = message.getDataByte(0);
-// 			float noteFrequency = midiToFreqTable_[noteNumber];
+// 			float noteFrequency = kMidiToFreqTable[noteNumber];
 // 			for (int i = 0; i < NUM_VOICES; i++)
 // 				if (noteFrequency == frequencies_[i])
 // 				{
@@ -502,110 +779,76 @@ float Note::process(Gui& gui, bool noteOn)
 // check if either the raw or final fft are ready to calculate
 bool Note::checkFftReady()
 {
-	return (outFftReady_ && specFftReady_);
+	return (outFft_.isReady() || specFft_.isReady());
+}
+
+bool Note::checkBakeRequested()
+{
+	return spectrum_.isBakeRequested();
+}
+
+// bake the spectrum's single cycle table
+void Note::bakeSpectrum()
+{
+	spectrum_.bake();
 }
 
 // calculate fft's as necessary and send them to the GUI
-void Note::outputFft(Gui& gui)
+bool Note::outputFft(Gui& gui)
 {
-	// Final Spectrum FFT
-	if (outFftReady_)
+	// Final Spectrum FFT, features are measured on every frame
+	bool analyzed = outFft_.isReady();
+	if (analyzed)
 	{
-		// reset ready flag
-		outFftReady_ = false;
-		// move write pointer to start of the circular buffer
-		outFftNeWritePtr_ = (outFftWritePtr_ + 1) % FFT_BUFFER_N;
-		
-		// Copy data from circular buffer to NE10 buffer
-		for(int n = 0; n < FFT_BUFFER_N; n++)
-		{
-			// data is fully real, no imaginary component
-			outFftNeInput_[n].r = (ne10_float32_t) outFftInputBuffer_[outFftNeWritePtr_] * fftWindowBuffer_[n];
-			outFftNeInput_[n].i = 0;
-	
-			// increment pointer index, moving to start as necessary
-			outFftNeWritePtr_++;
-			if(outFftNeWritePtr_ >= FFT_BUFFER_N)
-				outFftNeWritePtr_ = 0;
-		}
-		
-		// Run FFT
-		ne10_fft_c2c_1d_float32_neon (outFftNeOutput_, outFftNeInput_, outFftcfg_, 0);
-		
-		// normalizing factor for fft
-		float normFactor = 4.0 / float(FFT_BUFFER_N);
-		
-		// Copy FFT amplitude to buffer to send to GUI
-		for(int n = 0; n < FFT_OUT_N; n++)
+		bool display = outFft_.process();
+		features_.process(outFft_.getFramePower(), frequency_, outFft_.getFrameHop());
+		if (display)
 		{
-			//calculate amplitude of FFT
-			outFftOutputBuffer_[n] = sqrtf(outFftNeOutput_[n].r * outFftNeOutput_[n].r + outFftNeOutput_[n].i * outFftNeOutput_[n].i);
-			// normalize
-			outFftOutputBuffer_[n] = outFftOutputBuffer_[n] * normFactor;
-			// then convert to decibels
-			if (outFftOutputBuffer_[n] > 0.001)
-				outFftOutputBuffer_[n] = 20 * log10(outFftOutputBuffer_[n]);
-			// set minimum decibel value (avoid log(0))
-			else
-				outFftOutputBuffer_[n] = -60;
-			//convert to range [-60, 20] to [0, 1] (0.0125 is dividing by 80)
-			outFftOutputBuffer_[n] = (outFftOutputBuffer_[n] + 60) * 0.0125;
+			sendFft(gui, outFft_, outFftOutputBuffer_, kBtGOutFft);
+			gui.sendBuffer(kBtGFeatures, features_.getFeatures(), kNumFeatures);
 		}
-		// send to gui
-		gui.sendBuffer(kBtGOutFft, outFftOutputBuffer_);
 	}
 	// Raw Spectrum FFT
-	if (specFftReady_)
-	{
-		// reset ready flag
-		specFftReady_ = false;
-		// move write pointer to start of the circular buffer
-		specFftNeWritePtr_ = (specFftWritePtr_ + 1) % FFT_BUFFER_N;
-		// Copy data from circular buffer to NE10 buffer
-		for(int n = 0; n < FFT_BUFFER_N; n++)
-		{
-			// data is fully real, no imaginary component
-			specFftNeInput_[n].r = (ne10_float32_t) specFftInputBuffer_[specFftNeWritePtr_] * fftWindowBuffer_[n];
-			specFftNeInput_[n].i = 0;
-	
-			// increment pointer index, moving to start as necessary
-			specFftNeWritePtr_++;
-			if(specFftNeWritePtr_ >= FFT_BUFFER_N)
-				specFftNeWritePtr_ = 0;
-		}
-		
-		// Run FFT
-		ne10_fft_c2c_1d_float32_neon (specFftNeOutput_, specFftNeInput_, specFftcfg_, 0);
+	if (specFft_.process())
+		sendFft(gui, specFft_, specFftOutputBuffer_, kBtGSpecFft);
+	return analyzed;
+}
 
-		// normalizing factor for fft
-		float normFactor = 4.0 / float(FFT_BUFFER_N);
-		// Copy FFT amplitude to buffer to send to GUI
-		for(int n = 0; n < FFT_OUT_N; n++)
-		{
-			//calculate amplitude of FFT
-			specFftOutputBuffer_[n] = sqrtf(specFftNeOutput_[n].r * specFftNeOutput_[n].r + specFftNeOutput_[n].i * specFftNeOutput_[n].i);
-			// normalize
-			specFftOutputBuffer_[n] = specFftOutputBuffer_[n] * normFactor;
-			//then convert to decibels
-			if (specFftOutputBuffer_[n] > 0.001)
-				specFftOutputBuffer_[n] = 20 * log10(specFftOutputBuffer_[n]);
-			// set minimum decibel value (avoid log(0))
-			else
-				specFftOutputBuffer_[n] = -60;
-			//convert to range [-60, 20] to [0, 1] (0.0125 is dividing by 80)
-			specFftOutputBuffer_[n] = (specFftOutputBuffer_[n] + 60) * 0.0125;
-			
-		}
-		// send to gui
-		gui.sendBuffer(kBtGSpecFft, specFftOutputBuffer_);
-	}
+const float* Note::getFeatures()
+{
+	return features_.getFeatures();
+}
+
+void Note::sendFft(Gui& gui, FftAnalyzer& analyzer, std::vector<float>& output, int bufferIndex)
+{
+	// normalizing factor for fft
+	float normFactor = 4.0 / float(FFT_BUFFER_N);
+	// Pool FFT bins into bands, convert to display range [0, 1] and copy to buffer to send to GUI
+	fftBands_.processPower(analyzer.getDisplayPower(), fftBandPower_.data());
+	powerToDisplay(fftBandPower_.data(), output.data(), FFT_NUM_BANDS, normFactor);
+	// send to gui
+	gui.sendBuffer(bufferIndex, output);
+}
+
+// collect changes to brightness and articulation since the last call
+// graphs stay dirty until the graph task has recalculated them
+bool Note::checkGraphsDirty()
+{
+	if (brightness_.checkGraphChanged())
+		brGraphDirty_ = true;
+	if (articulation_.checkGraphChanged())
+		arGraphDirty_ = true;
+	return (brGraphDirty_ || arGraphDirty_);
 }
 
-// calculate brightness and articulation graphs and send to the GUI
-void Note::updateGraphs(Gui& gui)
+// calculate changed brightness and articulation graphs and send to the GUI
+void Note::updateGraphs(Gui& gui, bool force)
 {
-	brightness_.updateFrfGraph(gui, kBtGBrightFrf);
-	articulation_.updateFcGraph(gui, kBtGArticulation);
+	// clear flags before calculating, so changes made meanwhile aren't lost
+	if (brGraphDirty_.exchange(false) || force)
+		brightness_.updateFrfGraph(gui, kBtGBrightFrf);
+	if (arGraphDirty_.exchange(false) || force)
+		articulation_.updateFcGraph(gui, kBtGArticulation);
 }
 
 // Send GUI information
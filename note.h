@@ -7,18 +7,52 @@
 #include <libraries/ne10/NE10.h>
 #include <libraries/Fft/Fft.h>
 #include <cmath>
+#include <atomic>
 #include "spectrum.h"
 #include "brightness.h"
 #include "articulation.h"
 #include "envelope.h"
+#include "midiTables.h"
+#include "stageProfiler.h"
+#include "bandBinner.h"
+#include "fftAnalyzer.h"
+#include "featureExtractor.h"
+#include "quality.h"
+#include "modMatrix.h"
 
-#define NUM_MIDI_NOTES 128
-#define FFT_BUFFER_N 1024
-#define FFT_OUT_N FFT_BUFFER_N * 0.5
-#define FFT_HOP_SIZE 4096
+// the final spectrum FFT analyzes every hop and combines frames by mode, the GUI
+// gets both FFTs once per display period (the raw spectrum FFT is a snapshot)
+//------------ CHANGE FFT ANALYZER HERE -----------------
+#define FFT_HOP_SIZE 512 // 50% overlap
+#define FFT_DISPLAY_PERIOD 4096
+#define FFT_OUT_MODE kFftModeWelch // kFftModeSnapshot, kFftModeWelch, kFftModePeakHold or kFftModeSmooth
+//------------ CHANGE FFT ANALYZER HERE -----------------
+// FFT bins are pooled into bands before being sent to the GUI
+//------------ CHANGE FFT DISPLAY BANDS HERE -----------------
+#define FFT_NUM_BANDS 96
+#define FFT_BAND_SCALE kBandScaleLog // kBandScaleLinear, kBandScaleLog, kBandScaleErb or kBandScaleMel
+#define FFT_BAND_POOLING kBandPoolMax // kBandPoolMax or kBandPoolPowerMean
+#define FFT_BAND_MIN_FREQ 20 // lowest band edge in Hz (not used by the linear scale)
+//------------ CHANGE FFT DISPLAY BANDS HERE -----------------
+
+// parameter changes are applied once every control period (a control tick)
+// and glide to their new values over the period
+//------------ CHANGE CONTROL RATE HERE -----------------
+#define CONTROL_PERIOD 32 // samples between control ticks
+//------------ CHANGE CONTROL RATE HERE -----------------
+
+// pitch bend range of the note's channel (semitones, MPE voices: see mpeVoices.h)
+//------------ CHANGE PITCH BEND HERE -----------------
+#define PITCH_BEND_RANGE 2
+//------------ CHANGE PITCH BEND HERE -----------------
 
 // number of simultaneous notes (polyphony)
 #define NUM_VOICES 1
+// number of samples the envelope is rendered for at a time
+#define NOTE_CHUNK_SIZE 64
+// silent samples before a note goes idle: long enough for a display period after
+// a full buffer of silence, so the last FFT sent to the GUI is silent too
+#define NOTE_IDLE_HOLD (FFT_DISPLAY_PERIOD + FFT_BUFFER_N)
 
 // enumerator to index bela to GUI buffers
 enum belaToGuiBuffers {
@@ -32,7 +66,9 @@ enum belaToGuiBuffers {
 	kBtGFMAlg,
 	kBtGFMRatios,
 	kBtGFMAmps,
-	kBtGFMShapes
+	kBtGFMShapes,
+	kBtGFeatures,
+	kBtGGovernor
 };
 
 // enumerator to index GUI to BELA buffers
@@ -42,6 +78,15 @@ enum guiToBelaBuffers {
 	kGtBAdvSpectrum
 };
 
+// enumerator for the timbre dimensions, in the order of the GUI's timbre buffer
+enum timbreDimensions {
+	kTimbreSpectrum = 0,
+	kTimbreBrightness,
+	kTimbreArticulation,
+	kTimbreEnvelope,
+	kNumTimbreDimensions
+};
+
 // enumerator to index the contents of the advControls buffer
 enum advControlIndicex {
 	kACIAdvMode = 0,
@@ -51,6 +96,9 @@ enum advControlIndicex {
 	kACIDecay,
 	kACISustain,
 	kACIRelease,
+	kACIAttackCurve, // kADSRCurve...
+	kACIDecayCurve,
+	kACIReleaseCurve,
 	kACBufferSize
 };
 
@@ -64,9 +112,6 @@ public:
 	// Constructor specifying sample rate
 	Note(float sampleRate, float frequency);
 	
-	// Destructor
-	~Note();
-	
 	// Set sample rate
 	void setSampleRate(float frequency);
 	
@@ -79,35 +124,76 @@ public:
 	int articulation();
 	int envelope();
 	
-	// Set timbre parameters
+	// Set timbre parameters, applied at the next control tick
 	void setSpectrum(int spectrum);
 	void setBrightness(int brightness);
 	void setArticulation(int articulation);
 	void setEnvelope(int envelope);
+	// set one of the timbre dimensions by its index (timbreDimensions)
+	void setTimbre(int dimension, int value);
 	
 	// Toggle enable for advanced controls
 	void setAdvMode(float advMode);
 	
-	// Set advanced controls
+	// Set advanced controls, applied at the next control tick
 	void setAdvControls(float* controlData);
 	
-	// update FM spectrum
+	// update FM spectrum, applied at the next control tick
 	void updateAdvSpectrum(float* fmBuffer);
 	
-	// Set frequency of note and brightness q factor
-	void setMidiIn(float frequency, float qFactor, int indx);
+	// route a modulation source to a target (see modMatrix.h)
+	void setModSlot(int slot, int source, int via, int target, float amount);
+	// mod wheel, aftertouch (0 to 1) and slide (-1 to 1) without MIDI
+	void setModWheel(float modWheel);
+	void setAftertouch(float aftertouch);
+	void setSlide(float slide);
+	// pitch bend in semitones, applied at the next control tick and gliding over it
+	void setPitchBend(float semitones);
+	
+	// Set quality tier (see quality.h), a sounding note crossfades to it
+	void setQualityTier(int tier);
+	int getQualityTier();
+	// analyze one FFT frame every stride hops (1 for every hop)
+	void setAnalysisStride(int stride);
+	// whether the note feeds its FFTs (on by default), voices nobody analyzes
+	// skip the output ring and the raw spectrum they would otherwise render
+	void setAnalyzed(bool analyzed);
+	
+	// Set MIDI note (frequency) of note and brightness q factor
+	void setMidiIn(int noteNumber, float qFactor, int indx);
 
 	// get next audio sample
 	float process(Gui& gui, bool noteOn);
 	
+	// fill output with the next numFrames audio samples
+	void processBlock(Gui& gui, float* output, int numFrames);
+	
+	// play a note without MIDI (velocity 0 releases it)
+	void triggerNote(int noteNumber, int velocity);
+	// fill output with the next numFrames audio samples, without reading MIDI
+	void renderBlock(float* output, int numFrames);
+	// whether the note is released and its envelope has finished
+	bool isIdle();
+	
 	// run fft on output
 	// check if a buffer is full and an fft is ready to be run
-	// check this every frame. If it returns true, schedule the auxiliary task
+	// check this every block. If it returns true, schedule the auxiliary task
 	bool checkFftReady();
 	// Copy data from buffer and use NE10 to process
-	void outputFft(Gui& gui);
-	// Check and update Brightness and Articulation Graphs
-	void updateGraphs(Gui& gui);
+	// returns true if the output was analyzed and its features updated
+	bool outputFft(Gui& gui);
+	// timbre features of the last analyzed output frame (kNumFeatures)
+	const float* getFeatures();
+	// check if the spectrum is waiting for a baked cycle (see cycleBaker.h)
+	// check this every block. If it returns true, schedule the bake task
+	bool checkBakeRequested();
+	// bake the spectrum's single cycle table
+	void bakeSpectrum();
+	// check if Brightness or Articulation parameters changed since the last call
+	// check this every block. If it returns true, schedule the graph task
+	bool checkGraphsDirty();
+	// update changed Brightness and Articulation Graphs (all of them if force is true)
+	void updateGraphs(Gui& gui, bool force);
 	// Send GUI information
 	void sendToGui(Gui& gui);
 	
@@ -116,18 +202,59 @@ public:
 	void printTimbreParameters(); // print debug statements
 	
 private:
+	// read incoming MIDI messages
+	void processMidi(Gui& gui);
+	// apply the parameter changes since the last control tick
+	void controlTick();
+	// get next audio sample from envelope amplitude and state
+	float processSample(float amplitude, bool envelopeNoteOn);
+	// add a sample of the fixed frequency spectrum to the raw spectrum FFT
+	void feedSpectrumFft();
+	// pool an analyzer's display spectrum into bands and send it to the GUI
+	void sendFft(Gui& gui, FftAnalyzer& analyzer, std::vector<float>& output, int bufferIndex);
+	// keep the raw spectrum FFT running while idle, after the spectrum changed
+	void wakeSpectrumFft();
+	
 	float sampleRate_; // sample rate
-	float frequency_; // note frequency
+	float frequency_; // note frequency, including the pitch bend
+	int noteNumber_; // MIDI note being played (-1 before the first)
+	float pitchBend_; // semitones
+	float pendingPitchBend_; // pitch bend waiting for the next control tick
 	float qFactor_; // brightness q factor
-	float velocity_; // note's midi velocity (affects brightness resonance)
+	float velocity_; // note's midi velocity (0 to 1, affects brightness resonance)
 	bool noteOn_; // whether note is on
 	
+	// idle mode: envelope off and output silent, chain and FFT feeds skipped
+	int silentSamples_; // consecutive samples with the envelope off (up to NOTE_IDLE_HOLD)
+	int spectrumFftHold_; // samples the raw spectrum FFT still runs for while idle
+	bool analyzed_; // whether the FFTs are fed
+	
+	// control rate: samples until the next control tick and since the last one,
+	// and the parameter changes waiting for it (advanced controls and spectrum
+	// as sent by the GUI, kept as the base of their modulation)
+	int controlCount_;
+	int tickSamples_;
+	int pendingSpectrum_, pendingBrightness_, pendingArticulation_, pendingEnvelope_;
+	float pendingAdvControls_[kACBufferSize];
+	bool advControlsPending_;
+	bool advControlsSet_; // whether the GUI has sent advanced controls
+	float pendingAdvSpectrum_[ADV_SPECTRUM_SIZE];
+	bool advSpectrumPending_;
+	bool advSpectrumSet_; // whether the GUI has sent an advanced spectrum
+	
+	// envelope amplitudes and on/off state for the chunk being rendered
+	float amplitudes_[NOTE_CHUNK_SIZE];
+	bool envelopeNotesOn_[NOTE_CHUNK_SIZE];
+	
 	// Timbre Dimensions
 	Spectrum spectrum_;
 	Brightness brightness_;
 	Articulation articulation_;
 	Envelope envelope_;
 	
+	// modulation of the timbre dimensions and advanced controls
+	ModMatrix modMatrix_;
+	
 	// polyphony ==DOES NOT WORK==
 	// std::vector<float> frequencies_; // note frequency
 	// std::vector<float> qFactors_; // brightness q factor
@@ -142,6 +269,8 @@ private:
 	// boolean for toggling advanced mode
 	bool advMode_;
 	
+	int qualityTier_; // current quality tier
+	
 	// Object for handling MIDI messages
 	Midi midi_;
 	// MIDI port
@@ -149,36 +278,24 @@ private:
 	const char* midiPort0_ = "hw:1,0,0";
 	//------------ CHANGE MIDI PORT HERE -----------------
 	bool midiNoteOn_; // whether a MIDI key is depressed
-	
 
-	// table to convert MIDI numbers to frequencies and Q-values
-	float midiToFreqTable_[NUM_MIDI_NOTES] = {0};
-	float velocityToQTable_[NUM_MIDI_NOTES] = {0};
 	
 	// FFT variables for final spectrum FFT
-	ne10_fft_cpx_float32_t* outFftNeInput_ = nullptr; // input buffer for FFT
-    ne10_fft_cpx_float32_t* outFftNeOutput_ = nullptr; // output buffer for FFT
-    ne10_fft_cfg_float32_t outFftcfg_; // size for the FFT
-    std::vector<float> outFftInputBuffer_; // circular buffer of sample values
-	std::vector<float> outFftOutputBuffer_; // buffer of output magnitudes
-	std::vector<float> fftWindowBuffer_; // windowing function for both raw and final fft
-	int outFftWritePtr_; // write pointer for circular buffer
-	int outFftNeWritePtr_; // technically a read pointer to read from circular buffer to ne10 input buffer
-	int outFftSampleCounter_; // count samples for hop size
-	bool outFftReady_; // boolean of whether FFT is ready to be calculated
+	FftAnalyzer outFft_; // analyzer of the note's output
+	std::vector<float> outFftOutputBuffer_; // buffer of output band magnitudes
+	FeatureExtractor features_; // timbre features of the note's output
+	BandBinner fftBands_; // pools FFT bins into display bands for both raw and final fft
+	std::vector<float> fftBandPower_; // band powers of the fft being sent
 	
 	// FFT variables for raw spectrum FFT
 	Spectrum fftSpectrum_; // special Spectrum object for calculating samples for the FFT
 	float fftSpectrumFreq_; // fixed frequency for FFT Spectrum object
-	ne10_fft_cpx_float32_t* specFftNeInput_ = nullptr; // input buffer for FFT
-    ne10_fft_cpx_float32_t* specFftNeOutput_ = nullptr; // output buffer for FFT
-    ne10_fft_cfg_float32_t specFftcfg_; // size for the FFT
-    std::vector<float> specFftInputBuffer_; // circular buffer of sample values
-	std::vector<float> specFftOutputBuffer_; // buffer of output magnitudes
-	int specFftWritePtr_; // write pointer for circular buffer
-	int specFftNeWritePtr_; // technically a read pointer to read from circular buffer to ne10 input buffer
-	int specFftSampleCounter_; // count samples for hop size
-	bool specFftReady_; // boolean of whether FFT is ready to be calculated
+	FftAnalyzer specFft_; // analyzer of fftSpectrum_
+	std::vector<float> specFftOutputBuffer_; // buffer of output band magnitudes
+	
+	// graphs waiting to be recalculated by the graph task
+	std::atomic<bool> brGraphDirty_; // brightness FRF graph
+	std::atomic<bool> arGraphDirty_; // articulation Fc graph
 	
 	//dev tools
 	int frameCount_; // frame counter for square wave
@@ -9,29 +9,49 @@
 #include "operator.h"
 
 // Default constructor: set default values
-Operator::Operator() : table_(dummyTable)
+Operator::Operator()
 {
 	sampleRate_ = 44100.0;
+	tables_ = nullptr;
+	wave_ = nullptr;
+	interpolation_ = kInterpLinear;
+	bandLimited_ = false;
+	fadeWave_ = nullptr;
+	fadeRemaining_ = 0;
 	tableLength_ = 0;
 	currentTable_ = 0;
 	// table_ = 0;
 	lengthXinvSampleRate_ = 0;
 	phaseIncr_ = 0;
+	targetAmplitude_ = 0;
+	amplitudeStep_ = modAmplitudeStep_ = phaseIncrStep_ = 0;
 	invTwoPi_ = 1.0 / 2.0 / M_PI;
 }
 
 // Constructor taking arguments
 // Can also use initialisation lists instead of setting 
 // variables inside the function
-Operator::Operator(float sampleRate, const std::vector<std::vector<float>>& tableData) : table_(tableData)
+// starts on the default naive tables with linear interpolation
+Operator::Operator(float sampleRate)
 {
 	sampleRate_ = sampleRate;
+	tables_ = &WavetableSet::get(WAVETABLE_SIZE);
+	interpolation_ = kInterpLinear;
+	bandLimited_ = false;
+	fadeWave_ = nullptr;
+	fadeRemaining_ = 0;
 	currentTable_ = 0;
+	tableLength_ = float(tables_->size());
+	lengthXinvSampleRate_ = tableLength_ / sampleRate_;
+	frequency_ = 0;
 	phaseIncr_ = 0;
 	phase_ = 0;
 	lastOutput_ = 0;
 	amplitude_ = 1;
+	targetAmplitude_ = 1;
+	amplitudeStep_ = modAmplitudeStep_ = phaseIncrStep_ = 0;
 	invTwoPi_ = 1.0 / 2.0 / M_PI;
+	updateWave();
 }
 
 
@@ -40,8 +60,9 @@ void Operator::setup(int tableIndex, float frequency)
 {
 	currentTable_ = tableIndex;
 	frequency_ = frequency;
-	tableLength_ = float(table_[currentTable_].size());
+	tableLength_ = tables_ ? float(tables_->size()) : 0;
 	lengthXinvSampleRate_ = tableLength_ / sampleRate_;
+	updateWave();
 }
 
 // Set the samplerate of operator
@@ -49,6 +70,7 @@ void Operator::setSampleRate(float f)
 {
 	sampleRate_ = f;
 	lengthXinvSampleRate_ = tableLength_ / sampleRate_;
+	updateWave();
 }
 
 // reset state of operator
@@ -58,9 +80,32 @@ void Operator::reset()
 	lastOutput_ = 0;
 }
 
+// get state of operator, the phase in cycles (0 to 1) so that it does not
+// depend on the table length
+void Operator::getState(float& phase, float& lastOutput)
+{
+	phase = tableLength_ > 0 ? phase_ / tableLength_ : 0;
+	lastOutput = lastOutput_;
+}
+
+// continue from a state
+void Operator::setState(float phase, float lastOutput)
+{
+	phase_ = phase * tableLength_;
+	if (phase_ >= tableLength_)
+		phase_ = 0;
+	lastOutput_ = lastOutput;
+}
+
+void Operator::setWavetable(const float* wavetable)
+{
+	wave_ = wavetable;
+}
+
 // Setters
 void Operator::setAmplitude(float amplitude) {
 	amplitude_ = amplitude;
+	targetAmplitude_ = amplitude;
 	// Amplitude to use when operator is a modulator
 	// amplitude * frequency * tableLength  / sampleRate
 	modAmplitude_ = amplitude_ * tableLength_ * invTwoPi_;
@@ -73,17 +118,16 @@ void Operator::setFrequency(float frequency) {
 	// phaseIncr = tableLength * frequency / sampleRate
 	phaseIncr_ = frequency_ * lengthXinvSampleRate_;
 	modAmplitude_ = amplitude_ * tableLength_ * invTwoPi_;
+	if (bandLimited_)
+		updateWave();
 }
 
 // Set waveshape using enumerator
+// every shape has the same table length, so a glide carries on
 void Operator::setTable(int waveShapeEnum)
 {
 	currentTable_ = waveShapeEnum;
-	//retrieve new wavetable size and re-calculate relevant quantities
-	tableLength_ = float(table_[currentTable_].size());
-	lengthXinvSampleRate_ = tableLength_ / sampleRate_;
-	phaseIncr_ = frequency_ * lengthXinvSampleRate_;
-	modAmplitude_ = amplitude_ * tableLength_ * invTwoPi_;
+	updateWave();
 }
 
 // Set amplitude, frequency and waveshape all at once
@@ -93,13 +137,100 @@ void Operator::setParameters(float amplitude, float frequency, int table)
 {
 	currentTable_ = table;
 	amplitude_ = amplitude;
+	targetAmplitude_ = amplitude;
 	frequency_ = frequency;
 	
-	tableLength_ = float(table_[currentTable_].size());
+	tableLength_ = tables_ ? float(tables_->size()) : 0;
 	lengthXinvSampleRate_ = tableLength_ / sampleRate_;
 	phaseIncr_ = frequency_ * lengthXinvSampleRate_;
 	// modAmplitude_ = amplitude_ * lengthXinvSampleRate_ * invTwoPi_;
 	modAmplitude_ = amplitude_ * tableLength_ * invTwoPi_;
+	updateWave();
+}
+
+// Glide to an amplitude and frequency over a number of samples
+void Operator::rampTo(float amplitude, float frequency, int samples)
+{
+	// frequency now, part of the way through any previous glide
+	float currentFrequency = lengthXinvSampleRate_ > 0 ? phaseIncr_ / lengthXinvSampleRate_ : frequency_;
+	targetAmplitude_ = amplitude;
+	frequency_ = frequency;
+	
+	float invSamples = 1.0f / samples;
+	amplitudeStep_ = (targetAmplitude_ - amplitude_) * invSamples;
+	modAmplitudeStep_ = amplitudeStep_ * tableLength_ * invTwoPi_;
+	phaseIncrStep_ = (frequency_ * lengthXinvSampleRate_ - phaseIncr_) * invSamples;
+	
+	// band-limited tables for the highest frequency of the glide, so it never aliases
+	if (bandLimited_ && tables_)
+		wave_ = tables_->bandLimited(currentTable_, fmaxf(fabsf(currentFrequency), fabsf(frequency_)) / sampleRate_);
+}
+
+// one sample further along the glide
+void Operator::stepRamp()
+{
+	amplitude_ += amplitudeStep_;
+	modAmplitude_ += modAmplitudeStep_;
+	phaseIncr_ += phaseIncrStep_;
+}
+
+// end of the glide, exactly on the targets
+void Operator::finishRamp()
+{
+	amplitude_ = targetAmplitude_;
+	modAmplitude_ = amplitude_ * tableLength_ * invTwoPi_;
+	phaseIncr_ = frequency_ * lengthXinvSampleRate_;
+	if (bandLimited_)
+		updateWave();
+}
+
+// Set interpolation, table size and band-limiting
+void Operator::setQuality(int interpolation, int tableSize, bool bandLimited, bool fade)
+{
+	if (!tables_)
+		return;
+	const WavetableSet* tables = &WavetableSet::get(tableSize);
+	if (tables == tables_ && interpolation == interpolation_ && bandLimited == bandLimited_)
+		return;
+	
+	const float* oldWave = wave_;
+	float oldLength = tableLength_;
+	int oldInterpolation = interpolation_;
+	
+	tables_ = tables;
+	interpolation_ = interpolation;
+	bandLimited_ = bandLimited;
+	// keep the phase at the same point of the cycle in the new table
+	tableLength_ = float(tables_->size());
+	phase_ *= tableLength_ / oldLength;
+	if (phase_ >= tableLength_)
+		phase_ -= tableLength_;
+	lengthXinvSampleRate_ = tableLength_ / sampleRate_;
+	phaseIncr_ = frequency_ * lengthXinvSampleRate_;
+	modAmplitude_ = amplitude_ * tableLength_ * invTwoPi_;
+	updateWave();
+	
+	// read the old table at the same point of the cycle while fading it out
+	fadeRemaining_ = 0;
+	if (fade)
+	{
+		fadeWave_ = oldWave;
+		fadeLength_ = oldLength;
+		fadeScale_ = oldLength / tableLength_;
+		fadeInterpolation_ = oldInterpolation;
+		fadeRemaining_ = OPERATOR_QUALITY_FADE;
+	}
+}
+
+// band-limited tables depend on the frequency, naive ones only on the shape
+void Operator::updateWave()
+{
+	if (!tables_)
+		return;
+	if (bandLimited_)
+		wave_ = tables_->bandLimited(currentTable_, frequency_ / sampleRate_);
+	else
+		wave_ = tables_->naive(currentTable_);
 }
 
 // Getters
@@ -123,7 +254,7 @@ float Operator::phaseIncr()
 float Operator::debugValue()
 {
 	// return currentTable_;
-	return table_[1][256];
+	return tables_->naive(1)[256];
 }
 
 // calculate modulation phase (amount to add to modulatee's phase) 
@@ -158,15 +289,24 @@ float Operator::process(float modulation) {
 		phase_ -= tableLength_;
 	while(phase_ < 0)
 		phase_ += tableLength_;
+	// a tiny negative phase rounds up to the length itself
+	if (phase_ >= tableLength_)
+		phase_ = 0;
+	
+	// interpolation (tables are padded, no need to wrap the index)
+	float value = readWavetable(wave_, phase_, interpolation_);
 	
-	// interpolation
-	int indexBelow = floorf(phase_);
-	int indexAbove = indexBelow + 1;
-	if (indexAbove >= tableLength_) indexAbove = 0;
-	float fractionAbove = phase_ - indexBelow;
-	float fractionBelow = 1.0 - fractionAbove;
-	return  (fractionBelow * table_[currentTable_][indexBelow] +
-				fractionAbove * table_[currentTable_][indexAbove]);
+	// after a quality change, crossfade from the old table
+	if (fadeRemaining_ > 0)
+	{
+		float fadePhase = phase_ * fadeScale_;
+		if (fadePhase >= fadeLength_)
+			fadePhase -= fadeLength_;
+		float fadeValue = readWavetable(fadeWave_, fadePhase, fadeInterpolation_);
+		value += (fadeValue - value) * fadeRemaining_ * (1.0f / OPERATOR_QUALITY_FADE);
+		fadeRemaining_--;
+	}
+	return value;
 }	
 	
 // Destructor
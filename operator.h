@@ -7,16 +7,17 @@
 
 #include <array>
 #include <vector>
+#include "wavetables.h"
 
+// default table size (and interpolation, linear from naive tables)
 #define WAVETABLE_SIZE 512
-
-// Dummy table for default constructor
-static const std::vector<std::vector<float>> dummyTable;
+// samples the previous table is faded out over when the quality changes
+#define OPERATOR_QUALITY_FADE 256
 
 class Operator {
 public:
 	Operator();	// Default constructor
-	Operator(float sampleRate, const std::vector<std::vector<float>>& tableData); // Constructor with arguments
+	Operator(float sampleRate); // Constructor with arguments
 	void setup(int tableIndex, float frequency); // Set parameters
 	
 	// set sample rate
@@ -25,11 +26,32 @@ public:
 	// reset phase
 	void reset();
 	
+	// phase (in cycles) and previous output, everything the next output depends on
+	void getState(float& phase, float& lastOutput);
+	void setState(float phase, float lastOutput);
+	
+	// table being read, and reading another table of the same size instead of
+	// the one for the frequency (until the frequency, shape or quality changes)
+	const float* getWavetable() { return wave_; }
+	void setWavetable(const float* wavetable);
+	
 	void setAmplitude(float amplitude);	// Set the operator amplitude
 	void setFrequency(float frequency);	// Set the operator frequency
 	void setTable(int waveShapeEnum);		// Set the opeartor wavetable
 	void setParameters(float amplitude, float frequency, int waveShapeEnum);
 	
+	// Glide amplitude and frequency to new values: rampTo sets the targets and
+	// per-sample steps, the owner calls stepRamp once per sample for samples - 1
+	// samples and then finishRamp, which lands exactly on the targets
+	void rampTo(float amplitude, float frequency, int samples);
+	void stepRamp();
+	void finishRamp();
+	
+	// Set how the wavetables are read: interpolation (see wavetables.h), table
+	// size and band-limited or naive tables. With fade, the old table is
+	// crossfaded out over OPERATOR_QUALITY_FADE samples
+	void setQuality(int interpolation, int tableSize, bool bandLimited, bool fade);
+	
 	// Getters for debugging
 	float amplitude();			// Get the operator amplitude
 	float modAmplitude();		// Get the operator modulator amplitude
@@ -50,16 +72,35 @@ public:
 private:
 	float sampleRate_;			// Sample rate of the audio
 	
-	// Const reference to vector of wavetables (vector of vectors)
-	// Use a const reference so each operator doesn't need to make a copy of the vector
-	const std::vector<std::vector<float>>& table_;
+	// pick the table for the current shape and frequency
+	void updateWave();
+	
+	// Shared wavetables of the current size (see wavetables.h), null until constructed
+	// with a sample rate, so each operator doesn't need to make a copy of them
+	const WavetableSet* tables_;
+	const float* wave_;			// current wavetable
+	int interpolation_;			// how to read between samples
+	bool bandLimited_;			// band-limited or naive tables
+	
+	// previous wavetable, faded out after a quality change
+	const float* fadeWave_;
+	float fadeLength_;			// its length
+	float fadeScale_;			// its length / tableLength_
+	int fadeInterpolation_;
+	int fadeRemaining_;			// samples left to fade
 
 	// operator parameters
 	int currentTable_;			// Index of current table
 	float tableLength_;			// Length of the wavetable
 	float amplitude_;			// Normal amplitude of operator
 	float modAmplitude_;		// Amplitude if operator is modulating
-	float frequency_;			// Frequency of the operator
+	float frequency_;			// Frequency of the operator (the target while gliding)
+	
+	// glide towards a new amplitude and frequency (see rampTo)
+	float targetAmplitude_;		// amplitude at the end of the glide
+	float amplitudeStep_;		// per sample changes of amplitude_, modAmplitude_ and phaseIncr_
+	float modAmplitudeStep_;
+	float phaseIncrStep_;
 	
 	// Commonly needed inverted vlues to be used for multiplication instead of division
 	float lengthXinvSampleRate_;// Length / sampleRate
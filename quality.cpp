@@ -0,0 +1,228 @@
+/***** quality.cpp *****/
+#include <Bela.h>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include "quality.h"
+#include "note.h"
+#include "denormals.h"
+
+static const QualitySettings kQualitySettings[kNumQualityTiers] = {
+	{"eco", kInterpTruncate, 256, false, 2 * CONTROL_PERIOD},
+	{"low", kInterpLinear, WAVETABLE_SIZE, false, 2 * CONTROL_PERIOD},
+	{"standard", kInterpLinear, WAVETABLE_SIZE, false, CONTROL_PERIOD},
+	{"high", kInterpLinear, 2048, true, CONTROL_PERIOD / 4},
+	{"ultra", kInterpCubic, 4096, true, 1}
+};
+
+// benchmark: audio rendered per timing and runs (the fastest is kept)
+static constexpr float kBenchmarkSeconds = 0.5f;
+static constexpr int kBenchmarkRuns = 5;
+// noise is measured over a power of 2 samples with every harmonic on a bin
+static constexpr int kNoiseN = 8192;
+// fundamentals of the noise measurement, in bins (odd, so harmonics never fold onto each other)
+static constexpr int kNoiseBins[] = {19, 93, 371};
+// samples rendered either side of a tier switch
+static constexpr int kSwitchSamples = 2048;
+
+const QualitySettings& getQualitySettings(int tier)
+{
+	if (tier < 0)
+		tier = 0;
+	if (tier >= kNumQualityTiers)
+		tier = kNumQualityTiers - 1;
+	return kQualitySettings[tier];
+}
+
+// power between the harmonics relative to the harmonics (dB) of a signal whose
+// fundamental sits on bin k0 of kNoiseN samples
+static float inharmonicNoiseDb(const std::vector<float>& signal, int k0)
+{
+	static std::vector<double> cosTable, sinTable;
+	if (cosTable.empty())
+	{
+		for (int n = 0; n < kNoiseN; n++)
+		{
+			cosTable.push_back(cos(2 * M_PI * n / kNoiseN));
+			sinTable.push_back(sin(2 * M_PI * n / kNoiseN));
+		}
+	}
+	double total = 0;
+	double mean = 0;
+	for (int n = 0; n < kNoiseN; n++)
+	{
+		total += double(signal[n]) * signal[n];
+		mean += signal[n];
+	}
+	total /= kNoiseN;
+	mean /= kNoiseN;
+	// DC is neither signal nor noise
+	total -= mean * mean;
+	double harmonic = 0;
+	for (int k = k0; k < kNoiseN / 2; k += k0)
+	{
+		double re = 0, im = 0;
+		for (int n = 0, index = 0; n < kNoiseN; n++, index = (index + k) % kNoiseN)
+		{
+			re += signal[n] * cosTable[index];
+			im -= signal[n] * sinTable[index];
+		}
+		harmonic += 2 * (re * re + im * im) / (double(kNoiseN) * kNoiseN);
+	}
+	double noise = total - harmonic;
+	if (noise < 1e-20)
+		noise = 1e-20;
+	return 10 * log10(noise / harmonic);
+}
+
+// render a FreqMod at a tier
+static void renderSynth(FreqMod& synth, std::vector<float>& output, int numSamples)
+{
+	output.resize(numSamples);
+	for (int n = 0; n < numSamples; n++)
+		output[n] = synth.process();
+}
+
+// worst sample to sample step of a smooth FM sound switching from a tier to
+// this one, relative to the worst step while it does not switch
+static float switchStepRatio(int fromTier, int toTier, float sampleRate)
+{
+	std::vector<float> amps = {1, 2, 0, 0};
+	std::vector<float> ratios = {1, 1, 1, 1};
+	std::vector<int> waves = {kWaveSine, kWaveSine, kWaveSine, kWaveSine};
+	FreqMod synth(sampleRate, 441.0);
+	synth.setAlgorithm(kFmConfigDoubleStack22);
+	synth.setSpectrum(amps, ratios, waves);
+	const QualitySettings& from = getQualitySettings(fromTier);
+	const QualitySettings& to = getQualitySettings(toTier);
+	synth.setQuality(from.interpolation, from.tableSize, from.bandLimited, false);
+
+	std::vector<float> before, after;
+	renderSynth(synth, before, kSwitchSamples);
+	synth.setQuality(to.interpolation, to.tableSize, to.bandLimited, true);
+	renderSynth(synth, after, kSwitchSamples);
+
+	float steadyStep = 0, switchStep = 0;
+	for (int n = 1; n < kSwitchSamples; n++)
+		steadyStep = fmaxf(steadyStep, fabsf(before[n] - before[n - 1]));
+	switchStep = fabsf(after[0] - before[kSwitchSamples - 1]);
+	for (int n = 1; n < kSwitchSamples; n++)
+		switchStep = fmaxf(switchStep, fabsf(after[n] - after[n - 1]));
+	return switchStep / steadyStep;
+}
+
+// error of the articulation sweep against one designed every sample
+// (dB relative to the signal), sweeping white noise with the slowest low pass
+static float sweepErrorDb(int period, float sampleRate)
+{
+	Articulation reference(sampleRate), stepped(sampleRate);
+	reference.updateArticulation(0);
+	stepped.updateArticulation(0);
+	reference.setFrequency(220);
+	stepped.setFrequency(220);
+	stepped.setControlPeriod(period);
+	reference.reset();
+	stepped.reset();
+	unsigned int seed = 1;
+	double signal = 0, error = 0;
+	int numSamples = int(kBenchmarkSeconds * sampleRate);
+	for (int n = 0; n < numSamples; n++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		float in = float(seed >> 8) / float(1 << 23) - 1.0f;
+		float out = reference.process(in);
+		float diff = stepped.process(in) - out;
+		signal += out * out;
+		error += diff * diff;
+	}
+	if (error < 1e-20)
+		return -200;
+	return 10 * log10(error / signal);
+}
+
+// time the parts a tier changes, best of a few runs (ns per sample): four
+// operators in an FM stack and the articulation filter along its sweep
+static void timeTier(int tier, float sampleRate, double& synthTime, double& sweepTime)
+{
+	const QualitySettings& quality = getQualitySettings(tier);
+	std::vector<float> amps = {1, 1, 1, 1};
+	std::vector<float> ratios = {1, 2, 3, 0.5};
+	std::vector<int> waves = {kWaveSine, kWaveTriangle, kWaveSaw, kWaveSquare};
+	FreqMod synth(sampleRate, 220.0);
+	synth.setAlgorithm(kFmConfigFourStack);
+	synth.setSpectrum(amps, ratios, waves);
+	synth.setQuality(quality.interpolation, quality.tableSize, quality.bandLimited, false);
+	Articulation articulation(sampleRate);
+	articulation.updateArticulation(0);
+	articulation.setFrequency(220);
+	articulation.setControlPeriod(quality.articulationPeriod);
+
+	// the sweep lasts longer than a run
+	int numSamples = int(kBenchmarkSeconds * sampleRate);
+	std::vector<float> output(numSamples);
+	synthTime = 0;
+	sweepTime = 0;
+	for (int run = 0; run < kBenchmarkRuns; run++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (int n = 0; n < numSamples; n++)
+			output[n] = synth.process();
+		auto middle = std::chrono::steady_clock::now();
+		articulation.reset();
+		for (int n = 0; n < numSamples; n++)
+			output[n] = articulation.process(output[n]);
+		auto end = std::chrono::steady_clock::now();
+		double synthRun = std::chrono::duration<double>(middle - start).count();
+		double sweepRun = std::chrono::duration<double>(end - middle).count();
+		if (run == 0 || synthRun < synthTime)
+			synthTime = synthRun;
+		if (run == 0 || sweepRun < sweepTime)
+			sweepTime = sweepRun;
+	}
+	synthTime *= 1e9 / numSamples;
+	sweepTime *= 1e9 / numSamples;
+}
+
+void runQualityBenchmark(float sampleRate)
+{
+	ensureFlushToZero();
+	rt_printf("Quality benchmark: FM stack and articulation ns per sample, inharmonic noise (dB) of a saw at %.0f, %.0f and %.0f Hz\n",
+		kNoiseBins[0] * sampleRate / kNoiseN, kNoiseBins[1] * sampleRate / kNoiseN, kNoiseBins[2] * sampleRate / kNoiseN);
+	rt_printf("\tand of an FM stack at %.0f Hz, articulation sweep error (dB), step switching from standard (x steady):\n",
+		kNoiseBins[1] * sampleRate / kNoiseN);
+
+	std::vector<float> amps = {4, 0, 0, 0};
+	std::vector<float> ratios = {1, 1, 1, 1};
+	std::vector<int> sawWaves = {kWaveSaw, kWaveSine, kWaveSine, kWaveSine};
+	std::vector<float> fmAmps = {1, 3, 0, 0};
+	std::vector<float> fmRatios = {1, 2, 1, 1};
+	std::vector<int> sineWaves = {kWaveSine, kWaveSine, kWaveSine, kWaveSine};
+	std::vector<float> signal;
+	for (int tier = 0; tier < kNumQualityTiers; tier++)
+	{
+		const QualitySettings& quality = getQualitySettings(tier);
+		double synthTime, sweepTime;
+		timeTier(tier, sampleRate, synthTime, sweepTime);
+		char line[256];
+		int length = snprintf(line, sizeof(line), "\t%-8s %5.1f + %5.1f ns |", quality.name, synthTime, sweepTime);
+		for (int k0 : kNoiseBins)
+		{
+			FreqMod saw(sampleRate, k0 * sampleRate / kNoiseN);
+			saw.setSpectrum(amps, ratios, sawWaves);
+			saw.setQuality(quality.interpolation, quality.tableSize, quality.bandLimited, false);
+			renderSynth(saw, signal, kNoiseN);
+			length += snprintf(line + length, sizeof(line) - length, " %6.1f", inharmonicNoiseDb(signal, k0));
+		}
+		FreqMod fm(sampleRate, kNoiseBins[1] * sampleRate / kNoiseN);
+		fm.setAlgorithm(kFmConfigDoubleStack22);
+		fm.setSpectrum(fmAmps, fmRatios, sineWaves);
+		fm.setQuality(quality.interpolation, quality.tableSize, quality.bandLimited, false);
+		renderSynth(fm, signal, kNoiseN);
+		length += snprintf(line + length, sizeof(line) - length, " | FM %6.1f", inharmonicNoiseDb(signal, kNoiseBins[1]));
+		length += snprintf(line + length, sizeof(line) - length, " | sweep %6.1f",
+			sweepErrorDb(quality.articulationPeriod, sampleRate));
+		snprintf(line + length, sizeof(line) - length, " | switch %.2f",
+			switchStepRatio(kQualityStandard, tier, sampleRate));
+		rt_printf("%s\n", line);
+	}
+}
@@ -0,0 +1,49 @@
+/***** quality.h *****/
+// Quality tiers, trading sound quality for CPU time per note
+// A tier sets how the operators read their wavetables (interpolation, table
+// size, naive or band-limited tables) and how often the articulation filter
+// is redesigned along its sweep, it glides between designs. Tiers can change
+// while a note sounds: the operators keep their place in the cycle and
+// crossfade from the old tables (see Operator::setQuality), the sweep carries
+// on from where it was.
+#ifndef QUALITY_H
+#define QUALITY_H
+
+#include "wavetables.h"
+
+//------------ ENABLE QUALITY BENCHMARK HERE -----------------
+// time and measure every tier at setup
+#define QUALITY_BENCHMARK 0
+//------------ ENABLE QUALITY BENCHMARK HERE -----------------
+
+//------------ CHANGE QUALITY HERE -----------------
+#define QUALITY_TIER kQualityStandard // tier notes start with
+//------------ CHANGE QUALITY HERE -----------------
+
+// enumerator for the quality tiers, cheapest first
+enum qualityTiers {
+	kQualityEco = 0, // truncated small naive tables, sweep designed every other control tick
+	kQualityLow, // standard tables, sweep designed every other control tick
+	kQualityStandard, // linear interpolation of 512 sample naive tables, sweep designed every control tick
+	kQualityHigh, // linear interpolation of 2048 sample band-limited tables, sweep designed 4 times a tick
+	kQualityUltra, // cubic interpolation of 4096 sample band-limited tables, sweep designed every sample
+	kNumQualityTiers
+};
+
+struct QualitySettings {
+	const char* name;
+	int interpolation; // see interpolations in wavetables.h
+	int tableSize; // WAVETABLE_MIN_SIZE to WAVETABLE_MAX_SIZE
+	bool bandLimited; // band-limited or naive tables
+	int articulationPeriod; // samples between articulation filter designs
+};
+
+// settings of a tier (clamped to the range of tiers)
+const QualitySettings& getQualitySettings(int tier);
+
+// time every tier and measure its quality: aliasing and interpolation noise
+// of the operators, error of the stepped articulation sweep and the largest
+// step when switching to it, then print the table (dev tool, see QUALITY_BENCHMARK)
+void runQualityBenchmark(float sampleRate);
+
+#endif
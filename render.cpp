@@ -5,8 +5,22 @@
 #include <libraries/GuiController/GuiController.h>
 #include <libraries/Midi/Midi.h>
 #include <libraries/Scope/Scope.h>
+#include <libraries/WriteFile/WriteFile.h>
+#include <vector>
+#include <memory>
 #include "note.h"
 #include "articulation.h"
+#include "rtSafety.h"
+#include "analysisScheduler.h"
+#include "denormals.h"
+#include "dbConvert.h"
+#include "timbreAtlas.h"
+#include "timbreIndex.h"
+#include "fmFitter.h"
+#include "voiceRenderer.h"
+#include "quality.h"
+#include "cpuGovernor.h"
+#include "mpeVoices.h"
 
 // Trill ==============================================================
 //------------ CHANGE TRILL ADDRESSES HERE -----------------
@@ -50,6 +64,29 @@ AuxiliaryTask gGraphTask;
 void process_fft_background(void*);
 // graph calculation callback to be made into an auxiliary task
 void process_graphs_background(void*);
+// wake the FFT task when a hop is ready and the graph task when parameters change
+AnalysisScheduler gFFTScheduler;
+AnalysisScheduler gGraphScheduler;
+// spectrum cycle baking task, woken when the note asks for a baked cycle
+AuxiliaryTask gBakeTask;
+void process_bake_background(void*);
+AnalysisScheduler gBakeScheduler;
+// Time period (in seconds) after which graphs are resent even if unchanged
+float gGraphKeepAlivePeriod = 1.0;
+// Output timbre features log (see featureExtractor.h to enable)
+WriteFile gFeatureLog;
+
+// CPU governor (see cpuGovernor.h to enable), lowers analysis rate, quality and polyphony under load
+CpuGovernor gGovernor;
+// GUI updates are sent once every stride GUI periods
+int gGuiStride = 1;
+
+// Profiling (see stageProfiler.h to enable)
+AuxiliaryTask gProfileTask;
+// Time period (in seconds) between stage profile reports
+float gProfilePeriod = 5.0;
+// stage profile report callback to be made into an auxiliary task
+void process_profile_background(void*);
 
 // Timbre ==========================================================
 // Note object
@@ -61,6 +98,26 @@ int gTimbreDim[4] = {0};
 // Buffer to send to GUI to update dimension values
 // {spFlag, spectrum, brFlag, brightness, arFlag, articulation, enFlag, envelope}
 int gTimbreBuffer[8] = {0};
+// Note output for the current audio block
+std::vector<float> gNoteOutput;
+
+// MPE (see mpeVoices.h to enable) ==================================
+// gDevNote is the first voice, the one analyzed and shown on the GUI
+MpeVoices gMpeVoices;
+VoiceRenderer gVoiceRenderer;
+// the other voices
+std::vector<std::unique_ptr<Note>> gMpeNotes;
+// a governor decision waiting for the voices to be free to apply it
+bool gGovernorPending = false;
+
+// apply gTimbreDim[dimension] to the note, or to every MPE voice
+void applyTimbre(int dimension)
+{
+	if (MPE)
+		gMpeVoices.setTimbre(dimension, gTimbreDim[dimension]);
+	else
+		gDevNote.setTimbre(dimension, gTimbreDim[dimension]);
+}
 
 /*
  * Function to be run on an auxiliary task that reads data from the Trill sensor.
@@ -95,18 +152,67 @@ void loop(void*)
 // wrapper function to feed to Bela_createAuxiliaryTask
 void process_fft_background(void*)
 {
-	gDevNote.outputFft(gui);
+	ensureFlushToZero();
+	gFFTScheduler.taskStarted();
+	// log the features of every analyzed frame
+	if (gDevNote.outputFft(gui) && FEATURE_LOG)
+		gFeatureLog.log(gDevNote.getFeatures(), kNumFeatures);
 }
 
 // wrapper function to feed to Bela_createAuxiliaryTask
 void process_graphs_background(void*)
 {
-	gDevNote.updateGraphs(gui);
+	ensureFlushToZero();
+	// keep-alive wakeups resend both graphs
+	bool refresh = gGraphScheduler.taskStarted();
+	gDevNote.updateGraphs(gui, refresh);
+}
+
+// wrapper function to feed to Bela_createAuxiliaryTask
+void process_bake_background(void*)
+{
+	ensureFlushToZero();
+	gBakeScheduler.taskStarted();
+	if (MPE)
+		gMpeVoices.bakeSpectra();
+	else
+		gDevNote.bakeSpectrum();
+}
+
+// wrapper function to feed to Bela_createAuxiliaryTask
+void process_profile_background(void*)
+{
+	StageProfiler::report();
 }
 
 
 bool setup(BelaContext *context, void *userData)
 {
+	// Real-time safety checker setup (see rtSafety.h to enable)
+	RtSafety::init();
+	
+	// Denormal benchmark (see denormals.h to enable)
+	if (DENORMAL_BENCHMARK)
+		runDenormalBenchmark(context->audioSampleRate);
+	// dB conversion accuracy check (see dbConvert.h to enable)
+	if (DB_ACCURACY_CHECK)
+		runDbAccuracyCheck();
+	// Timbre atlas (see timbreAtlas.h to enable)
+	if (TIMBRE_ATLAS)
+		runTimbreAtlas(context->audioSampleRate);
+	// Timbre match of a reference recording (see timbreIndex.h to enable)
+	if (TIMBRE_MATCH)
+		runTimbreMatch(context->audioSampleRate);
+	// FM parameter fit to a recording (see fmFitter.h to enable)
+	if (FM_FIT)
+		runFmFit(context->audioSampleRate);
+	// Voices vs threads benchmark (see voiceRenderer.h to enable)
+	if (VOICE_BENCHMARK)
+		runVoiceBenchmark(context->audioSampleRate);
+	// Quality tier benchmark (see quality.h to enable)
+	if (QUALITY_BENCHMARK)
+		runQualityBenchmark(context->audioSampleRate);
+	
 	// Trill setup============================================================
 	// Setup Trill Squares on i2c bus 1, using the default mode
 	if(spectrumTrill.setup(1, Trill::SQUARE, gSpecTrillAddress) != 0) {
@@ -138,17 +244,32 @@ bool setup(BelaContext *context, void *userData)
 	// Note object setup
 	// We can't call the custom constructor since some class members have const references (non-copyable)
 	gDevNote.setSampleRate(context->audioSampleRate);
-	if (!gDevNote.initMidi())
+	gNoteOutput.resize(context->audioFrames);
+	if (MPE)
+	{
+		// MPE voices read MIDI instead of the note, and are rendered on every core
+		// only the note (voice 0) is analyzed, the others skip their FFT feeds
+		std::vector<Note*> voices = {&gDevNote};
+		for (int v = 1; v < MPE_NUM_VOICES; v++)
+		{
+			gMpeNotes.emplace_back(new Note(context->audioSampleRate, 440.0));
+			gMpeNotes.back()->setAnalyzed(false);
+			voices.push_back(gMpeNotes.back().get());
+		}
+		gMpeVoices.setup(voices);
+		gVoiceRenderer.setup(voices, context->audioSampleRate, context->audioFrames, 0);
+		if (!gMpeVoices.initMidi())
+			return false;
+	}
+	else if (!gDevNote.initMidi())
 		return false;
 	// Initial Timbre values
-	gTimbreDim[0] = MAX_SPECTRUM / 2 - 1;
-	gTimbreDim[1] = MAX_BRIGHTNESS / 2 - 1;
-	gTimbreDim[2] = MAX_ARTICULATION / 2 - 1;
-	gTimbreDim[3] = MAX_ENVELOPE / 2 - 1;
-	gDevNote.setSpectrum(gTimbreDim[0]);
-	gDevNote.setEnvelope(gTimbreDim[1]);
-	gDevNote.setArticulation(gTimbreDim[2]);
-	gDevNote.setBrightness(gTimbreDim[3]);
+	gTimbreDim[kTimbreSpectrum] = MAX_SPECTRUM / 2 - 1;
+	gTimbreDim[kTimbreBrightness] = MAX_BRIGHTNESS / 2 - 1;
+	gTimbreDim[kTimbreArticulation] = MAX_ARTICULATION / 2 - 1;
+	gTimbreDim[kTimbreEnvelope] = MAX_ENVELOPE / 2 - 1;
+	for (int i = 0; i < kNumTimbreDimensions; i++)
+		applyTimbre(i);
 	
 	
 	// GUI setup =============================================================
@@ -166,15 +287,69 @@ bool setup(BelaContext *context, void *userData)
 	// FFT Setup
 	gFFTTask = Bela_createAuxiliaryTask(&process_fft_background, 90, "fft-calculation");
 	gGraphTask = Bela_createAuxiliaryTask(&process_graphs_background, 80, "graph-calculation");
+	// FFT task runs once per hop, graphs at most once per GUI period
+	gFFTScheduler.setup(gFFTTask, 0, 0);
+	gGraphScheduler.setup(gGraphTask, gGuiPeriod*context->audioSampleRate, gGraphKeepAlivePeriod*context->audioSampleRate);
+	// Spectrum baking runs as soon as a cycle is requested
+	gBakeTask = Bela_createAuxiliaryTask(&process_bake_background, 70, "spectrum-bake");
+	gBakeScheduler.setup(gBakeTask, 0, 0);
+	
+	// Feature log setup, one line per analyzed frame
+	if (FEATURE_LOG)
+	{
+		gFeatureLog.setup(FEATURE_LOG_FILE);
+		gFeatureLog.setHeader("% time centroid spread flux rolloff oddEven attack\n");
+		gFeatureLog.setFormat("%.4f %.1f %.1f %.4f %.1f %.2f %.4f\n");
+		gFeatureLog.setFooter("");
+	}
+	
+	// CPU governor setup, starting from the full quality tier
+	gGovernor.setup(context->audioSampleRate, context->audioFrames, QUALITY_TIER, MPE ? gMpeVoices.getNumVoices() : 1);
+	
+	// Profiling setup
+	if (STAGE_PROFILING)
+		gProfileTask = Bela_createAuxiliaryTask(&process_profile_background, 50, "stage-profile");
+	
+	// Real-time safety session through render() (see rtSafety.h to enable)
+	if (RT_SAFETY_SESSION)
+	{
+		if (!runRtSafetySession(context, userData, gDevNote))
+			return false;
+		// back to the initial timbre, quality and analysis rate
+		for (int i = 0; i < kNumTimbreDimensions; i++)
+			applyTimbre(i);
+		if (MPE)
+			gMpeVoices.setQualityTier(QUALITY_TIER);
+		else
+			gDevNote.setQualityTier(QUALITY_TIER);
+		gDevNote.setAnalysisStride(1);
+		gGuiStride = 1;
+		gGovernor.setup(context->audioSampleRate, context->audioFrames, QUALITY_TIER, MPE ? gMpeVoices.getNumVoices() : 1);
+		if (MPE)
+			gMpeVoices.setVoiceLimit(gMpeVoices.getNumVoices());
+	}
 	
 	return true;
 }
 
 void render(BelaContext *context, void *userData)
 {
+	// flag everything below as running in the audio callback
+	RT_SAFETY_SCOPE();
+	// treat denormals as zero in the audio thread
+	ensureFlushToZero();
+	// time the whole block for the CPU governor
+	if (CPU_GOVERNOR)
+		gGovernor.blockStarted();
+	// voices the last block left rendering must be done before anything touches them
+	if (MPE)
+		gVoiceRenderer.waitForVoices();
+	
 	// Update Timbre =============================================================
 	// frame count for sending data to GUI
 	static unsigned int frameCount = 0;
+	// frame count for stage profile reports
+	static unsigned int profileFrameCount = 0;
 	
 	// set timbre parameters using the GUI
 	DataBuffer& buffer = gui.getDataBuffer(kGtBTimbreParams);
@@ -186,13 +361,7 @@ void render(BelaContext *context, void *userData)
 		if (data[2*i] == 1) {
 			gTimbreDim[i] = int(data[2*i+1]);
 			// set corresponding dimension depending on i
-			switch(i) 
-			{
-				case 0: gDevNote.setSpectrum(gTimbreDim[0]); break;
-				case 1: gDevNote.setBrightness(gTimbreDim[1]); break;
-				case 2: gDevNote.setArticulation(gTimbreDim[2]); break;
-				case 3: gDevNote.setEnvelope(gTimbreDim[3]); break;
-			}
+			applyTimbre(i);
 		}
 	}
 
@@ -211,8 +380,8 @@ void render(BelaContext *context, void *userData)
 		gTimbreDim[0] = int(map(specFilt.process(gSpecTouchPosition[1]), 0, 1, 0, MAX_SPECTRUM-1));
 		gTimbreDim[1] = int(map(brightFilt.process(gSpecTouchPosition[0]), 0, 1, 0, MAX_BRIGHTNESS-1));
 
-		gDevNote.setSpectrum(gTimbreDim[0]);
-		gDevNote.setBrightness(gTimbreDim[1]);
+		applyTimbre(kTimbreSpectrum);
+		applyTimbre(kTimbreBrightness);
 
 		// update send buffer for spectrum and brightness
 		// set update flags to 1 to tell gui to update
@@ -232,8 +401,8 @@ void render(BelaContext *context, void *userData)
 		gTimbreDim[2] = int(map(articFilt.process(gDynTouchPosition[1]), 0, 1, 0, MAX_ARTICULATION-1));
 		gTimbreDim[3] = int(map(envFilt.process(gDynTouchPosition[0]), 0, 1, 0, MAX_ENVELOPE-1));
 
-		gDevNote.setArticulation(gTimbreDim[2]);
-		gDevNote.setEnvelope(gTimbreDim[3]);
+		applyTimbre(kTimbreArticulation);
+		applyTimbre(kTimbreEnvelope);
 
 		// update send buffer for articulation and envelope
 		// set update flags to 1 to tell gui to update
@@ -248,14 +417,23 @@ void render(BelaContext *context, void *userData)
 	DataBuffer& advBuffer = gui.getDataBuffer(kGtBAdvControls);
 	float* advData = advBuffer.getAsFloat();
 	
-	// update advanced mode and controls for the note object
-	gDevNote.setAdvMode(advData[kACIAdvMode]);
-	gDevNote.setAdvControls(advData);
-	
-	// advanced FM spectrum buffer and control - retrieve, convert, update
+	// advanced FM spectrum buffer and control - retrieve, convert
 	DataBuffer& advFmBuffer = gui.getDataBuffer(kGtBAdvSpectrum);
 	float* advFmData = advFmBuffer.getAsFloat();
-	gDevNote.updateAdvSpectrum(advFmData);
+	
+	// update advanced mode, controls and spectrum for the note object (or voices)
+	if (MPE)
+	{
+		gMpeVoices.setAdvMode(advData[kACIAdvMode]);
+		gMpeVoices.setAdvControls(advData);
+		gMpeVoices.updateAdvSpectrum(advFmData);
+	}
+	else
+	{
+		gDevNote.setAdvMode(advData[kACIAdvMode]);
+		gDevNote.setAdvControls(advData);
+		gDevNote.updateAdvSpectrum(advFmData);
+	}
 	
 	
 	// debug statements
@@ -268,11 +446,22 @@ void render(BelaContext *context, void *userData)
 	}
 	
 	// Audio Block Loop ==========================================================
+	// render the note (or every MPE voice) for the whole block
+	if (MPE)
+	{
+		gMpeVoices.processMidi(gui);
+		gVoiceRenderer.render(gNoteOutput.data(), context->audioFrames);
+	}
+	else
+		gDevNote.processBlock(gui, gNoteOutput.data(), context->audioFrames);
+	// voices left rendering by a late block are not touched again in this block
+	bool voicesLate = MPE && gVoiceRenderer.isLate();
+	
 	float out = 0;
 	for (unsigned int n = 0; n < context->audioFrames; n++)
 	{
-		// Send buffers to GUI at fixed intervals
-		if(frameCount >= gGuiPeriod*context->audioSampleRate)
+		// Send buffers to GUI at fixed intervals (after late voices are done)
+		if(frameCount >= gGuiStride*gGuiPeriod*context->audioSampleRate && !voicesLate)
 		{
 			//send timbre paramters
 			gui.sendBuffer(kBtGTimbreParams, gTimbreBuffer);
@@ -281,17 +470,23 @@ void render(BelaContext *context, void *userData)
 				gTimbreBuffer[2*i] = 0;
 			// send assorted envelope and spectrum info to the GUI
 			gDevNote.sendToGui(gui);
-			// schedule task to calculate brightness FRF and articulation graph and then send them to the GUI
-			Bela_scheduleAuxiliaryTask(gGraphTask);
-			// schedule tasks to calculate raw and final spectrum FFTs and send them to the GUI
-			Bela_scheduleAuxiliaryTask(gFFTTask);
+			// CPU load and governor decisions
+			if (CPU_GOVERNOR)
+				gGovernor.sendToGui(gui, kBtGGovernor);
 
 			frameCount = 0;
 		}
 		frameCount ++;
 		
-		// call note process
-		out = gDevNote.process(gui, true);
+		// Print per-stage profile at fixed intervals
+		if (STAGE_PROFILING && ++profileFrameCount >= gProfilePeriod*context->audioSampleRate)
+		{
+			Bela_scheduleAuxiliaryTask(gProfileTask);
+			profileFrameCount = 0;
+		}
+		
+		// get note output
+		out = gNoteOutput[n];
 		// log output to oscilloscope
 		gScope.log(out);
 		
@@ -299,9 +494,38 @@ void render(BelaContext *context, void *userData)
 		for (unsigned int i = 0; i < context->audioOutChannels; i++)
 			audioWrite(context, n, i, out);
 	}
+	
+	// Analysis tasks ==============================================================
+	// calculate raw and final spectrum FFTs once a hop is ready and send them to the GUI
+	gFFTScheduler.update(!voicesLate && gDevNote.checkFftReady(), context->audioFrames);
+	// calculate brightness FRF and articulation graph only after they changed
+	gGraphScheduler.update(!voicesLate && gDevNote.checkGraphsDirty(), context->audioFrames);
+	// bake a single cycle of the spectrum once its parameters have settled
+	gBakeScheduler.update(!voicesLate && (MPE ? gMpeVoices.checkBakeRequested() : gDevNote.checkBakeRequested()), context->audioFrames);
+	
+	// CPU Governor ==============================================================
+	// apply a new level from the next block, once no voice is still rendering
+	if (CPU_GOVERNOR && gGovernor.blockFinished())
+		gGovernorPending = true;
+	if (gGovernorPending && !voicesLate)
+	{
+		gGovernorPending = false;
+		if (MPE)
+		{
+			gMpeVoices.setQualityTier(gGovernor.getQualityTier());
+			gMpeVoices.setVoiceLimit(gGovernor.getVoiceLimit());
+		}
+		else
+			gDevNote.setQualityTier(gGovernor.getQualityTier());
+		gDevNote.setAnalysisStride(gGovernor.getAnalysisStride());
+		gGuiStride = gGovernor.getAnalysisStride();
+	}
 }
 
 void cleanup(BelaContext *context, void *userData)
 {
-	
+	// stop the voice rendering threads
+	gVoiceRenderer.cleanup();
+	// print real-time safety summary
+	RtSafety::report();
 }
\ No newline at end of file
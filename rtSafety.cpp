@@ -0,0 +1,383 @@
+/***** rtSafety.cpp *****/
+#include <Bela.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <new>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include "rtSafety.h"
+#include "note.h"
+#include "quality.h"
+
+// frames of stack trace to print for each violation
+#define RT_SAFETY_TRACE_DEPTH 32
+// length (seconds) of the scripted session
+#define RT_SAFETY_SESSION_LENGTH 4
+
+// whether the current thread is inside the audio callback
+static thread_local bool tInAudioCallback = false;
+// total number of violations, across all threads
+static std::atomic<int> gRtViolations(0);
+
+#if RT_SAFETY_CHECK
+// guard so that reporting a violation does not report itself
+static thread_local bool tReporting = false;
+
+// print the offending call and a stack trace, without allocating
+static void reportViolation(const char* what)
+{
+	if (!tInAudioCallback || tReporting)
+		return;
+	tReporting = true;
+	gRtViolations++;
+
+	char msg[128];
+	int len = snprintf(msg, sizeof(msg), "RT safety violation: %s called inside render()\n", what);
+	if (len > 0)
+		write(STDERR_FILENO, msg, len);
+	// backtrace_symbols_fd writes straight to the descriptor (no malloc)
+	void* frames[RT_SAFETY_TRACE_DEPTH];
+	int numFrames = backtrace(frames, RT_SAFETY_TRACE_DEPTH);
+	backtrace_symbols_fd(frames, numFrames, STDERR_FILENO);
+
+	if (RT_SAFETY_ABORT)
+		abort();
+	tReporting = false;
+}
+#endif
+
+#if RT_SAFETY_CHECK && defined(__COBALT__)
+// Xenomai sends SIGDEBUG when a real-time thread with PTHREAD_WARNSW set
+// switches to secondary (Linux) mode, e.g. for a syscall or a Linux mutex
+static void sigdebugHandler(int sig, siginfo_t* si, void* context)
+{
+	char what[64];
+	snprintf(what, sizeof(what), "mode switch (reason %d)", int(sigdebug_reason(si)));
+	reportViolation(what);
+}
+#endif
+
+void RtSafety::init()
+{
+#if RT_SAFETY_CHECK
+	// the first backtrace() loads libgcc, do it here rather than in render()
+	void* frames[1];
+	backtrace(frames, 1);
+#if defined(__COBALT__)
+	struct sigaction sa = {};
+	sa.sa_sigaction = sigdebugHandler;
+	sa.sa_flags = SA_SIGINFO;
+	sigaction(SIGDEBUG, &sa, NULL);
+#else
+	// resolve every interposed function now, dlsym may allocate
+	pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+	pthread_mutex_lock(&mutex);
+	pthread_mutex_unlock(&mutex);
+	char byte;
+	write(STDERR_FILENO, "", 0);
+	read(-1, &byte, 0);
+	usleep(0);
+	struct timespec zero = {0, 0};
+	nanosleep(&zero, NULL);
+#endif
+#endif
+}
+
+void RtSafety::enterAudioCallback()
+{
+#if defined(__COBALT__)
+	// ask Xenomai to signal mode switches of the audio thread
+	static thread_local bool warnSwEnabled = false;
+	if (!warnSwEnabled)
+	{
+		pthread_setmode_np(0, PTHREAD_WARNSW, NULL);
+		warnSwEnabled = true;
+	}
+#endif
+	tInAudioCallback = true;
+}
+
+void RtSafety::exitAudioCallback()
+{
+	tInAudioCallback = false;
+}
+
+int RtSafety::getViolationCount()
+{
+	return gRtViolations.load();
+}
+
+void RtSafety::report()
+{
+	if (!RT_SAFETY_CHECK)
+		return;
+	int violations = gRtViolations.load();
+	if (violations == 0)
+		rt_printf("RT safety: no violations inside render()\n");
+	else
+		rt_printf("RT safety: %d violation(s) inside render(), see stack traces above\n", violations);
+}
+
+// advance the scripted session to a block: note on, a sweep of every timbre
+// dimension with expression, a quality change, advanced mode on and off, note off
+static void runSessionStep(Note& note, int block, int numBlocks)
+{
+	static const int kMaxDimensions[kNumTimbreDimensions] = {MAX_SPECTRUM, MAX_BRIGHTNESS, MAX_ARTICULATION, MAX_ENVELOPE};
+	float position = float(block) / numBlocks;
+	if (block == 0)
+		note.triggerNote(60, 100);
+	if (position < 0.5f)
+	{
+		// a new value of one of the dimensions every 8 blocks
+		if (block % 8 == 0)
+		{
+			int dimension = (block / 8) % kNumTimbreDimensions;
+			note.setTimbre(dimension, int(2 * position * (kMaxDimensions[dimension] - 1)));
+		}
+		note.setModWheel(2 * position);
+		note.setAftertouch(1 - 2 * position);
+		note.setSlide(4 * position - 1);
+		note.setPitchBend(4 * position);
+	}
+	if (block == numBlocks / 4)
+		note.setQualityTier(kQualityHigh);
+	if (block == numBlocks / 2)
+		note.setAdvMode(1);
+	if (block == 5 * numBlocks / 8)
+		note.setAdvMode(0);
+	if (block == 3 * numBlocks / 4)
+		note.triggerNote(60, 0);
+	if (block == 7 * numBlocks / 8)
+		note.setQualityTier(QUALITY_TIER);
+}
+
+// render() schedules the analysis and bake tasks, sends to the GUI and scope
+// and reads MIDI as it does when audio runs
+bool runRtSafetySession(BelaContext* context, void* userData, Note& note)
+{
+	if (!RT_SAFETY_CHECK)
+	{
+		rt_printf("RT safety session: set RT_SAFETY_CHECK to check the session\n");
+		return true;
+	}
+	int violations = RtSafety::getViolationCount();
+	int numBlocks = int(RT_SAFETY_SESSION_LENGTH * context->audioSampleRate / context->audioFrames);
+	for (int b = 0; b < numBlocks; b++)
+	{
+		{
+			RtSafetyScope scope;
+			runSessionStep(note, b, numBlocks);
+		}
+		// render() checks itself
+		render(context, userData);
+	}
+	violations = RtSafety::getViolationCount() - violations;
+	if (violations > 0)
+		rt_printf("RT safety session: FAILED, %d violation(s), see stack traces above\n", violations);
+	else
+		rt_printf("RT safety session: passed, %d blocks of render() without violations\n", numBlocks);
+	return (violations == 0);
+}
+
+#if RT_SAFETY_CHECK
+// Interposed allocation functions =============================================
+// glibc exports its allocator under __libc_* names, so the real functions can be
+// reached without dlsym (which itself allocates)
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t num, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void* __libc_valloc(size_t size);
+void __libc_free(void* ptr);
+
+void* malloc(size_t size)
+{
+	reportViolation("malloc");
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t num, size_t size)
+{
+	reportViolation("calloc");
+	return __libc_calloc(num, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+	reportViolation("realloc");
+	return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr)
+{
+	if (ptr)
+		reportViolation("free");
+	__libc_free(ptr);
+}
+
+// aligned allocations, freed by free()
+int posix_memalign(void** memptr, size_t alignment, size_t size)
+{
+	reportViolation("posix_memalign");
+	if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+		return EINVAL;
+	void* ptr = __libc_memalign(alignment, size);
+	if (!ptr)
+		return ENOMEM;
+	*memptr = ptr;
+	return 0;
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+	reportViolation("aligned_alloc");
+	return __libc_memalign(alignment, size);
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+	reportViolation("memalign");
+	return __libc_memalign(alignment, size);
+}
+
+void* valloc(size_t size)
+{
+	reportViolation("valloc");
+	return __libc_valloc(size);
+}
+}
+
+void* operator new(size_t size)
+{
+	reportViolation("operator new");
+	void* ptr = __libc_malloc(size);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](size_t size)
+{
+	reportViolation("operator new[]");
+	void* ptr = __libc_malloc(size);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+	if (ptr)
+		reportViolation("operator delete");
+	__libc_free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	if (ptr)
+		reportViolation("operator delete[]");
+	__libc_free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+	operator delete[](ptr);
+}
+
+#if __cpp_aligned_new
+// over-aligned types (C++17)
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	reportViolation("operator new (aligned)");
+	void* ptr = __libc_memalign(size_t(alignment), size);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	reportViolation("operator new[] (aligned)");
+	void* ptr = __libc_memalign(size_t(alignment), size);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+	operator delete(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept
+{
+	operator delete[](ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept
+{
+	operator delete(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept
+{
+	operator delete[](ptr);
+}
+#endif
+
+#if !defined(__COBALT__)
+// Interposed locks and system calls (host only) ===============================
+// Look up the next definition of a libc function, once
+#define RT_SAFETY_REAL(name) \
+	static decltype(&name) real = (decltype(&name)) dlsym(RTLD_NEXT, #name)
+
+extern "C" {
+int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+	RT_SAFETY_REAL(pthread_mutex_lock);
+	reportViolation("pthread_mutex_lock");
+	return real(mutex);
+}
+
+ssize_t write(int fd, const void* buf, size_t count)
+{
+	RT_SAFETY_REAL(write);
+	reportViolation("write");
+	return real(fd, buf, count);
+}
+
+ssize_t read(int fd, void* buf, size_t count)
+{
+	RT_SAFETY_REAL(read);
+	reportViolation("read");
+	return real(fd, buf, count);
+}
+
+int usleep(useconds_t usec)
+{
+	RT_SAFETY_REAL(usleep);
+	reportViolation("usleep");
+	return real(usec);
+}
+
+int nanosleep(const struct timespec* req, struct timespec* rem)
+{
+	RT_SAFETY_REAL(nanosleep);
+	reportViolation("nanosleep");
+	return real(req, rem);
+}
+}
+#endif
+#endif
@@ -0,0 +1,63 @@
+/***** rtSafety.h *****/
+// Real-time safety checker for the audio callback
+// With RT_SAFETY_CHECK set to 1, any heap allocation, mutex lock or blocking
+// system call made while the audio callback flag is set prints a stack trace.
+// On a host build the libc functions are interposed directly. On Bela
+// (Xenomai/Cobalt) mode switches are detected with PTHREAD_WARNSW instead,
+// since Cobalt already wraps the pthread and syscall entry points.
+#ifndef RTSAFETY_H
+#define RTSAFETY_H
+
+#include <Bela.h>
+
+class Note;
+
+//------------ ENABLE RT SAFETY CHECK HERE -----------------
+#define RT_SAFETY_CHECK 0
+// abort on the first violation instead of printing and carrying on
+#define RT_SAFETY_ABORT 0
+// run render() through a scripted session at setup and fail setup on any violation
+#define RT_SAFETY_SESSION 0
+//------------ ENABLE RT SAFETY CHECK HERE -----------------
+
+class RtSafety
+{
+public:
+	// resolve the real libc functions and warm up the backtrace machinery
+	// CALL IN SETUP (these steps allocate themselves)
+	static void init();
+
+	// set or clear the thread-local "in audio callback" flag
+	static void enterAudioCallback();
+	static void exitAudioCallback();
+
+	// number of violations seen so far
+	static int getViolationCount();
+
+	// print a summary of the violations (call in cleanup)
+	static void report();
+};
+
+// call render() through a scripted session of the note (note on, timbre sweeps,
+// expression, quality and advanced mode changes, note off), checking the script
+// steps as render() checks itself, and return whether it ran without
+// violations. Call at the end of setup, the context is setup's own (its buffers
+// are allocated, audio has not started yet) (dev tool, see RT_SAFETY_SESSION)
+bool runRtSafetySession(BelaContext* context, void* userData, Note& note);
+
+// Sets the audio callback flag for the lifetime of the scope
+class RtSafetyScope
+{
+public:
+	RtSafetyScope() { RtSafety::enterAudioCallback(); }
+	~RtSafetyScope() { RtSafety::exitAudioCallback(); }
+};
+
+// Check everything called in the rest of the enclosing scope
+#if RT_SAFETY_CHECK
+#define RT_SAFETY_SCOPE() RtSafetyScope rtSafetyScope_
+#else
+#define RT_SAFETY_SCOPE()
+#endif
+
+#endif
@@ -30,6 +30,7 @@ let brightLinkButton;
 let brightQSlider;
 let artiQSlider;
 let dsrSliders = [];
+let curveSelects = [];
 // let susSlider;
 // let relSlider;
 
@@ -411,8 +412,14 @@ class FftDisplay {
 		// title position and size
 		this.titleY = 0.09 * ht;
 		this.titleSize = 0.029 * wid;
+		
+		// feature readout, right of the title
+		this.featX = this.graphX + this.graphW;
+		this.featSize = 0.009 * wid;
 	}
-	draw() {
+	// input is the features array from Bela
+	// {time, centroid, spread, flux, rolloff, odd/even, attack}
+	draw(features) {
 		// rectMode(CORNER);
 		// fill(255);
 		// rect(this.x, this.y, this.w, this.h);
@@ -423,6 +430,16 @@ class FftDisplay {
 		textAlign(LEFT, BOTTOM);
 		textSize(this.titleSize);
 		text('Final Spectrum', this.graphX, this.titleY);
+		
+		// output timbre features
+		if (features !== undefined && features.length >= 7) {
+			textAlign(RIGHT, BOTTOM);
+			textSize(this.featSize);
+			text('Centroid ' + features[1].toFixed(0) + ' Hz  Rolloff ' + features[4].toFixed(0) + ' Hz  Flux ' + features[3].toFixed(2),
+				this.featX, this.titleY - 1.2*this.featSize);
+			text('Odd/Even ' + features[5].toFixed(1) + ' dB  Attack ' + (1000*features[6]).toFixed(0) + ' ms',
+				this.featX, this.titleY);
+		}
 		stroke(0);
 	}
 }
@@ -474,10 +491,16 @@ class OtherControls {
 		this.pitchX = this.x + 0.2*this.w;
 		this.pitchY = this.y + 0.3*this.h;
 		this.velY = this.y + 0.45*this.h;
+		
+		// CPU governor readout, between the MIDI info and the advanced button
+		this.govSize = 0.045 * this.w;
+		this.govY = this.y + 0.5*this.h;
 	}
 	
 	// input is a 2-element array of the note and velocity info from Bela
-	draw(midiInfo) {
+	// and the CPU governor buffer {load, level, tier, stride, voices, then time,
+	// load, from, to, reason of the latest decisions}
+	draw(midiInfo, governor) {
 		// rectMode(CORNER);
 		// fill(255);
 		// rect(this.x, this.y, this.w, this.h);
@@ -509,6 +532,18 @@ class OtherControls {
 		textSize(this.txtSize);
 		text('Note: ' + note, this.pitchX, this.pitchY);
 		text('Velocity: ' + vel, this.pitchX, this.velY);
+		
+		// CPU governor state and its last decision
+		if (governor !== undefined && governor.length >= 10) {
+			const tiers = ['eco', 'low', 'standard', 'high', 'ultra'];
+			const reasons = ['high load', 'panic', 'low load'];
+			textSize(this.govSize);
+			text('CPU ' + (100*governor[0]).toFixed(0) + '%  level ' + governor[1] + '  quality ' + tiers[governor[2]] +
+				'  analysis 1/' + governor[3] + '  voices ' + governor[4], this.pitchX, this.govY);
+			if (governor[9] >= 0)
+				text(governor[5].toFixed(1) + ' s: ' + reasons[governor[9]] + ' ' + (100*governor[6]).toFixed(0) + '%, level ' +
+					governor[7] + ' to ' + governor[8], this.pitchX, this.govY + 1.3*this.govSize);
+		}
 		stroke(0);
 		
 		// Add BELA logo
@@ -520,8 +555,8 @@ class OtherControls {
 class AdvControls {
 	// inputs are algorthm dropdown menu, array of frequency ratio input text boxes, array of amplitude input text boxes
 	// array of waveshape dropdown menus, update spectrum button, brightness checkbox, brightness slider, articulation slider
-	// and array of sliders for decay, sustain, and release
-	constructor(algSelectIn, fRatiosIn, ampsIn, shapesIn, specButtonIn, brigButton, brigQSlider, artiQSliderIn, dsrSlidersIn) {
+	// array of sliders for decay, sustain, and release and array of curve menus for attack, decay and release
+	constructor(algSelectIn, fRatiosIn, ampsIn, shapesIn, specButtonIn, brigButton, brigQSlider, artiQSliderIn, dsrSlidersIn, curveSelectsIn) {
 		// algorithm select setup
 		this.algSelect = algSelectIn;
 		this.algSelect.option('Additive', 0);
@@ -548,6 +583,12 @@ class AdvControls {
 		this.brigQSlider = brigQSlider;
 		this.artiQSlider = artiQSliderIn;
 		this.dsrSliders = dsrSlidersIn;
+		this.curveSelects = curveSelectsIn;
+		// setup options for curve menus, the values are the ADSR curves in adsr.h
+		for (let i = 0; i < 3; i++) {
+			this.curveSelects[i].option('Linear', 0);
+			this.curveSelects[i].option('Exponential', 1);
+		}
 		
 		// set advMode to 1 and then toggle it off to hide elements
 		this.advMode = 1;
@@ -636,7 +677,14 @@ class AdvControls {
 			this.dsrSlideY[i] = 0.2*(i+1)*this.h + this.y;
 			this.dsrSlideLblY[i] = this.dsrSlideY[i] - 0.08*this.h;
 			this.dsrSliders[i].position(this.dsrSlideX, this.dsrSlideY[i]);
-			this.dsrSliders[i].size(0.2*this.w, 0.1*this.h);
+			this.dsrSliders[i].size(0.13*this.w, 0.1*this.h);
+		}
+		// attack curve in the top row, decay and release curves beside their sliders
+		this.curveX = 0.90*this.w;
+		this.curveY = [this.y + 0.05*this.h, this.dsrSlideY[0], this.dsrSlideY[2]];
+		for (let i = 0; i < 3; i++) {
+			this.curveSelects[i].position(this.curveX, this.curveY[i]);
+			this.curveSelects[i].size(0.09*this.w, 0.1*this.h);
 		}
 	}
 	draw() {
@@ -764,6 +812,8 @@ class AdvControls {
 			text('Decay', this.dsrSlideX, this.dsrSlideLblY[0]);
 			text('Sustain', this.dsrSlideX, this.dsrSlideLblY[1]);
 			text('Release', this.dsrSlideX, this.dsrSlideLblY[2]);
+			textAlign(RIGHT, TOP);
+			text('Attack', this.curveX - 0.01*this.w, this.curveY[0]);
 		}
 		//end of hidden/shown advanced control elements
 		
@@ -778,6 +828,8 @@ class AdvControls {
 		buffer[3] = this.artiQSlider.value();
 		for (let i = 0; i < 3; i++)
 			buffer[i+4] = this.dsrSliders[i].value();
+		for (let i = 0; i < 3; i++)
+			buffer[i+7] = this.curveSelects[i].value();
 		// always send advanced mode buffer
 		// (0th element, advanced mode, will determine if it has any effect)
 		// advanced mode buffer index is 1, as determined by initialization order in render.cpp's setup()
@@ -828,6 +880,7 @@ class AdvControls {
 			this.artiQSlider.hide();
 			for (let i = 0; i < 3; i++) {
 				this.dsrSliders[i].hide();
+				this.curveSelects[i].hide();
 			}
 		}
 		// if currently not in advanced mode, turn on and show all elements
@@ -846,6 +899,7 @@ class AdvControls {
 			this.artiQSlider.show();
 			for (let i = 0; i < 3; i++) {
 				this.dsrSliders[i].show();
+				this.curveSelects[i].show();
 			}
 		}
 	}
@@ -930,7 +984,10 @@ function setup() {
 	dsrSliders[1] = createSlider(0, 1, 0.9, 0.01);
 	//release
 	dsrSliders[2] = createSlider(0, 0.3, 0.1, 0.01);
-	advControls = new AdvControls(algSelect, fRatios, amps, shapes, specButton, brightLinkButton, brightQSlider, artiQSlider, dsrSliders);
+	// attack, decay and release curves
+	for (let i = 0; i < 3; i++)
+		curveSelects[i] = createSelect();
+	advControls = new AdvControls(algSelect, fRatios, amps, shapes, specButton, brightLinkButton, brightQSlider, artiQSlider, dsrSliders, curveSelects);
 	
 	windowResized();
 }
@@ -941,8 +998,8 @@ function draw() {
 	// draw objects
 	space.draw();
 	blk.draw();
-	fft.draw();
-	other.draw(Bela.data.buffers[1]);
+	fft.draw(Bela.data.buffers[11]);
+	other.draw(Bela.data.buffers[1], Bela.data.buffers[12]);
 	advControls.draw();
 
 	// Retrieve data from BELA =========================================
@@ -975,6 +1032,7 @@ function draw() {
 	enveIn.value(timbreDim[3]);
 
 	// draw graphs
+	// both FFT graphs arrive as log-spaced bands, so their x axis is log frequency
 	draw.spfftGraph = Bela.data.buffers[2];
 	specGraph.setData(draw.spfftGraph);
 	draw.frfGraph = Bela.data.buffers[3];
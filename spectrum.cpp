@@ -1,5 +1,6 @@
 /***** spectrum.cpp *****/
 #include "spectrum.h"
+#include <cmath>
 
 // Default constructor
 Spectrum::Spectrum() : Spectrum(44100.0, 440.0) {}
@@ -16,8 +17,28 @@ fmSynth_(sampleRate, frequency)
 	fmAlg_ = kFmConfigAdd;
 	updateFmGui_ = 1;
 	
-	// default spectrum value
-	spectrum_ = MAX_SPECTRUM / 2;
+	bakeEnabled_ = false;
+	bakeRequested_ = false;
+	stableSamples_ = 0;
+	interpolation_ = kInterpLinear;
+	tableSize_ = WAVETABLE_SIZE;
+	bandLimited_ = false;
+	cyclePhase_ = 0;
+	bakeMix_ = 0;
+	bakeFade_ = 0;
+	bakeDelay_ = SPECTRUM_BAKE_DELAY * sampleRate_;
+	bakeMixStep_ = 1.0 / (SPECTRUM_BAKE_FADE * sampleRate_);
+	cycleIncr_ = frequency_ / sampleRate_;
+	for (int i = 0; i < NUM_OPERATORS; i++)
+	{
+		bakePhases_[i] = 0;
+		bakeLastOutputs_[i] = 0;
+		bakeRatios_[i] = 0;
+	}
+	
+	// default spectrum value, built here so that its vectors are allocated
+	// before any update from the audio thread (they are reassigned in place)
+	spectrum_ = -1;
 	updateSpectrum(MAX_SPECTRUM / 2);
 }
 
@@ -26,11 +47,16 @@ void Spectrum::setSampleRate(float frequency)
 {
 	sampleRate_ = frequency;
 	fmSynth_.setSampleRate(sampleRate_);
+	bakeDelay_ = SPECTRUM_BAKE_DELAY * sampleRate_;
+	bakeMixStep_ = 1.0 / (SPECTRUM_BAKE_FADE * sampleRate_);
+	cycleIncr_ = frequency_ / sampleRate_;
+	parametersChanged();
 }
 
 // reset FreqMod object and its operators
 void Spectrum::reset()
 {
+	parametersChanged();
 	fmSynth_.reset();
 }
 
@@ -79,6 +105,7 @@ void Spectrum::updateAdvSpectrum(float* fmBuffer)
 	
 	// update freqMod object
 	fmSynth_.setSpectrum(amps_, fRatios_, opWaves_);
+	parametersChanged();
 }
 
 // Update FreqMod object based on new spectrum value
@@ -92,6 +119,7 @@ void Spectrum::updateSpectrum(int spectrum)
 	// by default behavior, the algorithm is always additive synthesis
 	fmAlg_ = kFmConfigAdd;
 	updateFmGui_ = 1;
+	parametersChanged();
 		
 	// All harmonics + Noise
 	// TBA? ;)
@@ -211,13 +239,154 @@ void Spectrum::setFrequency(float frequency)
 		return;
 	frequency_ = frequency;
 	fmSynth_.setFrequency(frequency_);
-	
+	cycleIncr_ = frequency_ / sampleRate_;
+	parametersChanged();
+}
+
+// Set the number of samples parameter changes glide over
+void Spectrum::setRampLength(int samples)
+{
+	fmSynth_.setRampLength(samples);
+}
+
+// Set operator interpolation, table size and band-limiting
+void Spectrum::setQuality(int interpolation, int tableSize, bool bandLimited, bool fade)
+{
+	fmSynth_.setQuality(interpolation, tableSize, bandLimited, fade);
+	if (interpolation == interpolation_ && tableSize == tableSize_ && bandLimited == bandLimited_)
+		return;
+	interpolation_ = interpolation;
+	tableSize_ = tableSize;
+	bandLimited_ = bandLimited;
+	// a cycle of the old tables that isn't playing yet is baked again
+	if (bakeRequested_ && bakeMix_ == 0 && bakeFade_ == 0)
+	{
+		bakeRequested_ = false;
+		baker_.cancel();
+	}
 }
 
 // get next signal value to play
+// operators, table or a crossfade between them
 float Spectrum::process()
 {
-	return fmSynth_.process();
+	if (!bakeEnabled_)
+		return fmSynth_.process();
+	
+	// once the parameters have settled, ask for a baked cycle
+	if (stableSamples_ < bakeDelay_)
+		stableSamples_++;
+	else if (!bakeRequested_)
+		bakeRequested_ = requestBake();
+	// fade to the table as soon as it is ready
+	if (bakeFade_ == 0 && bakeMix_ == 0 && bakeRequested_ && baker_.start())
+		bakeFade_ = 1;
+	
+	// the operators are only run while they can be heard or fade back in
+	float out = 0;
+	if (bakeMix_ < 1 || bakeFade_ < 0)
+		out = (1 - bakeMix_) * fmSynth_.process();
+	if (bakeMix_ > 0)
+		out += bakeMix_ * baker_.read(cyclePhase_);
+	cyclePhase_ += cycleIncr_;
+	if (cyclePhase_ >= 1)
+		cyclePhase_ -= 1;
+	
+	if (bakeFade_ != 0)
+	{
+		bakeMix_ += bakeFade_ * bakeMixStep_;
+		if (bakeMix_ >= 1)
+		{
+			bakeMix_ = 1;
+			bakeFade_ = 0;
+		}
+		else if (bakeMix_ <= 0)
+		{
+			bakeMix_ = 0;
+			bakeFade_ = 0;
+			baker_.stop();
+		}
+	}
+	return out;
+}
+
+// CALL IN SETUP
+void Spectrum::enableBaking(bool enable)
+{
+	if (enable)
+		baker_.setup();
+	bakeEnabled_ = enable;
+	parametersChanged();
+}
+
+bool Spectrum::isBakeRequested()
+{
+	return bakeEnabled_ && baker_.isRequested();
+}
+
+void Spectrum::bake()
+{
+	baker_.bake();
+}
+
+bool Spectrum::isBaked()
+{
+	return bakeMix_ == 1;
+}
+
+// restart the wait for stable parameters and leave the table
+// the operators are stopped while the table plays alone, so they are first
+// moved on to the table's position in the cycle. With whole number ratios an
+// operator's phase there is its phase at the request plus its ratio times the
+// cycles since. Keeping the previous outputs of the request makes the next
+// modulation step add what the modulators moved the carriers by since then.
+void Spectrum::parametersChanged()
+{
+	stableSamples_ = 0;
+	bakeRequested_ = false;
+	baker_.cancel();
+	if (bakeMix_ == 1 && bakeFade_ == 0)
+	{
+		// the next output steps the operators to cyclePhase_
+		float cycles = cyclePhase_ - cycleIncr_;
+		float phases[NUM_OPERATORS];
+		for (int i = 0; i < NUM_OPERATORS; i++)
+		{
+			phases[i] = bakePhases_[i] + bakeRatios_[i] * cycles;
+			phases[i] -= floorf(phases[i]);
+		}
+		fmSynth_.setState(phases, bakeLastOutputs_);
+	}
+	if (bakeFade_ > 0 || bakeMix_ > 0)
+		bakeFade_ = -1;
+}
+
+// the output repeats every cycle if every sounding operator has a whole number ratio
+bool Spectrum::requestBake()
+{
+	for (int i = 0; i < NUM_OPERATORS; i++)
+		if (amps_[i] != 0 && fRatios_[i] != floorf(fRatios_[i]))
+			return true; // nothing to bake until the parameters change
+	
+	float phases[NUM_OPERATORS];
+	float lastOutputs[NUM_OPERATORS];
+	const float* wavetables[NUM_OPERATORS];
+	fmSynth_.getState(phases, lastOutputs);
+	fmSynth_.getWavetables(wavetables);
+	int numHarmonics = 0.5f * sampleRate_ / frequency_;
+	if (!baker_.request(fmAlg_, amps_, fRatios_, opWaves_, phases, lastOutputs,
+		wavetables, interpolation_, tableSize_, bandLimited_, numHarmonics))
+		return false;
+	// the table starts at the states, the operators step before their output
+	cyclePhase_ = cycleIncr_;
+	// silent operators don't step
+	for (int i = 0; i < NUM_OPERATORS; i++)
+	{
+		bakePhases_[i] = phases[i];
+		bakeLastOutputs_[i] = lastOutputs[i];
+		bakeRatios_[i] = (amps_[i] != 0) ? fRatios_[i] : 0;
+	}
+	return true;
 }
 
 // send current FM algorithm to GUI
@@ -3,10 +3,21 @@
 #define SPECTRUM_H
 
 #include "freqMod.h"
+#include "cycleBaker.h"
 #include <libraries/Gui/Gui.h>
 #include <vector>
 
 #define MAX_SPECTRUM 256
+// size of the advanced spectrum buffer from the GUI
+#define ADV_SPECTRUM_SIZE (2 + 3 * NUM_OPERATORS)
+
+// static spectra with whole number ratios are baked into one cycle and played
+// from a table, crossfading back to the operators when the parameters change
+//------------ CHANGE SPECTRUM BAKING HERE -----------------
+#define SPECTRUM_BAKE 1 // 0 to always run the operators
+#define SPECTRUM_BAKE_DELAY 0.05f // seconds the parameters must be unchanged before baking
+#define SPECTRUM_BAKE_FADE 0.01f // crossfade time between operators and table (seconds)
+//------------ CHANGE SPECTRUM BAKING HERE -----------------
 
 class Spectrum
 {
@@ -28,6 +39,8 @@ public:
 	void setAdvMode(bool advMode);
 	
 	// update FM spectrum based on buffer from GUI (advanced mode)
+	// ADV_SPECTRUM_SIZE values: changed flag, algorithm, then ratio, amplitude
+	// and shape of each operator
 	void updateAdvSpectrum(float* fmBuffer);
 	
 	// Update FeqMod object based on Spectrum value
@@ -36,9 +49,27 @@ public:
 	// Set fundamental frequency of spectrum
 	void setFrequency(float frequency);
 	
+	// operator amplitudes and frequencies glide to new spectra and frequencies
+	// over this many samples (0 to jump, see FreqMod::setRampLength)
+	void setRampLength(int samples);
+	
 	// Retrieve next signal value
 	float process();
 	
+	// Set how the operators read their wavetables (see Operator::setQuality)
+	// tables are baked from the same wavetables, a baked table keeps playing
+	// at the quality it was baked with
+	void setQuality(int interpolation, int tableSize, bool bandLimited, bool fade);
+	
+	// allow this spectrum to be baked (CALL IN SETUP, allocates the baker)
+	void enableBaking(bool enable);
+	// whether a baked cycle has been requested (check every block, schedule the bake task)
+	bool isBakeRequested();
+	// bake the requested cycle (bake task)
+	void bake();
+	// whether the table is playing instead of the operators
+	bool isBaked();
+	
 	//send FM information to GUI
 	void sendAlg(Gui& gui, int bufferId);
 	void sendRatios(Gui& gui, int bufferId);
@@ -63,6 +94,31 @@ private:
 	std::vector<int> opWaves_;
 	// whether or not to update the FmGui, 1 for yes, 0 for no
 	int updateFmGui_;
+	
+	// the parameters changed, go back to the operators
+	void parametersChanged();
+	// request a cycle of the current parameters, returns false if the baker is busy
+	bool requestBake();
+	
+	// single cycle baking
+	CycleBaker baker_;
+	bool bakeEnabled_;
+	bool bakeRequested_; // current parameters were requested, or can not be baked
+	int stableSamples_; // samples since the parameters changed (up to bakeDelay_)
+	int bakeDelay_; // samples the parameters must be stable for
+	// wavetable quality of the operators, cycles are baked from the same tables
+	int interpolation_, tableSize_;
+	bool bandLimited_;
+	float cyclePhase_; // position in the cycle (0 to 1) from the operator states of the last request
+	float cycleIncr_; // cycles per sample
+	// operator states and ratios (0 if silent) of the last request, to bring the
+	// operators back in phase with the table after playing it alone
+	float bakePhases_[NUM_OPERATORS];
+	float bakeLastOutputs_[NUM_OPERATORS];
+	float bakeRatios_[NUM_OPERATORS];
+	float bakeMix_; // 0 for operators, 1 for table
+	float bakeMixStep_; // change of bakeMix_ per sample while fading
+	int bakeFade_; // 1 fading to the table, -1 fading to the operators, 0 not fading
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,85 @@
+/***** stageProfiler.cpp *****/
+#include <Bela.h>
+#include "stageProfiler.h"
+
+// names printed in the report, in profilerStages order
+static const char* const kStageNames[kNumProfilerStages] = {
+	"midi", "control", "envelope", "spectrum", "brightness", "articulation", "fftRing", "spectrumFft"
+};
+
+StageCounters StageProfiler::counters_[PROFILER_MAX_THREADS] = {};
+std::atomic<int> StageProfiler::numThreads_(0);
+
+// return the calling thread's counters, claiming a free slot the first time
+// once every slot is taken a thread gets none, so each counter keeps a single writer
+StageCounters* StageProfiler::threadCounters()
+{
+	static thread_local int slot = -1;
+	if (slot == -1)
+	{
+		slot = numThreads_.fetch_add(1);
+		if (slot >= PROFILER_MAX_THREADS)
+			slot = PROFILER_MAX_THREADS; // no slot, not profiled
+	}
+	return slot < PROFILER_MAX_THREADS ? &counters_[slot] : nullptr;
+}
+
+// single writer per counter, so a relaxed load/store pair is enough
+void StageProfiler::add(int stage, uint64_t ticks)
+{
+	StageCounters* counters = threadCounters();
+	if (!counters)
+		return;
+	counters->ticks[stage].store(counters->ticks[stage].load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+	counters->calls[stage].store(counters->calls[stage].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// print ticks per call and share of the total for every stage since the last report
+void StageProfiler::report()
+{
+	// totals at the time of the previous report (only ever called from one task)
+	static uint64_t lastTicks[kNumProfilerStages] = {0};
+	static uint64_t lastCalls[kNumProfilerStages] = {0};
+
+	uint64_t ticks[kNumProfilerStages] = {0};
+	uint64_t calls[kNumProfilerStages] = {0};
+	int numThreads = numThreads_.load();
+	int unprofiledThreads = 0;
+	if (numThreads > PROFILER_MAX_THREADS)
+	{
+		unprofiledThreads = numThreads - PROFILER_MAX_THREADS;
+		numThreads = PROFILER_MAX_THREADS;
+	}
+
+	// sum the counters of every thread
+	for (int t = 0; t < numThreads; t++)
+		for (int s = 0; s < kNumProfilerStages; s++)
+		{
+			ticks[s] += counters_[t].ticks[s].load(std::memory_order_relaxed);
+			calls[s] += counters_[t].calls[s].load(std::memory_order_relaxed);
+		}
+
+	// deltas since last report
+	uint64_t totalTicks = 0;
+	for (int s = 0; s < kNumProfilerStages; s++)
+	{
+		uint64_t t = ticks[s];
+		uint64_t c = calls[s];
+		ticks[s] -= lastTicks[s];
+		calls[s] -= lastCalls[s];
+		lastTicks[s] = t;
+		lastCalls[s] = c;
+		totalTicks += ticks[s];
+	}
+	if (totalTicks == 0)
+		return;
+
+	rt_printf("Stage profile (%d thread(s)):\n", numThreads);
+	if (unprofiledThreads > 0)
+		rt_printf("  %d more thread(s) not profiled, raise PROFILER_MAX_THREADS\n", unprofiledThreads);
+	for (int s = 0; s < kNumProfilerStages; s++)
+	{
+		float perCall = calls[s] ? float(ticks[s]) / float(calls[s]) : 0;
+		rt_printf("  %-12s %10.1f ticks/call %5.1f%%\n", kStageNames[s], perCall, 100.0f * ticks[s] / totalTicks);
+	}
+}
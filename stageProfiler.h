@@ -0,0 +1,102 @@
+/***** stageProfiler.h *****/
+// Per-stage cycle counters for the Note signal chain
+// Set STAGE_PROFILING to 1 to time each stage of Note::process. When it is 0
+// the PROFILE_STAGE macro expands to nothing and there is no runtime cost.
+#ifndef STAGEPROFILER_H
+#define STAGEPROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+//------------ ENABLE PROFILING HERE -----------------
+#define STAGE_PROFILING 0
+// Cortex-A8 cycle counter (needs user access to the PMU enabled by a kernel
+// module, otherwise reading it is an illegal instruction). Off = monotonic clock
+#define STAGE_PROFILING_ARM_PMU 0
+//------------ ENABLE PROFILING HERE -----------------
+
+// maximum number of threads that can own a set of counters, threads after
+// these are not profiled (the report says how many)
+#define PROFILER_MAX_THREADS 8
+
+// enumerator to index profiled stages
+enum profilerStages {
+	kStageMidi = 0,
+	kStageControl,
+	kStageEnvelope,
+	kStageSpectrum,
+	kStageBrightness,
+	kStageArticulation,
+	kStageFftRing,
+	kStageSpectrumFft, // fixed frequency spectrum rendered for its FFT
+	kNumProfilerStages
+};
+
+// read a free running tick counter (cycles where available, nanoseconds otherwise)
+static inline uint64_t readCycleCounter()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__arm__) && STAGE_PROFILING_ARM_PMU
+	uint32_t cycles;
+	asm volatile("mrc p15, 0, %0, c9, c13, 0" : "=r"(cycles));
+	return cycles;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+// Counters owned by a single thread. Only the owning thread writes them, other
+// threads only read, so no locked operations are needed on the hot path.
+struct StageCounters {
+	std::atomic<uint64_t> ticks[kNumProfilerStages];
+	std::atomic<uint64_t> calls[kNumProfilerStages];
+};
+
+class StageProfiler
+{
+public:
+	// add elapsed ticks to the calling thread's counter for a stage
+	static void add(int stage, uint64_t ticks);
+
+	// aggregate all threads' counters and print the per-stage breakdown since
+	// the last report. Call from an auxiliary task, never from the audio thread
+	static void report();
+
+private:
+	// counters of the calling thread (claims a slot on first use), nullptr if
+	// every slot was taken
+	static StageCounters* threadCounters();
+
+	static StageCounters counters_[PROFILER_MAX_THREADS];
+	static std::atomic<int> numThreads_; // threads that asked for a slot, with or without one
+};
+
+// RAII timer, accumulates the ticks spent in its scope into a stage counter
+class ScopedStageTimer
+{
+public:
+	ScopedStageTimer(int stage) : stage_(stage), start_(readCycleCounter()) {}
+	~ScopedStageTimer() { StageProfiler::add(stage_, readCycleCounter() - start_); }
+
+private:
+	int stage_;
+	uint64_t start_;
+};
+
+// Time the rest of the enclosing scope as the given stage
+#if STAGE_PROFILING
+#define PROFILE_STAGE_CONCAT_(a, b) a##b
+#define PROFILE_STAGE_NAME_(line) PROFILE_STAGE_CONCAT_(stageTimer_, line)
+#define PROFILE_STAGE(stage) ScopedStageTimer PROFILE_STAGE_NAME_(__LINE__)(stage)
+#else
+#define PROFILE_STAGE(stage)
+#endif
+
+#endif
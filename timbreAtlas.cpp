@@ -0,0 +1,358 @@
+/***** timbreAtlas.cpp *****/
+#include <Bela.h>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "timbreAtlas.h"
+#include "note.h"
+#include "denormals.h"
+
+// samples rendered by the note at a time
+static constexpr int kAtlasBlockSize = 64;
+
+AtlasFile::AtlasFile()
+{
+	map_ = nullptr;
+	size_ = 0;
+	header_ = nullptr;
+	points_ = nullptr;
+	snippets_ = nullptr;
+}
+
+AtlasFile::~AtlasFile()
+{
+	close();
+}
+
+size_t AtlasFile::fileSize(const AtlasHeader& header)
+{
+	return sizeof(AtlasHeader) + (size_t) header.numPoints * sizeof(AtlasPoint)
+		+ (size_t) header.numPoints * header.snippetSamples * sizeof(int16_t);
+}
+
+bool AtlasFile::map(int fd, size_t size, bool writable)
+{
+	int protection = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+	void* address = mmap(nullptr, size, protection, MAP_SHARED, fd, 0);
+	if (address == MAP_FAILED)
+		return false;
+	map_ = address;
+	size_ = size;
+	header_ = (AtlasHeader*) map_;
+	points_ = (AtlasPoint*) ((char*) map_ + sizeof(AtlasHeader));
+	snippets_ = header_->snippetSamples ? (int16_t*) (points_ + header_->numPoints) : nullptr;
+	return true;
+}
+
+bool AtlasFile::create(const char* path, const AtlasHeader& header)
+{
+	close();
+	size_t size = fileSize(header);
+	int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		return false;
+	
+	// resume if the file holds the same atlas
+	struct stat st;
+	bool resume = false;
+	if (fstat(fd, &st) == 0 && (size_t) st.st_size == size)
+	{
+		AtlasHeader existing;
+		resume = (pread(fd, &existing, sizeof(existing), 0) == sizeof(existing)
+			&& memcmp(&existing, &header, sizeof(header)) == 0);
+	}
+	if (!resume && (ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0))
+	{
+		::close(fd);
+		return false;
+	}
+	bool mapped = map(fd, size, true);
+	::close(fd);
+	if (!mapped)
+		return false;
+	if (!resume)
+	{
+		// new file is zero filled: write the header, every point is not done
+		memcpy(header_, &header, sizeof(header));
+		// snippets_ was worked out from the zeroed header
+		snippets_ = header_->snippetSamples ? (int16_t*) (points_ + header_->numPoints) : nullptr;
+	}
+	return true;
+}
+
+bool AtlasFile::open(const char* path)
+{
+	close();
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	AtlasHeader header, current;
+	bool valid = (fstat(fd, &st) == 0
+		&& pread(fd, &header, sizeof(header), 0) == sizeof(header)
+		&& strncmp(header.magic, ATLAS_MAGIC, sizeof(header.magic)) == 0
+		&& header.version == ATLAS_VERSION
+		&& header.headerSize == sizeof(AtlasHeader)
+		&& header.pointSize == sizeof(AtlasPoint)
+		&& header.numFeatures == kNumFeatures
+		&& (size_t) st.st_size == fileSize(header));
+	if (valid)
+	{
+		// features measured another way do not compare with the current ones
+		current = header;
+		setAtlasAnalysis(current);
+		valid = (memcmp(&current, &header, sizeof(header)) == 0);
+	}
+	bool mapped = valid && map(fd, st.st_size, false);
+	::close(fd);
+	return mapped;
+}
+
+void AtlasFile::close()
+{
+	if (map_)
+		munmap(map_, size_);
+	map_ = nullptr;
+	size_ = 0;
+	header_ = nullptr;
+	points_ = nullptr;
+	snippets_ = nullptr;
+}
+
+void AtlasFile::sync()
+{
+	if (map_)
+		msync(map_, size_, MS_ASYNC);
+}
+
+int16_t* AtlasFile::getSnippet(int index)
+{
+	if (!snippets_)
+		return nullptr;
+	return snippets_ + (size_t) index * header_->snippetSamples;
+}
+
+int atlasGridValue(int step, int gridSteps, int maxValue)
+{
+	if (gridSteps < 2)
+		return maxValue / 2;
+	return int(step * (maxValue - 1) / float(gridSteps - 1) + 0.5f);
+}
+
+void setAtlasAnalysis(AtlasHeader& header)
+{
+	header.fftSize = FFT_BUFFER_N;
+	header.hopSize = FFT_HOP_SIZE;
+	header.rolloff = FEATURE_ROLLOFF;
+	header.onsetDb = FEATURE_ONSET_DB;
+	header.attackLow = FEATURE_ATTACK_LOW;
+	header.attackHigh = FEATURE_ATTACK_HIGH;
+	header.attackHold = FEATURE_ATTACK_HOLD;
+	header.attackMaxTime = FEATURE_ATTACK_MAX_TIME;
+	header.oddEvenMaxDb = FEATURE_ODD_EVEN_MAX_DB;
+}
+
+// Rendering ===================================================================
+
+void measureAtlasFeatures(FftAnalyzer& analyzer, FeatureExtractor& extractor,
+	const float* samples, int numSamples, float sampleRate, float fundamental, float* features)
+{
+	analyzer.setup(sampleRate, kFftModeSnapshot, FFT_HOP_SIZE, FFT_HOP_SIZE);
+	extractor.setup(sampleRate, FFT_BUFFER_N, FFT_HOP_SIZE);
+	
+	// sums of the features of sounding frames
+	double sums[kNumFeatures] = {0};
+	int soundingFrames = 0;
+	for (int n = 0; n < numSamples; n++)
+	{
+		analyzer.push(samples[n]);
+		if (!analyzer.isReady())
+			continue;
+		analyzer.process();
+		extractor.process(analyzer.getFramePower(), fundamental, analyzer.getFrameHop());
+		if (extractor.isSounding())
+		{
+			const float* frameFeatures = extractor.getFeatures();
+			for (int i = 0; i < kNumFeatures; i++)
+				sums[i] += frameFeatures[i];
+			soundingFrames++;
+		}
+	}
+	
+	for (int i = 0; i < kNumFeatures; i++)
+		features[i] = soundingFrames ? float(sums[i] / soundingFrames) : 0;
+	features[kFeatureAttack] = extractor.getFeatures()[kFeatureAttack];
+	features[kFeatureTime] = soundingFrames * FFT_HOP_SIZE / sampleRate;
+}
+
+// everything one worker thread needs to render points
+struct AtlasWorker {
+	std::unique_ptr<Note> note;
+	FftAnalyzer analyzer;
+	FeatureExtractor extractor;
+	std::vector<float> output; // the point's held and released note
+};
+
+// play one point and store its features (and snippet)
+static void renderAtlasPoint(AtlasWorker& worker, const AtlasHeader& header, AtlasPoint& point, int16_t* snippet)
+{
+	Note& note = *worker.note;
+	note.setSpectrum(point.timbre[0]);
+	note.setBrightness(point.timbre[1]);
+	note.setArticulation(point.timbre[2]);
+	note.setEnvelope(point.timbre[3]);
+	
+	// hold, then release for the rest of the output
+	int onSamples = int(header.noteOnTime * header.sampleRate);
+	int numSamples = worker.output.size();
+	note.triggerNote(point.note, header.velocity);
+	for (int start = 0; start < numSamples; start += kAtlasBlockSize)
+	{
+		if (start >= onSamples && start < onSamples + kAtlasBlockSize)
+			note.triggerNote(point.note, 0);
+		int blockSize = std::min(kAtlasBlockSize, numSamples - start);
+		note.renderBlock(worker.output.data() + start, blockSize);
+	}
+	
+	measureAtlasFeatures(worker.analyzer, worker.extractor, worker.output.data(), numSamples,
+		header.sampleRate, kMidiToFreqTable[point.note], point.features);
+	for (unsigned int n = 0; snippet && n < header.snippetSamples && n < (unsigned int) numSamples; n++)
+		snippet[n] = (int16_t) lrintf(fminf(fmaxf(worker.output[n], -1.0f), 1.0f) * 32767.0f);
+	
+	// let the release finish so the next point starts from silence
+	float tail[kAtlasBlockSize];
+	int maxTailBlocks = int(ATLAS_MAX_TAIL_TIME * header.sampleRate) / kAtlasBlockSize;
+	for (int b = 0; b < maxTailBlocks && !note.isIdle(); b++)
+		note.renderBlock(tail, kAtlasBlockSize);
+	
+	point.done = 1;
+}
+
+void runTimbreAtlas(float sampleRate)
+{
+	const int notes[] = ATLAS_NOTES;
+	const int numNotes = sizeof(notes) / sizeof(notes[0]);
+	static_assert(sizeof(notes) / sizeof(notes[0]) <= ATLAS_MAX_NOTES, "too many ATLAS_NOTES");
+	const int steps = ATLAS_GRID_STEPS;
+	
+	AtlasHeader header;
+	memset(&header, 0, sizeof(header));
+	strncpy(header.magic, ATLAS_MAGIC, sizeof(header.magic));
+	header.version = ATLAS_VERSION;
+	header.headerSize = sizeof(AtlasHeader);
+	header.pointSize = sizeof(AtlasPoint);
+	header.numPoints = steps * steps * steps * steps * numNotes;
+	header.gridSteps = steps;
+	header.numNotes = numNotes;
+	for (int i = 0; i < numNotes; i++)
+		header.notes[i] = notes[i];
+	header.velocity = ATLAS_VELOCITY;
+	header.numFeatures = kNumFeatures;
+	header.snippetSamples = ATLAS_SNIPPET_SAMPLES;
+	header.sampleRate = sampleRate;
+	header.noteOnTime = ATLAS_NOTE_ON_TIME;
+	header.releaseTime = ATLAS_RELEASE_TIME;
+	setAtlasAnalysis(header);
+	
+	AtlasFile file;
+	if (!file.create(ATLAS_FILE, header))
+	{
+		rt_printf("Timbre atlas: unable to map %s\n", ATLAS_FILE);
+		return;
+	}
+	
+	// list the points still to render, filling in the grid of new points
+	AtlasPoint* points = file.getPoints();
+	std::vector<int> todo;
+	int index = 0;
+	for (int sp = 0; sp < steps; sp++)
+		for (int br = 0; br < steps; br++)
+			for (int ar = 0; ar < steps; ar++)
+				for (int en = 0; en < steps; en++)
+					for (int n = 0; n < numNotes; n++, index++)
+					{
+						AtlasPoint& point = points[index];
+						if (point.done)
+							continue;
+						point.timbre[0] = atlasGridValue(sp, steps, MAX_SPECTRUM);
+						point.timbre[1] = atlasGridValue(br, steps, MAX_BRIGHTNESS);
+						point.timbre[2] = atlasGridValue(ar, steps, MAX_ARTICULATION);
+						point.timbre[3] = atlasGridValue(en, steps, MAX_ENVELOPE);
+						point.note = notes[n];
+						todo.push_back(index);
+					}
+	int numTodo = todo.size();
+	rt_printf("Timbre atlas: %d points, %d already rendered\n", header.numPoints, header.numPoints - numTodo);
+	if (numTodo == 0)
+		return;
+	
+	int numThreads = ATLAS_THREADS > 0 ? ATLAS_THREADS : std::thread::hardware_concurrency();
+	if (numThreads < 1)
+		numThreads = 1;
+	if (numThreads > numTodo)
+		numThreads = numTodo;
+	
+	// notes are made here: the first one builds the shared coefficient cache.
+	// Points are measured from the rendered output, the notes' own FFTs are off
+	std::vector<AtlasWorker> workers(numThreads);
+	int numSamples = int(header.noteOnTime * sampleRate) + int(header.releaseTime * sampleRate);
+	for (auto& worker : workers)
+	{
+		worker.note.reset(new Note(sampleRate, 440.0));
+		worker.note->setAnalyzed(false);
+		worker.output.resize(numSamples);
+	}
+	
+	// work stealing over the todo list: each thread starts on its own share
+	// and, once that is finished, takes points from the other shares
+	std::vector<std::atomic<int>> next(numThreads);
+	std::vector<int> end(numThreads);
+	for (int t = 0; t < numThreads; t++)
+	{
+		next[t] = (long long) numTodo * t / numThreads;
+		end[t] = (long long) numTodo * (t + 1) / numThreads;
+	}
+	std::atomic<int> completed(0);
+	auto workerLoop = [&](int t) {
+		ensureFlushToZero();
+		for (int k = 0; k < numThreads; k++)
+		{
+			int share = (t + k) % numThreads;
+			for (int i = next[share]++; i < end[share]; i = next[share]++)
+			{
+				int p = todo[i];
+				renderAtlasPoint(workers[t], header, points[p], file.getSnippet(p));
+				completed++;
+			}
+		}
+	};
+	
+	auto startTime = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (int t = 0; t < numThreads; t++)
+		threads.emplace_back(workerLoop, t);
+	// report progress and write back rendered points every few seconds
+	while (completed < numTodo)
+	{
+		for (int i = 0; i < 50 && completed < numTodo; i++)
+			usleep(100000);
+		file.sync();
+		rt_printf("Timbre atlas: %d / %d points\n", completed.load(), numTodo);
+	}
+	for (auto& thread : threads)
+		thread.join();
+	file.sync();
+	
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	rt_printf("Timbre atlas: rendered %d points in %.1f s on %d threads, %.1f points/s/thread\n",
+		numTodo, seconds, numThreads, numTodo / seconds / numThreads);
+}
@@ -0,0 +1,134 @@
+/***** timbreAtlas.h *****/
+// Timbre atlas: features of a grid of timbre points, rendered offline
+// Every point of a grid over {spectrum, brightness, articulation, envelope}
+// is played on each of a set of MIDI notes through the Note signal chain, and
+// the output is measured with the same analyzer and feature extractor the GUI
+// uses. Points are rendered on all cores and written straight into a memory
+// mapped file, so a stopped run resumes where it left off and other tools can
+// map the finished atlas without parsing it.
+//
+// File layout (native byte order):
+//     AtlasHeader
+//     AtlasPoint[numPoints]
+//     int16 snippets[numPoints][snippetSamples] (first samples of each point, optional)
+#ifndef TIMBREATLAS_H
+#define TIMBREATLAS_H
+
+#include <cstddef>
+#include <cstdint>
+#include "featureExtractor.h"
+
+//------------ ENABLE TIMBRE ATLAS HERE -----------------
+// render (or resume) the atlas at setup, then carry on as normal
+#define TIMBRE_ATLAS 0
+//------------ ENABLE TIMBRE ATLAS HERE -----------------
+
+//------------ CHANGE TIMBRE ATLAS HERE -----------------
+#define ATLAS_FILE "atlas.bin"
+#define ATLAS_GRID_STEPS 8 // values per timbre dimension
+#define ATLAS_NOTES { 36, 48, 60, 72, 84 } // MIDI notes played at every point
+#define ATLAS_VELOCITY 100
+#define ATLAS_NOTE_ON_TIME 0.5f // seconds held before release
+#define ATLAS_RELEASE_TIME 0.25f // seconds rendered after release
+#define ATLAS_SNIPPET_SAMPLES 0 // audio samples kept per point, 0 for features only
+#define ATLAS_THREADS 0 // worker threads, 0 for one per core
+//------------ CHANGE TIMBRE ATLAS HERE -----------------
+
+#define ATLAS_MAGIC "TSATLAS"
+#define ATLAS_VERSION 2
+#define ATLAS_MAX_NOTES 16
+// longest a released note may take to finish before the next point (seconds)
+#define ATLAS_MAX_TAIL_TIME 10.0f
+
+// describes the grid and everything that changes the stored features
+struct AtlasHeader {
+	char magic[8]; // ATLAS_MAGIC
+	uint32_t version; // ATLAS_VERSION
+	uint32_t headerSize; // sizeof(AtlasHeader)
+	uint32_t pointSize; // sizeof(AtlasPoint)
+	uint32_t numPoints; // gridSteps^4 * numNotes
+	uint32_t gridSteps;
+	uint32_t numNotes;
+	uint32_t notes[ATLAS_MAX_NOTES];
+	uint32_t velocity;
+	uint32_t numFeatures; // kNumFeatures
+	uint32_t snippetSamples;
+	float sampleRate;
+	float noteOnTime;
+	float releaseTime;
+	// analysis settings (see fftAnalyzer.h, note.h and featureExtractor.h)
+	uint32_t fftSize; // FFT_BUFFER_N
+	uint32_t hopSize; // FFT_HOP_SIZE
+	float rolloff; // FEATURE_ROLLOFF
+	float onsetDb; // FEATURE_ONSET_DB
+	float attackLow; // FEATURE_ATTACK_LOW
+	float attackHigh; // FEATURE_ATTACK_HIGH
+	float attackHold; // FEATURE_ATTACK_HOLD
+	float attackMaxTime; // FEATURE_ATTACK_MAX_TIME
+	float oddEvenMaxDb; // FEATURE_ODD_EVEN_MAX_DB
+};
+
+// one rendered (timbre, note) pair
+// features are means over the frames above the onset threshold, except
+// kFeatureAttack (the note's attack time) and kFeatureTime (seconds above the threshold)
+struct AtlasPoint {
+	uint8_t timbre[4]; // spectrum, brightness, articulation, envelope
+	uint8_t note; // MIDI note
+	uint8_t done; // 1 once rendered
+	uint16_t reserved;
+	float features[kNumFeatures];
+};
+
+// memory mapped atlas file
+class AtlasFile
+{
+public:
+	AtlasFile();
+	~AtlasFile();
+	
+	// map a file for writing. An existing file with the same header is resumed,
+	// anything else (another grid, notes or analysis settings) is replaced by a
+	// new file with every point not done
+	bool create(const char* path, const AtlasHeader& header);
+	// map an existing file for reading, if its features were measured with the
+	// current analysis settings
+	bool open(const char* path);
+	// unmap the file
+	void close();
+	// write changed pages back to the file
+	void sync();
+	
+	const AtlasHeader& getHeader() { return *header_; }
+	int getNumPoints() { return header_ ? header_->numPoints : 0; }
+	AtlasPoint* getPoints() { return points_; }
+	// first samples of a point, nullptr if the atlas has no snippets
+	int16_t* getSnippet(int index);
+	
+private:
+	bool map(int fd, size_t size, bool writable);
+	static size_t fileSize(const AtlasHeader& header);
+	
+	void* map_;
+	size_t size_;
+	AtlasHeader* header_;
+	AtlasPoint* points_;
+	int16_t* snippets_;
+};
+
+// grid value of a step along a dimension with maxValue values
+int atlasGridValue(int step, int gridSteps, int maxValue);
+
+// set the analysis settings of a header to the current ones
+void setAtlasAnalysis(AtlasHeader& header);
+
+class FftAnalyzer;
+
+// features of a signal as stored in AtlasPoint, using the given analyzer and extractor
+void measureAtlasFeatures(FftAnalyzer& analyzer, FeatureExtractor& extractor,
+	const float* samples, int numSamples, float sampleRate, float fundamental, float* features);
+
+// render the atlas described by the ATLAS_ defines, resuming a partial run,
+// and print the throughput (dev tool, see TIMBRE_ATLAS)
+void runTimbreAtlas(float sampleRate);
+
+#endif
@@ -0,0 +1,248 @@
+/***** timbreIndex.cpp *****/
+#include <Bela.h>
+#include <libraries/AudioFile/AudioFile.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include "timbreIndex.h"
+#include "fftAnalyzer.h"
+#include "midiTables.h"
+
+// weight of each feature in the search space
+// (time above the onset threshold depends on how long the recording is held)
+static constexpr float kFeatureWeights[kNumFeatures] = {
+	0.0f, // time
+	1.0f, // centroid
+	0.5f, // spread
+	0.5f, // flux
+	1.0f, // rolloff
+	1.0f, // odd/even
+	1.0f // attack
+};
+
+// frequencies are compared on a log scale
+static bool isFrequencyFeature(int feature)
+{
+	return (feature == kFeatureCentroid || feature == kFeatureSpread || feature == kFeatureRolloff);
+}
+
+// max heap order of matches, the worst match on top
+static bool closer(const TimbreMatch& a, const TimbreMatch& b)
+{
+	return a.distance < b.distance;
+}
+
+TimbreIndex::TimbreIndex()
+{
+	points_ = nullptr;
+	for (int i = 0; i < kNumFeatures; i++)
+	{
+		mean_[i] = 0;
+		scale_[i] = 0;
+	}
+}
+
+// log frequencies, then centre, scale and weight
+void TimbreIndex::toKey(const float* features, Key& key)
+{
+	for (int i = 0; i < kNumFeatures; i++)
+	{
+		float value = isFrequencyFeature(i) ? log2f(1.0f + features[i]) : features[i];
+		key.values[i] = (value - mean_[i]) * scale_[i];
+	}
+}
+
+// CALL IN SETUP
+bool TimbreIndex::build(AtlasFile& atlas)
+{
+	points_ = atlas.getPoints();
+	int numPoints = atlas.getNumPoints();
+	
+	// deviation of every (log) feature over the rendered points
+	double sums[kNumFeatures] = {0};
+	double sums2[kNumFeatures] = {0};
+	int numDone = 0;
+	for (int p = 0; p < numPoints; p++)
+	{
+		if (!points_[p].done)
+			continue;
+		for (int i = 0; i < kNumFeatures; i++)
+		{
+			float value = points_[p].features[i];
+			if (isFrequencyFeature(i))
+				value = log2f(1.0f + value);
+			sums[i] += value;
+			sums2[i] += value * value;
+		}
+		numDone++;
+	}
+	if (numDone == 0)
+		return false;
+	for (int i = 0; i < kNumFeatures; i++)
+	{
+		mean_[i] = sums[i] / numDone;
+		float deviation = sqrt(fmax(sums2[i] / numDone - mean_[i] * mean_[i], 0.0));
+		scale_[i] = deviation > 0 ? kFeatureWeights[i] / deviation : 0;
+	}
+	
+	keys_.resize(numPoints);
+	for (int p = 0; p < numPoints; p++)
+		toKey(points_[p].features, keys_[p]);
+	
+	// one tree per note, over the rendered points of that note
+	const AtlasHeader& header = atlas.getHeader();
+	order_.clear();
+	trees_.clear();
+	for (unsigned int n = 0; n < header.numNotes; n++)
+	{
+		Tree tree;
+		tree.note = header.notes[n];
+		tree.begin = order_.size();
+		for (int p = 0; p < numPoints; p++)
+			if (points_[p].done && points_[p].note == tree.note)
+				order_.push_back(p);
+		tree.end = order_.size();
+		if (tree.end > tree.begin)
+			trees_.push_back(tree);
+	}
+	splitDims_.assign(order_.size(), 0);
+	for (auto& tree : trees_)
+		buildNode(tree.begin, tree.end);
+	return true;
+}
+
+void TimbreIndex::buildNode(int begin, int end)
+{
+	if (end - begin < 2)
+		return;
+	// split along the dimension the points spread furthest in
+	float low[kNumFeatures], high[kNumFeatures];
+	for (int i = 0; i < kNumFeatures; i++)
+		low[i] = high[i] = keys_[order_[begin]].values[i];
+	for (int j = begin + 1; j < end; j++)
+		for (int i = 0; i < kNumFeatures; i++)
+		{
+			float value = keys_[order_[j]].values[i];
+			low[i] = fminf(low[i], value);
+			high[i] = fmaxf(high[i], value);
+		}
+	int dim = 0;
+	for (int i = 1; i < kNumFeatures; i++)
+		if (high[i] - low[i] > high[dim] - low[dim])
+			dim = i;
+	
+	int mid = (begin + end) / 2;
+	std::nth_element(order_.begin() + begin, order_.begin() + mid, order_.begin() + end,
+		[&](int a, int b) { return keys_[a].values[dim] < keys_[b].values[dim]; });
+	splitDims_[mid] = dim;
+	buildNode(begin, mid);
+	buildNode(mid + 1, end);
+}
+
+void TimbreIndex::searchNode(int begin, int end, const Key& key, int k, TimbreMatch* results, int& numResults)
+{
+	if (begin >= end)
+		return;
+	int mid = (begin + end) / 2;
+	int point = order_[mid];
+	const Key& nodeKey = keys_[point];
+	
+	// squared distances until the results are sorted
+	float distance = 0;
+	for (int i = 0; i < kNumFeatures; i++)
+	{
+		float difference = key.values[i] - nodeKey.values[i];
+		distance += difference * difference;
+	}
+	if (numResults < k)
+	{
+		results[numResults++] = { point, distance };
+		std::push_heap(results, results + numResults, closer);
+	}
+	else if (distance < results[0].distance)
+	{
+		std::pop_heap(results, results + numResults, closer);
+		results[numResults - 1] = { point, distance };
+		std::push_heap(results, results + numResults, closer);
+	}
+	
+	// near side first, far side only if the splitting plane is within reach
+	int dim = splitDims_[mid];
+	float offset = key.values[dim] - nodeKey.values[dim];
+	bool leftFirst = (offset < 0);
+	searchNode(leftFirst ? begin : mid + 1, leftFirst ? mid : end, key, k, results, numResults);
+	if (numResults < k || offset * offset < results[0].distance)
+		searchNode(leftFirst ? mid + 1 : begin, leftFirst ? end : mid, key, k, results, numResults);
+}
+
+int TimbreIndex::query(const float* features, int noteNumber, int k, TimbreMatch* results)
+{
+	if (trees_.empty() || k < 1)
+		return 0;
+	const Tree* tree = &trees_[0];
+	for (auto& t : trees_)
+		if (abs(t.note - noteNumber) < abs(tree->note - noteNumber))
+			tree = &t;
+	
+	Key key;
+	toKey(features, key);
+	int numResults = 0;
+	searchNode(tree->begin, tree->end, key, k, results, numResults);
+	std::sort_heap(results, results + numResults, closer);
+	for (int i = 0; i < numResults; i++)
+		results[i].distance = sqrtf(results[i].distance);
+	return numResults;
+}
+
+void runTimbreMatch(float sampleRate)
+{
+	AtlasFile atlas;
+	if (!atlas.open(ATLAS_FILE))
+	{
+		rt_printf("Timbre match: unable to open atlas %s\n", ATLAS_FILE);
+		return;
+	}
+	TimbreIndex index;
+	if (!index.build(atlas))
+	{
+		rt_printf("Timbre match: atlas %s has no rendered points\n", ATLAS_FILE);
+		return;
+	}
+	if (atlas.getHeader().sampleRate != sampleRate)
+		rt_printf("Timbre match: atlas rendered at %.0f Hz, running at %.0f Hz\n", atlas.getHeader().sampleRate, sampleRate);
+	
+	std::vector<float> reference = AudioFileUtilities::loadMono(TIMBRE_MATCH_FILE);
+	if (reference.empty())
+	{
+		rt_printf("Timbre match: unable to load %s\n", TIMBRE_MATCH_FILE);
+		return;
+	}
+	FftAnalyzer analyzer;
+	FeatureExtractor extractor;
+	float features[kNumFeatures];
+	measureAtlasFeatures(analyzer, extractor, reference.data(), reference.size(),
+		atlas.getHeader().sampleRate, kMidiToFreqTable[TIMBRE_MATCH_NOTE], features);
+	
+	// time the query
+	TimbreMatch matches[TIMBRE_MATCH_K];
+	const int kRepeats = 1000;
+	int numMatches = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < kRepeats; i++)
+		numMatches = index.query(features, TIMBRE_MATCH_NOTE, TIMBRE_MATCH_K, matches);
+	double microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / kRepeats;
+	
+	rt_printf("Timbre match: %s (note %d) centroid %.0f Hz, rolloff %.0f Hz, odd/even %.1f dB, attack %.3f s\n",
+		TIMBRE_MATCH_FILE, TIMBRE_MATCH_NOTE, features[kFeatureCentroid], features[kFeatureRolloff],
+		features[kFeatureOddEven], features[kFeatureAttack]);
+	rt_printf("Timbre match: %d nearest of %d points in %.2f us, as sketch.js presets:\n",
+		numMatches, atlas.getNumPoints(), microseconds);
+	AtlasPoint* points = atlas.getPoints();
+	for (int i = 0; i < numMatches; i++)
+	{
+		const AtlasPoint& point = points[matches[i].point];
+		rt_printf("\tnum = [%d, %d, %d, %d]; // distance %.3f, note %d\n",
+			point.timbre[0], point.timbre[1], point.timbre[2], point.timbre[3], matches[i].distance, point.note);
+	}
+}
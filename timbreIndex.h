@@ -0,0 +1,78 @@
+/***** timbreIndex.h *****/
+// Nearest neighbour lookup of timbre points by their features
+// Builds one k-d tree per note of a timbre atlas (see timbreAtlas.h). Features
+// are mapped to a search space where distances are comparable: frequencies
+// on a log scale, then every dimension scaled to unit deviation over the atlas
+// and weighted. Trees are stored implicitly: a node is the middle point of its
+// range of the point order, its children are the two halves either side.
+// The k nearest points are then found in a few microseconds.
+#ifndef TIMBREINDEX_H
+#define TIMBREINDEX_H
+
+#include <vector>
+#include "timbreAtlas.h"
+
+//------------ ENABLE TIMBRE MATCH HERE -----------------
+// suggest presets for a reference recording at setup (needs an atlas)
+#define TIMBRE_MATCH 0
+//------------ ENABLE TIMBRE MATCH HERE -----------------
+
+//------------ CHANGE TIMBRE MATCH HERE -----------------
+#define TIMBRE_MATCH_FILE "reference.wav" // mono or first channel, at the atlas sample rate
+#define TIMBRE_MATCH_NOTE 60 // MIDI note played in the recording
+#define TIMBRE_MATCH_K 5 // number of suggestions
+//------------ CHANGE TIMBRE MATCH HERE -----------------
+
+// one result of a query
+struct TimbreMatch {
+	int point; // index of the atlas point
+	float distance; // in the weighted search space
+};
+
+class TimbreIndex
+{
+public:
+	TimbreIndex();
+	
+	// build the trees of every note in an atlas (the atlas must stay mapped)
+	// returns false if the atlas has no rendered points
+	// CALL IN SETUP (allocates)
+	bool build(AtlasFile& atlas);
+	
+	// find the k points nearest to the features (kNumFeatures, as stored in the atlas)
+	// among those of the atlas note nearest to noteNumber. Results are sorted by
+	// distance, returns the number found (less than k if the note has fewer points)
+	int query(const float* features, int noteNumber, int k, TimbreMatch* results);
+	
+private:
+	// a feature vector in the search space
+	struct Key {
+		float values[kNumFeatures];
+	};
+	// one tree, over a range of order_
+	struct Tree {
+		int note;
+		int begin, end;
+	};
+	
+	void toKey(const float* features, Key& key);
+	// order points [begin, end) into an implicit tree
+	void buildNode(int begin, int end);
+	// search the subtree [begin, end), keeping the k best in results (a max heap)
+	void searchNode(int begin, int end, const Key& key, int k, TimbreMatch* results, int& numResults);
+	
+	AtlasPoint* points_;
+	std::vector<Key> keys_; // search space key of every atlas point
+	std::vector<int> order_; // point indices, grouped by tree and in tree order
+	std::vector<int> splitDims_; // split dimension of the node at each position of order_
+	std::vector<Tree> trees_;
+	// search space transform: key = (feature - mean) * scale
+	float mean_[kNumFeatures];
+	float scale_[kNumFeatures];
+};
+
+// load TIMBRE_MATCH_FILE, measure it like an atlas point and print the nearest
+// presets in the format of sketch.js sendPreset (dev tool, see TIMBRE_MATCH)
+void runTimbreMatch(float sampleRate);
+
+#endif
@@ -0,0 +1,343 @@
+/***** voiceRenderer.cpp *****/
+#include <Bela.h>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "voiceRenderer.h"
+#include "denormals.h"
+
+// workers run just below the audio thread
+static constexpr int kVoiceWorkerPriority = BELA_AUDIO_PRIORITY - 1;
+// spins of the waiting audio thread between reads of the clock
+static constexpr int kVoiceClockSpins = 64;
+
+// benchmark: voice counts, block size and audio rendered per measurement
+static constexpr int kBenchmarkVoices[] = {1, 2, 4, 8, 16, 32};
+static constexpr int kBenchmarkFrames = 64;
+static constexpr float kBenchmarkSeconds = 1.0f;
+
+// tell the core that this is a spin loop
+static inline void spinPause()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || (defined(__arm__) && __ARM_ARCH >= 7)
+	asm volatile("yield");
+#endif
+}
+
+static inline double elapsedMicroseconds(const timespec& start)
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start.tv_sec) * 1e6 + (now.tv_nsec - start.tv_nsec) * 1e-3;
+}
+
+VoiceRenderer::VoiceRenderer()
+{
+	sampleRate_ = 44100;
+	maxFrames_ = 0;
+	numThreads_ = 1;
+	minParallelWork_ = VOICE_MIN_PARALLEL_WORK;
+	lateBlocks_ = 0;
+	lateVoices_ = 0;
+	late_ = false;
+	nextVoice_ = 0;
+	wokenWorkers_ = 0;
+	quit_ = false;
+	blockFrames_ = 0;
+	block_ = 0;
+}
+
+VoiceRenderer::~VoiceRenderer()
+{
+	cleanup();
+}
+
+// CALL IN SETUP
+void VoiceRenderer::setup(const std::vector<Note*>& voices, float sampleRate, int maxFrames, int numThreads)
+{
+	cleanup();
+	voices_ = voices;
+	sampleRate_ = sampleRate;
+	maxFrames_ = maxFrames;
+	voiceOutputs_.assign(voices_.size(), std::vector<float>(maxFrames_, 0));
+	voiceBlocks_.reset(new std::atomic<unsigned int>[voices_.size()]);
+	for (unsigned int v = 0; v < voices_.size(); v++)
+		voiceBlocks_[v] = block_.load();
+
+	int numCores = std::thread::hardware_concurrency();
+	if (numThreads <= 0)
+		numThreads = VOICE_THREADS > 0 ? VOICE_THREADS : numCores;
+	if (numThreads < 1)
+		numThreads = 1;
+	numThreads_ = 1;
+
+	// worker w runs on core w, the audio thread keeps its own (usually core 0)
+	quit_ = false;
+	for (int w = 1; w < numThreads; w++)
+	{
+		std::unique_ptr<Worker> worker(new Worker);
+		worker->renderer = this;
+		sem_init(&worker->start, 0, 0);
+
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		sched_param param = {};
+		param.sched_priority = kVoiceWorkerPriority;
+		pthread_attr_setschedparam(&attr, &param);
+		if (numCores > 1)
+		{
+			cpu_set_t cores;
+			CPU_ZERO(&cores);
+			CPU_SET(w % numCores, &cores);
+			pthread_attr_setaffinity_np(&attr, sizeof(cores), &cores);
+		}
+		int error = pthread_create(&worker->thread, &attr, workerLoop, worker.get());
+		if (error)
+		{
+			// no real-time scheduling allowed (e.g. on a host without privileges)
+			rt_printf("Voice renderer: worker %d is not real-time (error %d)\n", w, error);
+			pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+			error = pthread_create(&worker->thread, &attr, workerLoop, worker.get());
+		}
+		pthread_attr_destroy(&attr);
+		if (error)
+		{
+			rt_printf("Voice renderer: unable to start worker %d (error %d)\n", w, error);
+			sem_destroy(&worker->start);
+			break;
+		}
+		workers_.push_back(std::move(worker));
+		numThreads_++;
+	}
+}
+
+void VoiceRenderer::cleanup()
+{
+	waitForVoices();
+	quit_ = true;
+	for (auto& worker : workers_)
+	{
+		sem_post(&worker->start);
+		pthread_join(worker->thread, NULL);
+		sem_destroy(&worker->start);
+	}
+	workers_.clear();
+	quit_ = false;
+	if (lateBlocks_ > 0)
+		rt_printf("Voice renderer: %d block(s) left out %d voice(s) rendering late\n", lateBlocks_, lateVoices_);
+	lateBlocks_ = 0;
+	lateVoices_ = 0;
+}
+
+// the stamp is the voice's last access, a late worker leaves nothing behind
+// that a later block could count
+void VoiceRenderer::renderVoices()
+{
+	int numVoices = voices_.size();
+	for (int v = nextVoice_++; v < numVoices; v = nextVoice_++)
+	{
+		// the block the voice was taken for
+		unsigned int block = block_.load(std::memory_order_relaxed);
+		int numFrames = blockFrames_.load(std::memory_order_relaxed);
+		voices_[v]->renderBlock(voiceOutputs_[v].data(), numFrames);
+		voiceBlocks_[v].store(block, std::memory_order_release);
+	}
+}
+
+int VoiceRenderer::countRenderedVoices(unsigned int block)
+{
+	int rendered = 0;
+	for (unsigned int v = 0; v < voices_.size(); v++)
+		if (voiceBlocks_[v].load(std::memory_order_acquire) == block)
+			rendered++;
+	return rendered;
+}
+
+// every voice of the last block was taken, the ones without its stamp are
+// still rendering on a worker's own core
+void VoiceRenderer::waitForVoices()
+{
+	if (!late_)
+		return;
+	unsigned int block = block_.load(std::memory_order_relaxed);
+	while (countRenderedVoices(block) < (int) voices_.size())
+		spinPause();
+	late_ = false;
+}
+
+void* VoiceRenderer::workerLoop(void* worker)
+{
+	Worker* self = (Worker*) worker;
+	VoiceRenderer* renderer = self->renderer;
+	ensureFlushToZero();
+	while (true)
+	{
+		// sleep until the next block
+		sem_wait(&self->start);
+		if (renderer->quit_)
+			return NULL;
+		renderer->wokenWorkers_++;
+		renderer->renderVoices();
+	}
+}
+
+void VoiceRenderer::startWorkers()
+{
+	for (auto& worker : workers_)
+		sem_post(&worker->start);
+}
+
+void VoiceRenderer::render(float* output, int numFrames)
+{
+	if (numFrames > maxFrames_)
+		numFrames = maxFrames_;
+	int numVoices = voices_.size();
+	waitForVoices();
+
+	// idle voices only write silence, count the ones that sound
+	int soundingVoices = 0;
+	for (int v = 0; v < numVoices; v++)
+		if (!voices_[v]->isIdle())
+			soundingVoices++;
+
+	// the block is published by resetting the voice counter
+	blockFrames_.store(numFrames, std::memory_order_relaxed);
+	unsigned int block = block_.load(std::memory_order_relaxed) + 1;
+	block_.store(block, std::memory_order_relaxed);
+	nextVoice_ = 0;
+	if (numThreads_ > 1 && soundingVoices * numFrames >= minParallelWork_)
+	{
+		timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		startWorkers();
+		renderVoices();
+		// every voice is taken, wait for the workers' ones until the deadline
+		double maxWait = 1e6 * VOICE_MAX_WAIT * numFrames / sampleRate_;
+		for (int spins = 1; countRenderedVoices(block) < numVoices; spins++)
+		{
+			spinPause();
+			if (spins % kVoiceClockSpins == 0 && elapsedMicroseconds(start) > maxWait)
+			{
+				late_ = true;
+				break;
+			}
+		}
+	}
+	else
+		renderVoices();
+
+	// fixed order sum of the voices rendered for this block, leaving out the late ones
+	for (int n = 0; n < numFrames; n++)
+		output[n] = 0;
+	int lateVoices = 0;
+	for (int v = 0; v < numVoices; v++)
+	{
+		if (voiceBlocks_[v].load(std::memory_order_acquire) != block)
+		{
+			lateVoices++;
+			continue;
+		}
+		const float* voiceOutput = voiceOutputs_[v].data();
+		for (int n = 0; n < numFrames; n++)
+			output[n] += voiceOutput[n];
+	}
+	if (lateVoices > 0)
+	{
+		lateBlocks_++;
+		lateVoices_ += lateVoices;
+	}
+}
+
+double VoiceRenderer::measureSyncTime(int numBlocks)
+{
+	if (numThreads_ < 2)
+		return 0;
+	// no voices to take
+	nextVoice_ = voices_.size();
+	auto start = std::chrono::steady_clock::now();
+	for (int b = 0; b < numBlocks; b++)
+	{
+		wokenWorkers_ = 0;
+		startWorkers();
+		while (wokenWorkers_.load(std::memory_order_acquire) < numThreads_ - 1)
+			spinPause();
+	}
+	double microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	return microseconds / numBlocks;
+}
+
+// start every voice on its own note and spectrum, render a second of audio
+// and return the time per block (microseconds) and the summed output
+static double timeVoices(std::vector<std::unique_ptr<Note>>& notes, int numVoices, int numThreads,
+	float sampleRate, std::vector<float>& output)
+{
+	std::vector<Note*> voices;
+	for (int v = 0; v < numVoices; v++)
+	{
+		notes[v].reset(new Note(sampleRate, 440.0));
+		notes[v]->setAnalyzed(false);
+		notes[v]->setSpectrum((v * 37) % MAX_SPECTRUM);
+		notes[v]->triggerNote(36 + (v * 7) % 48, 100);
+		voices.push_back(notes[v].get());
+	}
+	VoiceRenderer renderer;
+	renderer.setup(voices, sampleRate, kBenchmarkFrames, numThreads);
+	renderer.setMinParallelWork(0);
+
+	int numBlocks = int(kBenchmarkSeconds * sampleRate) / kBenchmarkFrames;
+	output.resize(numBlocks * kBenchmarkFrames);
+	auto start = std::chrono::steady_clock::now();
+	for (int b = 0; b < numBlocks; b++)
+		renderer.render(&output[b * kBenchmarkFrames], kBenchmarkFrames);
+	double microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	return microseconds / numBlocks;
+}
+
+void runVoiceBenchmark(float sampleRate)
+{
+	ensureFlushToZero();
+	int numCores = std::thread::hardware_concurrency();
+	if (numCores < 1)
+		numCores = 1;
+	double blockTime = 1e6 * kBenchmarkFrames / sampleRate;
+	rt_printf("Voice benchmark: %d cores, %d frame blocks (%.0f us), us per block (speedup):\n",
+		numCores, kBenchmarkFrames, blockTime);
+
+	// synchronisation cost of an empty block
+	for (int t = 2; t <= numCores; t++)
+	{
+		VoiceRenderer renderer;
+		renderer.setup(std::vector<Note*>(), sampleRate, kBenchmarkFrames, t);
+		rt_printf("\t%d threads: %.2f us per block synchronisation\n", t, renderer.measureSyncTime(10000));
+	}
+
+	int maxVoices = kBenchmarkVoices[sizeof(kBenchmarkVoices) / sizeof(kBenchmarkVoices[0]) - 1];
+	std::vector<std::unique_ptr<Note>> notes(maxVoices);
+	std::vector<float> reference, output;
+	for (int numVoices : kBenchmarkVoices)
+	{
+		char line[256];
+		int length = snprintf(line, sizeof(line), "\t%2d voices:", numVoices);
+		double singleTime = 0;
+		bool identical = true;
+		for (int t = 1; t <= numCores; t++)
+		{
+			double time = timeVoices(notes, numVoices, t, sampleRate, t == 1 ? reference : output);
+			if (t == 1)
+				singleTime = time;
+			else if (memcmp(output.data(), reference.data(), reference.size() * sizeof(float)) != 0)
+				identical = false;
+			if (length < (int) sizeof(line))
+				length += snprintf(line + length, sizeof(line) - length, " %d: %.1f (%.2fx)", t, time, singleTime / time);
+		}
+		rt_printf("%s%s%s\n", line, singleTime > blockTime ? ", over budget on one core" : "",
+			identical ? "" : ", OUTPUTS DIFFER");
+	}
+}
@@ -0,0 +1,115 @@
+/***** voiceRenderer.h *****/
+// Renders a set of voices (Note objects) on several cores
+// Each block the audio thread publishes the block size and wakes the workers,
+// real-time threads pinned to their own cores one priority below audio, which
+// sleep on a semaphore between blocks. Workers and the audio thread then take
+// voices from a shared atomic counter until all voices are taken, each
+// rendered into its own buffer. The audio thread renders whatever is left and
+// waits for the voices the workers took (a worker that wakes late finds none),
+// but only until VOICE_MAX_WAIT of the block period has passed: a voice still
+// rendering then is left out of the block rather than the audio thread missing
+// its deadline. Until waitForVoices() the late voices must not be touched (they
+// are still rendering), the audio thread calls it before it next touches any
+// voice. Each voice is stamped with the block it was last rendered for, a
+// block is complete when every voice carries its stamp. The voice buffers are
+// summed in voice order, so the output does not depend on which thread
+// rendered which voice. Blocks with too little work for the synchronisation to
+// pay off (fewer sounding voice-samples than the minimum) are rendered on the
+// audio thread alone.
+// On Bela (Xenomai) the threads and semaphores are Cobalt ones through the
+// POSIX wrappers. On its single core there are no workers, every block is
+// rendered in place.
+#ifndef VOICERENDERER_H
+#define VOICERENDERER_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <semaphore.h>
+#include "note.h"
+
+//------------ ENABLE VOICE BENCHMARK HERE -----------------
+// time voices vs threads at setup
+#define VOICE_BENCHMARK 0
+//------------ ENABLE VOICE BENCHMARK HERE -----------------
+
+//------------ CHANGE VOICE RENDERING HERE -----------------
+#define VOICE_THREADS 0 // rendering threads including the audio thread, 0 for one per core
+#define VOICE_MIN_PARALLEL_WORK 256 // sounding voice-samples per block below which one thread renders
+#define VOICE_MAX_WAIT 0.5f // share of the block period the block's voices have to be rendered in
+//------------ CHANGE VOICE RENDERING HERE -----------------
+
+class VoiceRenderer
+{
+public:
+	VoiceRenderer();
+	~VoiceRenderer();
+
+	// voices to render, sample rate, largest block size and number of rendering
+	// threads (including the calling thread, 0 for VOICE_THREADS). Starts the workers
+	// CALL IN SETUP (allocates and starts threads)
+	void setup(const std::vector<Note*>& voices, float sampleRate, int maxFrames, int numThreads);
+	// stop the workers
+	void cleanup();
+
+	// sounding voice-samples per block below which blocks are rendered in place
+	void setMinParallelWork(int minWork) { minParallelWork_ = minWork; }
+	int getNumThreads() { return numThreads_; }
+	// blocks that left out a voice still rendering at the deadline, and the
+	// voices left out
+	int getLateBlocks() { return lateBlocks_; }
+	int getLateVoices() { return lateVoices_; }
+
+	// render every voice and sum them into output (audio thread)
+	void render(float* output, int numFrames);
+	// whether the last block left voices still rendering
+	bool isLate() { return late_; }
+	// wait for the voices the last block left rendering (audio thread). Call
+	// before touching any voice (MIDI, timbre, GUI) after a late block
+	void waitForVoices();
+
+	// time waking the workers until all of them run, with no work (microseconds)
+	double measureSyncTime(int numBlocks);
+
+private:
+	struct Worker {
+		VoiceRenderer* renderer;
+		pthread_t thread;
+		sem_t start; // posted once per block
+	};
+	static void* workerLoop(void* worker);
+	// take voices from the shared counter until none are left
+	void renderVoices();
+	// voices stamped with the block
+	int countRenderedVoices(unsigned int block);
+	// wake every worker for a block
+	void startWorkers();
+
+	std::vector<Note*> voices_;
+	std::vector<std::vector<float>> voiceOutputs_;
+	float sampleRate_;
+	int maxFrames_;
+	int numThreads_;
+	int minParallelWork_;
+	int lateBlocks_;
+	int lateVoices_;
+	bool late_;
+
+	std::vector<std::unique_ptr<Worker>> workers_;
+	std::atomic<int> nextVoice_; // next voice to take
+	std::atomic<int> wokenWorkers_; // workers woken so far (see measureSyncTime)
+	std::atomic<bool> quit_;
+	// frames and number of the current block, set before nextVoice_
+	std::atomic<int> blockFrames_;
+	std::atomic<unsigned int> block_;
+	// per voice: the block it was last rendered for
+	std::unique_ptr<std::atomic<unsigned int>[]> voiceBlocks_;
+};
+
+// time blocks of voices vs numbers of threads, check the outputs match and
+// print the table (dev tool, see VOICE_BENCHMARK)
+void runVoiceBenchmark(float sampleRate);
+
+#endif
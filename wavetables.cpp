@@ -0,0 +1,139 @@
+/***** wavetables.cpp *****/
+#include <libraries/ne10/NE10.h>
+#include <cmath>
+#include <memory>
+#include "wavetables.h"
+#include "freqMod.h"
+
+// padding before a table (after it there are two samples)
+static constexpr int kTablePadding = 1;
+
+// build every size at once, so reading them later never allocates
+static std::vector<std::unique_ptr<WavetableSet>> buildWavetableSets()
+{
+	std::vector<std::unique_ptr<WavetableSet>> sets;
+	for (int size = WAVETABLE_MIN_SIZE; size <= WAVETABLE_MAX_SIZE; size *= 2)
+		sets.emplace_back(new WavetableSet(size));
+	return sets;
+}
+
+const WavetableSet& WavetableSet::get(int size)
+{
+	static const std::vector<std::unique_ptr<WavetableSet>> sets = buildWavetableSets();
+	unsigned int index = 0;
+	while (index + 1 < sets.size() && sets[index]->size() < size)
+		index++;
+	return *sets[index];
+}
+
+WavetableSet::WavetableSet(int size)
+{
+	size_ = size;
+	numLevels_ = 0;
+	while ((size_ >> (numLevels_ + 1)) > 1)
+		numLevels_++;
+	stride_ = size_ + 3;
+	data_.assign(NUM_WAVETABLE_SHAPES * (1 + numLevels_) * stride_, 0);
+
+	// naive tables, as FreqMod always drew them (the sine is a little short of a cycle)
+	float invSize = 1.0 / float(size_ + 1);
+	float* sine = table(kWaveSine, -1);
+	float* tri = table(kWaveTriangle, -1);
+	float* square = table(kWaveSquare, -1);
+	float* saw = table(kWaveSaw, -1);
+	for (int i = 0; i < size_; i++)
+	{
+		sine[i] = sinf(2*M_PI*i*invSize);
+		saw[i] = 2*float(size_ - i)/size_ - 1;
+		if (i < size_ / 2)
+		{
+			tri[i] = 4*float(i)/size_ - 1;
+			square[i] = 1;
+		}
+		else
+		{
+			tri[i] = 3.0 - 4* float(i)/size_;
+			square[i] = -1;
+		}
+	}
+
+	// band-limited tables from the Fourier series of the naive shapes. A harmonic
+	// a cos + b sin goes in bins k and N - k as (a, b) / 2 and (a, -b) / 2, the
+	// real part of their forward transform is the waveform
+	ne10_fft_cpx_float32_t* neInput = (ne10_fft_cpx_float32_t*) NE10_MALLOC (size_ * sizeof (ne10_fft_cpx_float32_t));
+	ne10_fft_cpx_float32_t* neOutput = (ne10_fft_cpx_float32_t*) NE10_MALLOC (size_ * sizeof (ne10_fft_cpx_float32_t));
+	ne10_fft_cfg_float32_t cfg = ne10_fft_alloc_c2c_float32_neon (size_);
+	for (int shape = 0; shape < NUM_WAVETABLE_SHAPES; shape++)
+	{
+		for (int level = 0; level < numLevels_; level++)
+		{
+			int numHarmonics = (size_ >> (level + 1)) - 1;
+			for (int k = 0; k < size_; k++)
+			{
+				neInput[k].r = 0;
+				neInput[k].i = 0;
+			}
+			for (int k = 1; k <= numHarmonics; k++)
+			{
+				float a = 0, b = 0;
+				if (shape == kWaveSine)
+					b = (k == 1);
+				else if (shape == kWaveSaw)
+					b = 2.0 / (M_PI * k);
+				else if (shape == kWaveSquare)
+					b = (k % 2) ? 4.0 / (M_PI * k) : 0;
+				else if (shape == kWaveTriangle)
+					a = (k % 2) ? -8.0 / (M_PI * M_PI * k * k) : 0;
+				neInput[k].r = 0.5f * a;
+				neInput[k].i = 0.5f * b;
+				neInput[size_ - k].r = 0.5f * a;
+				neInput[size_ - k].i = -0.5f * b;
+			}
+			ne10_fft_c2c_1d_float32_neon (neOutput, neInput, cfg, 0);
+			float* values = table(shape, level);
+			for (int i = 0; i < size_; i++)
+				values[i] = neOutput[i].r;
+		}
+	}
+	NE10_FREE(neInput);
+	NE10_FREE(neOutput);
+	NE10_FREE(cfg);
+
+	// wrap the padding around
+	for (int shape = 0; shape < NUM_WAVETABLE_SHAPES; shape++)
+	{
+		for (int level = -1; level < numLevels_; level++)
+		{
+			float* values = table(shape, level);
+			values[-1] = values[size_ - 1];
+			values[size_] = values[0];
+			values[size_ + 1] = values[1];
+		}
+	}
+}
+
+const float* WavetableSet::naive(int shape) const
+{
+	return table(shape, -1);
+}
+
+const float* WavetableSet::bandLimited(int shape, float cyclesPerSample) const
+{
+	// lowest level whose top harmonic is still below Nyquist
+	cyclesPerSample = fabsf(cyclesPerSample);
+	int level = 0;
+	while (level < numLevels_ - 1 && ((size_ >> (level + 1)) - 1) * cyclesPerSample > 0.5f)
+		level++;
+	return table(shape, level);
+}
+
+// level -1 is the naive table
+float* WavetableSet::table(int shape, int level)
+{
+	return &data_[(shape * (1 + numLevels_) + level + 1) * stride_ + kTablePadding];
+}
+
+const float* WavetableSet::table(int shape, int level) const
+{
+	return &data_[(shape * (1 + numLevels_) + level + 1) * stride_ + kTablePadding];
+}
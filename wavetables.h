@@ -0,0 +1,71 @@
+/***** wavetables.h *****/
+// Shared operator wavetables, one set per table size
+// Every size from WAVETABLE_MIN_SIZE to WAVETABLE_MAX_SIZE (powers of 2) has
+// naive tables, the waveshapes drawn sample by sample, and band-limited tables
+// built from their Fourier series, one per octave of playing frequency with
+// the harmonics that fit below Nyquist. The sets are built once, the first
+// time one is asked for, and read by every operator.
+// Tables are padded with one sample before and two after, wrapped around, so
+// they can be read with cubic interpolation at any phase in [0, size).
+#ifndef WAVETABLES_H
+#define WAVETABLES_H
+
+#include <vector>
+
+#define WAVETABLE_MIN_SIZE 256
+#define WAVETABLE_MAX_SIZE 4096
+#define NUM_WAVETABLE_SHAPES 4 // sine, triangle, square and saw (see waveShapes in freqMod.h)
+
+// enumerator for the ways to read a table between samples
+enum interpolations {
+	kInterpTruncate = 0, // sample below the phase
+	kInterpLinear, // straight line between the samples either side
+	kInterpCubic // cubic Hermite through the four closest samples
+};
+
+class WavetableSet
+{
+public:
+	// the shared set of a size (rounded to a power of 2 between the min and max)
+	// the first call builds every set (allocates), make it in setup
+	static const WavetableSet& get(int size);
+
+	int size() const { return size_; }
+	// naive table of a waveshape
+	const float* naive(int shape) const;
+	// band-limited table of a waveshape for a frequency (cycles per sample)
+	const float* bandLimited(int shape, float cyclesPerSample) const;
+
+	WavetableSet(int size);
+
+private:
+	float* table(int shape, int level);
+	const float* table(int shape, int level) const;
+
+	int size_;
+	int numLevels_; // band-limited levels, level l has size / 2^(l+1) - 1 harmonics
+	int stride_; // floats per table, size_ plus padding
+	// per shape: the naive table, then the band-limited levels
+	std::vector<float> data_;
+};
+
+// read a padded table at a phase in [0, size)
+static inline float readWavetable(const float* table, float phase, int interpolation)
+{
+	int index = int(phase);
+	float fraction = phase - index;
+	if (interpolation == kInterpTruncate)
+		return table[index];
+	if (interpolation == kInterpLinear)
+		return (1.0f - fraction) * table[index] + fraction * table[index + 1];
+	float y0 = table[index - 1];
+	float y1 = table[index];
+	float y2 = table[index + 1];
+	float y3 = table[index + 2];
+	float c1 = 0.5f * (y2 - y0);
+	float c2 = y0 - 2.5f * y1 + 2.0f * y2 - 0.5f * y3;
+	float c3 = 0.5f * (y3 - y0) + 1.5f * (y1 - y2);
+	return ((c3 * fraction + c2) * fraction + c1) * fraction + y1;
+}
+
+#endif